@@ -37,6 +37,9 @@
 
 #define _MODBUS_ASCII_CHECKSUM_LENGTH    3 /* lcr8 + \r\n */
 
+/* Characters read ahead of the decoding, a whole frame fits */
+#define _MODBUS_ASCII_RX_BUF_LENGTH      (2 * MODBUS_ASCII_MAX_ADU_LENGTH + 3)
+
 #if defined(_WIN32)
 #if !defined(ENOTSUP)
 #define ENOTSUP WSAEOPNOTSUPP
@@ -81,6 +84,16 @@ typedef struct _modbus_rtu {
 #endif
     /* To handle many slaves on the same link */
     int confirmation_to_ignore;
+    /* Characters read but not decoded yet, from rx_start to rx_end */
+    uint8_t rx_buf[_MODBUS_ASCII_RX_BUF_LENGTH];
+    int rx_start;
+    int rx_end;
+    /* Frame being received, its bytes decoded so far and the sum of the
+       hex ones */
+    const uint8_t *rx_msg;
+    int rx_length;
+    int rx_lrc_length;
+    uint8_t rx_lrc;
 } modbus_ascii_t;
 
 #endif /* _MODBUS_RTU_PRIVATE_H_ */
@@ -39,8 +39,7 @@
 #include <linux/serial.h>
 #endif
 
-static int _modbus_ascii_select(modbus_t *ctx, fd_set *rset,
-                       struct timeval *tv, int length_to_read);
+static int _modbus_ascii_wait_line(modbus_t *ctx, struct timeval *tv);
 
 static int _modbus_ascii_flush(modbus_t *);
 
@@ -204,27 +203,30 @@ static int win32_ser_read(struct win32_ser *ws, uint8_t *p_msg,
 }
 #endif
 
-static char nibble_to_hex_ascii(uint8_t nibble) {
-    char c;
-    if (nibble < 10) {
-        c = nibble + '0';
-    } else {
-        c = nibble - 10 + 'A';
-    }
-    return c;
-}
-
-static uint8_t hex_ascii_to_nibble(char digit) {
-    if (digit >= '0' && digit <= '9' ) {
-        return digit - '0'; 
-    } else if (digit >= 'A' && digit <= 'F' ) {
-        return digit - 'A' + 10;
-    } else if (digit >= 'a' && digit <= 'f' ) {
-        return digit - 'a' + 10;
-    }
-    return 0xff; 
-}
+static const char hex_ascii_digits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
 
+/* Value of each hex digit, 0xFF for any other character */
+static const uint8_t hex_ascii_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
 
 static ssize_t _modbus_ascii_send(modbus_t *ctx, const uint8_t *req, int req_length)
 {
@@ -236,8 +238,8 @@ static ssize_t _modbus_ascii_send(modbus_t *ctx, const uint8_t *req, int req_len
     ascii_req[0] = req[0]; // ':'
     k = 1;
     for (i = 1; i < req_length - 2; ++i) {
-        ascii_req[k++] = nibble_to_hex_ascii(req[i] >> 4);
-        ascii_req[k++] = nibble_to_hex_ascii(req[i] & 0x0f);
+        ascii_req[k++] = hex_ascii_digits[req[i] >> 4];
+        ascii_req[k++] = hex_ascii_digits[req[i] & 0x0f];
     }
     ascii_req[k++] = req[i++]; // '\r'
     ascii_req[k++] = req[i++]; // '\n'
@@ -277,62 +279,123 @@ static int _modbus_ascii_receive(modbus_t *ctx, uint8_t *req)
     return rc;
 }
 
-static ssize_t _modbus_ascii_recv_char(modbus_t *ctx, char *p_char_rsp, uint8_t with_select)
+/* Reads whatever the line has to give in one call, after the characters
+   not decoded yet */
+static ssize_t _modbus_ascii_fill(modbus_t *ctx)
 {
-    int rc;
-    fd_set rset;
-    struct timeval tv;
+    modbus_ascii_t *ctx_ascii = ctx->backend_data;
+    int pending = ctx_ascii->rx_end - ctx_ascii->rx_start;
     ssize_t size;
 
-    if (with_select) {
-        FD_ZERO(&rset);
-        FD_SET(ctx->s, &rset);
-
-        if (ctx->byte_timeout.tv_sec >= 0 && ctx->byte_timeout.tv_usec >= 0) {
-            /* Byte timeout can be disabled with negative values */
-            tv.tv_sec = ctx->byte_timeout.tv_sec;
-            tv.tv_usec = ctx->byte_timeout.tv_usec;
-        } else {
-            tv.tv_sec = ctx->response_timeout.tv_sec;
-            tv.tv_usec = ctx->response_timeout.tv_usec;
-        }
-
-        rc = _modbus_ascii_select(ctx, &rset, &tv, 1);
-        if (rc == -1) {
-            return 0;
-        }
+    if (ctx_ascii->rx_start > 0) {
+        memmove(ctx_ascii->rx_buf, ctx_ascii->rx_buf + ctx_ascii->rx_start, pending);
+        ctx_ascii->rx_start = 0;
+        ctx_ascii->rx_end = pending;
     }
+
 #if defined(_WIN32)
-    size = win32_ser_read(&((modbus_ascii_t *)ctx->backend_data)->w_ser, p_char_rsp, 1);
+    size = win32_ser_read(&ctx_ascii->w_ser, ctx_ascii->rx_buf + pending,
+                          _MODBUS_ASCII_RX_BUF_LENGTH - pending);
 #else
-    size = read(ctx->s, p_char_rsp, 1);
+    size = read(ctx->s, ctx_ascii->rx_buf + pending,
+                _MODBUS_ASCII_RX_BUF_LENGTH - pending);
 #endif
+    if (size > 0) {
+        ctx_ascii->rx_end += size;
+    }
+
     return size;
 }
 
+/* Decodes at most rsp_length bytes of the buffered characters and adds the
+   hex ones to the LRC of the frame. A digit without its pair is left for
+   the next read. */
+static int _modbus_ascii_decode(modbus_ascii_t *ctx_ascii, uint8_t *rsp, int rsp_length)
+{
+    const uint8_t *p = ctx_ascii->rx_buf + ctx_ascii->rx_start;
+    const uint8_t *end = ctx_ascii->rx_buf + ctx_ascii->rx_end;
+    uint8_t lrc = ctx_ascii->rx_lrc;
+    int lrc_length = 0;
+    int length = 0;
+
+    /* A frame starts at its colon, anything before is line noise */
+    if (ctx_ascii->rx_length == 0) {
+        while (p < end && *p != ':') {
+            p++;
+        }
+    }
+
+    while (length < rsp_length && p < end) {
+        if (*p == ':' || *p == '\r' || *p == '\n') {
+            rsp[length++] = *p++;
+        } else if (end - p >= 2) {
+            uint8_t byte = (uint8_t)(hex_ascii_values[p[0]] << 4) | hex_ascii_values[p[1]];
+
+            rsp[length++] = byte;
+            lrc += byte;
+            lrc_length++;
+            p += 2;
+        } else {
+            break;
+        }
+    }
+
+    ctx_ascii->rx_start = p - ctx_ascii->rx_buf;
+    ctx_ascii->rx_length += length;
+    ctx_ascii->rx_lrc_length += lrc_length;
+    ctx_ascii->rx_lrc = lrc;
+
+    return length;
+}
 
 static ssize_t _modbus_ascii_recv(modbus_t *ctx, uint8_t *rsp, int rsp_length)
 {
-    char char_resp;
-    uint8_t nibble_resp;
+    modbus_ascii_t *ctx_ascii = ctx->backend_data;
+    ssize_t size;
+    int length;
 
-    // Call here without select, because we are already selected
-    if (_modbus_ascii_recv_char(ctx, &char_resp, 0) != 1) {
-        return 0;
+    /* wait() has reported buffered characters or the line readable */
+    if (ctx_ascii->rx_start == ctx_ascii->rx_end) {
+        size = _modbus_ascii_fill(ctx);
+        if (size <= 0) {
+            return size;
+        }
     }
 
-    if (char_resp == ':' || char_resp == '\r' || char_resp == '\n') {
-        *rsp = char_resp;
-    } else {
-        nibble_resp = hex_ascii_to_nibble(char_resp);
-        *rsp = nibble_resp << 4;
-        if (_modbus_ascii_recv_char(ctx, &char_resp, 1) != 1) {
-            return 0;
+    /* Only noise or half a byte, the rest is at most a byte timeout away */
+    while ((length = _modbus_ascii_decode(ctx_ascii, rsp, rsp_length)) == 0) {
+        struct timeval tv;
+
+        if (ctx->byte_timeout.tv_sec >= 0 && ctx->byte_timeout.tv_usec >= 0) {
+            /* Byte timeout can be disabled with negative values */
+            tv = ctx->byte_timeout;
+        } else {
+            tv = ctx->response_timeout;
         }
-        nibble_resp = hex_ascii_to_nibble(char_resp);
-        *rsp |= nibble_resp;
+
+        if (_modbus_ascii_wait_line(ctx, &tv) == -1) {
+            return -1;
+        }
+        size = _modbus_ascii_fill(ctx);
+        if (size <= 0) {
+            return size;
+        }
+    }
+
+    return length;
+}
+
+/* Starts the LRC of the frame received in msg */
+static void _modbus_ascii_recv_progress(modbus_t *ctx, const uint8_t *msg, int msg_length)
+{
+    modbus_ascii_t *ctx_ascii = ctx->backend_data;
+
+    if (msg_length == 0) {
+        ctx_ascii->rx_msg = msg;
+        ctx_ascii->rx_length = 0;
+        ctx_ascii->rx_lrc_length = 0;
+        ctx_ascii->rx_lrc = 0;
     }
-    return 1;
 }
 
 static int _modbus_ascii_pre_check_confirmation(modbus_t *ctx, const uint8_t *req,
@@ -359,6 +422,7 @@ static int _modbus_ascii_pre_check_confirmation(modbus_t *ctx, const uint8_t *re
 static int _modbus_ascii_check_integrity(modbus_t *ctx, uint8_t *msg,
                                        const int msg_length)
 {
+    modbus_ascii_t *ctx_ascii = ctx->backend_data;
     uint8_t lcr;
     char colon = msg[0];
     int slave = msg[1];
@@ -382,7 +446,12 @@ static int _modbus_ascii_check_integrity(modbus_t *ctx, uint8_t *msg,
         return 0;
     }
 
-    lcr = lcr8(msg + 1, msg_length - 3); /* strip ":" and "\r\n" */
+    /* strip ":" and "\r\n", the sum was made while decoding */
+    if (msg == ctx_ascii->rx_msg && ctx_ascii->rx_lrc_length == msg_length - 3) {
+        lcr = -ctx_ascii->rx_lrc;
+    } else {
+        lcr = lcr8(msg + 1, msg_length - 3);
+    }
     /* Check CRC of msg */
     if (lcr == 0) {
         return msg_length;
@@ -901,6 +970,10 @@ static int _modbus_ascii_connect(modbus_t *ctx)
     }
 #endif
 
+    /* Nothing read ahead on a previous connection is kept */
+    ctx_ascii->rx_start = 0;
+    ctx_ascii->rx_end = 0;
+
     return 0;
 }
 
@@ -1001,8 +1074,11 @@ static void _modbus_ascii_close(modbus_t *ctx)
 
 static int _modbus_ascii_flush(modbus_t *ctx)
 {
-#if defined(_WIN32)
     modbus_ascii_t *ctx_ascii = ctx->backend_data;
+
+    ctx_ascii->rx_start = 0;
+    ctx_ascii->rx_end = 0;
+#if defined(_WIN32)
     ctx_ascii->w_ser.n_bytes = 0;
     return (FlushFileBuffers(ctx_ascii->w_ser.fd) == FALSE);
 #else
@@ -1010,14 +1086,12 @@ static int _modbus_ascii_flush(modbus_t *ctx)
 #endif
 }
 
-static int _modbus_ascii_select(modbus_t *ctx, fd_set *rset,
-                       struct timeval *tv, int length_to_read)
+/* Waits for characters on the line itself */
+static int _modbus_ascii_wait_line(modbus_t *ctx, struct timeval *tv)
 {
+#if defined(_WIN32)
     int s_rc;
 
-    (void)length_to_read; /* unused */
-
-#if defined(_WIN32)
     s_rc = win32_ser_select(&(((modbus_ascii_t*)ctx->backend_data)->w_ser),
                             1, tv);
     if (s_rc == 0) {
@@ -1028,28 +1102,25 @@ static int _modbus_ascii_select(modbus_t *ctx, fd_set *rset,
     if (s_rc < 0) {
         return -1;
     }
+
+    return s_rc;
 #else
-    while ((s_rc = select(ctx->s+1, rset, NULL, NULL, tv)) == -1) {
-        if (errno == EINTR) {
-            if (ctx->debug) {
-                fprintf(stderr, "A non blocked signal was caught\n");
-            }
-            /* Necessary after an error */
-            FD_ZERO(rset);
-            FD_SET(ctx->s, rset);
-        } else {
-            return -1;
-        }
-    }
+    return _modbus_wait_fd(ctx->s, _MODBUS_WAIT_READ, tv);
+#endif
+}
 
-    if (s_rc == 0) {
-        /* Timeout */
-        errno = ETIMEDOUT;
-        return -1;
+static int _modbus_ascii_wait(modbus_t *ctx, struct timeval *tv, int length_to_read)
+{
+    modbus_ascii_t *ctx_ascii = ctx->backend_data;
+
+    (void)length_to_read; /* unused */
+
+    /* Characters read ahead are decoded first */
+    if (ctx_ascii->rx_start < ctx_ascii->rx_end) {
+        return 1;
     }
-#endif
 
-    return s_rc;
+    return _modbus_ascii_wait_line(ctx, tv);
 }
 
 static void _modbus_ascii_free(modbus_t *ctx) {
@@ -1068,15 +1139,17 @@ const modbus_backend_t _modbus_ascii_backend = {
     _modbus_ascii_build_response_basis,
     _modbus_ascii_prepare_response_tid,
     _modbus_ascii_send_msg_pre,
+    NULL,
     _modbus_ascii_send,
     _modbus_ascii_receive,
     _modbus_ascii_recv,
     _modbus_ascii_check_integrity,
+    _modbus_ascii_recv_progress,
     _modbus_ascii_pre_check_confirmation,
     _modbus_ascii_connect,
     _modbus_ascii_close,
     _modbus_ascii_flush,
-    _modbus_ascii_select,
+    _modbus_ascii_wait,
     _modbus_ascii_free
 };
 
@@ -1115,6 +1188,7 @@ modbus_t* modbus_new_ascii(const char *device,
     }
     ctx_ascii->data_bit = data_bit;
     ctx_ascii->stop_bit = stop_bit;
+    ctx->char_time = (1000 * 1000) * (1 + data_bit + (parity == 'N' ? 0 : 1) + stop_bit) / baud;
 
 #if HAVE_DECL_TIOCSRS485
     /* The RS232 mode has been set by default */
@@ -1122,6 +1196,12 @@ modbus_t* modbus_new_ascii(const char *device,
 #endif
 
     ctx_ascii->confirmation_to_ignore = FALSE;
+    ctx_ascii->rx_start = 0;
+    ctx_ascii->rx_end = 0;
+    ctx_ascii->rx_msg = NULL;
+    ctx_ascii->rx_length = 0;
+    ctx_ascii->rx_lrc_length = 0;
+    ctx_ascii->rx_lrc = 0;
 
     return ctx;
 }
@@ -51,6 +51,17 @@ MODBUS_BEGIN_DECLS
 #define _RESPONSE_TIMEOUT    500000
 #define _BYTE_TIMEOUT        500000
 
+/* Turnaround delay after a broadcast on a serial line (0.1 s) */
+#define _BROADCAST_DELAY     100000
+
+/* Adaptive timeouts, see modbus_set_adaptive_timeout() */
+#define _MODBUS_LATENCY_SLAVES          16
+#define _MODBUS_LATENCY_BUCKETS         96      /* 4 per octave, up to 33 s */
+#define _MODBUS_LATENCY_WINDOW          512     /* counts are halved beyond */
+#define _MODBUS_LATENCY_MIN_SAMPLES     16
+#define _MODBUS_LATENCY_DEAD_FAILURES   3
+#define _MODBUS_LATENCY_MARGIN          5000    /* us, scheduling and USB */
+
 typedef enum {
     _MODBUS_BACKEND_TYPE_RTU=0,
     _MODBUS_BACKEND_TYPE_TCP, 
@@ -77,6 +88,44 @@ typedef struct _sft {
     int t_id;
 } sft_t;
 
+/* Response times of one slave (or of the whole bus) */
+typedef struct _modbus_latency {
+    int slave;                  /* -1 when the slot is free */
+    uint32_t ewma;              /* us, smoothed with a 1/8 gain */
+    uint16_t count;             /* samples in the histogram */
+    uint16_t failures;          /* timeouts since the last response */
+    uint32_t last_use;
+    uint16_t histogram[_MODBUS_LATENCY_BUCKETS];
+} _modbus_latency_t;
+
+/* Progress of the frame being received, kept between reads so a frame can
+   be assembled over several wake ups of an event loop */
+typedef struct _modbus_rx {
+    int step;
+    int length_to_read;
+    int msg_length;
+    uint64_t first;             /* arrival of the first and last chunks */
+    uint64_t last;
+    uint64_t largest_gap;
+} _modbus_rx_t;
+
+/* A transaction submitted with modbus_submit_*() */
+typedef struct _modbus_pending {
+    int active;
+    uint32_t seq;               /* order of submission */
+    int slave;
+    int function;
+    int nb;                     /* values to store in dest */
+    void *dest;
+    modbus_completion_fnc_t callback;
+    void *user_data;
+    int broadcast;              /* succeeds at the deadline, unanswered */
+    uint64_t start;             /* us, when the request was sent */
+    uint64_t deadline;          /* us, end of the response timeout */
+    struct timeval byte_timeout;
+    uint8_t req[MODBUS_TCP_MAX_ADU_LENGTH];
+} _modbus_pending_t;
+
 typedef struct _modbus_backend {
     unsigned int backend_type;
     unsigned int header_length;
@@ -88,17 +137,23 @@ typedef struct _modbus_backend {
     int (*build_response_basis) (sft_t *sft, uint8_t *rsp);
     int (*prepare_response_tid) (const uint8_t *req, int *req_length);
     int (*send_msg_pre) (uint8_t *req, int req_length);
+    /* Optional, updates a prepared request before each send */
+    void (*renew_request) (modbus_t *ctx, uint8_t *req);
     ssize_t (*send) (modbus_t *ctx, const uint8_t *req, int req_length);
     int (*receive) (modbus_t *ctx, uint8_t *req);
     ssize_t (*recv) (modbus_t *ctx, uint8_t *rsp, int rsp_length);
     int (*check_integrity) (modbus_t *ctx, uint8_t *msg,
                             const int msg_length);
+    /* Optional, called with 0 before a frame and after each chunk read */
+    void (*recv_progress) (modbus_t *ctx, const uint8_t *msg, int msg_length);
     int (*pre_check_confirmation) (modbus_t *ctx, const uint8_t *req,
                                    const uint8_t *rsp, int rsp_length);
     int (*connect) (modbus_t *ctx);
     void (*close) (modbus_t *ctx);
     int (*flush) (modbus_t *ctx);
-    int (*select) (modbus_t *ctx, fd_set *rset, struct timeval *tv, int msg_length);
+    /* Waits until msg_length bytes may be read, at most tv which is left
+       with the time remaining */
+    int (*wait) (modbus_t *ctx, struct timeval *tv, int msg_length);
     void (*free) (modbus_t *ctx);
 } modbus_backend_t;
 
@@ -111,17 +166,55 @@ struct _modbus {
     int error_recovery;
     struct timeval response_timeout;
     struct timeval byte_timeout;
+    struct timeval broadcast_delay;
 	uint16_t last_crc_expected;
 	uint16_t last_crc_received;
     const modbus_backend_t *backend;
     void *backend_data;
     modbus_monitor_add_item_fnc_t monitor_add_item;
     modbus_monitor_raw_data_fnc_t monitor_raw_data;
+    /* Time in micro seconds to transmit one character, 0 on TCP */
+    int char_time;
+    int adaptive_timeout;
+    int request_function;       /* of the last request sent, -1 if none */
+    uint32_t latency_clock;
+    _modbus_latency_t latency_bus;  /* all slaves, the guess for new ones */
+    _modbus_latency_t latency_gap;  /* largest silence inside a frame */
+    _modbus_latency_t latency[_MODBUS_LATENCY_SLAVES];
+    /* Transactions of modbus_submit_*(), the confirmation being received
+       is shared, frames come one after the other on the socket */
+    int pipeline_depth;
+    int nb_pending;
+    uint32_t pending_seq;
+    _modbus_rx_t rx;
+    uint64_t rx_deadline;       /* byte timeout of a started frame, or 0 */
+    uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+    _modbus_pending_t pending[MODBUS_TCP_MAX_PIPELINE_DEPTH];
 };
 
+/* A request of modbus_prepare_*(), ready to be written as is */
+struct _modbus_prepared {
+    const modbus_backend_t *backend;
+    int slave;
+    int function;
+    int nb;
+    int req_length;             /* checksum included */
+    int rsp_length;             /* of the confirmation expected */
+    uint8_t req[MODBUS_MAX_ADU_LENGTH];
+};
+
+/* Events of _modbus_wait_fd() */
+#define _MODBUS_WAIT_READ   1
+#define _MODBUS_WAIT_WRITE  2
+
 void _modbus_init_common(modbus_t *ctx);
+uint64_t _modbus_time_us(void);
+int _modbus_wait_fd(int fd, int events, struct timeval *tv);
+void _modbus_reset_latency(modbus_t *ctx);
+void _modbus_reset_pending(modbus_t *ctx);
 void _error_print(modbus_t *ctx, const char *context);
 int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type);
+void _modbus_monitor_decode(modbus_t *ctx, const uint8_t *msg, int msg_len);
 
 #ifndef HAVE_STRLCPY
 size_t strlcpy(char *dest, const char *src, size_t dest_size);
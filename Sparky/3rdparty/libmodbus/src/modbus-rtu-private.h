@@ -41,6 +41,13 @@
    data before to read */
 #define _MODBUS_RTU_TIME_BETWEEN_RTS_SWITCH 10000
 
+/* Above 19200 bauds the spec fixes the inter-frame delay (t3.5) to 1750 us */
+#define _MODBUS_RTU_T35_MIN_TIME       1750
+
+/* In low latency mode, reads of at least as many bytes wake up once the
+   driver holds them all (VMIN), shorter ones at the first byte */
+#define _MODBUS_RTU_VMIN_MIN_LENGTH    8
+
 #if defined(_WIN32)
 #if !defined(ENOTSUP)
 #define ENOTSUP WSAEOPNOTSUPP
@@ -75,6 +82,10 @@ typedef struct _modbus_rtu {
 #else
     /* Save old termios settings */
     struct termios old_tios;
+    /* Settings in use, VMIN is changed in low latency mode */
+    struct termios tios;
+    /* Driver flags before low latency was asked, -1 when left alone */
+    int old_serial_flags;
 #endif
 #if HAVE_DECL_TIOCSRS485
     int serial_mode;
@@ -85,6 +96,22 @@ typedef struct _modbus_rtu {
 #endif
     /* To handle many slaves on the same link */
     int confirmation_to_ignore;
+    /* Time in micro seconds to transmit one character and the 3.5 characters
+       of silence required between two frames */
+    int char_time;
+    int t35_time;
+    /* Time stamp (us) at which the last byte seen on the line ended */
+    uint64_t frame_end;
+    /* CRC of the frame being received, folded in while it arrives */
+    const uint8_t *rx_msg;
+    int rx_crc_length;
+    uint16_t rx_crc;
+    /* Opt-in, see modbus_rtu_set_low_latency() */
+    int low_latency;
+    /* Round trips of the requests, low latency off [0] and on [1] */
+    uint64_t request_start;
+    uint32_t round_trip_count[2];
+    uint64_t round_trip_sum[2];
 } modbus_rtu_t;
 
 #endif /* MODBUS_RTU_PRIVATE_H */
@@ -44,6 +44,16 @@ MODBUS_API int modbus_rtu_get_serial_mode(modbus_t *ctx);
 MODBUS_API int modbus_rtu_set_rts(modbus_t *ctx, int mode);
 MODBUS_API int modbus_rtu_get_rts(modbus_t *ctx);
 
+MODBUS_API int modbus_rtu_set_low_latency(modbus_t *ctx, int enable);
+MODBUS_API int modbus_rtu_get_low_latency(modbus_t *ctx);
+MODBUS_API int modbus_rtu_get_round_trip(modbus_t *ctx, int low_latency, uint32_t *mean_us);
+
+MODBUS_API uint16_t modbus_rtu_crc16(const uint8_t *buffer, int length);
+
+MODBUS_API int modbus_rtu_get_t35_time(modbus_t *ctx);
+MODBUS_API int modbus_rtu_monitor_read(modbus_t *ctx, uint8_t *dest, int max_length);
+MODBUS_API void modbus_rtu_monitor_frame(modbus_t *ctx, const uint8_t *msg, int msg_length);
+
 MODBUS_END_DECLS
 
 #endif /* MODBUS_RTU_H */
@@ -99,9 +99,8 @@ static int _modbus_set_slave(modbus_t *ctx, int slave)
 }
 
 /* Builds a TCP request header */
-static int _modbus_tcp_build_request_basis(modbus_t *ctx, int function,
-                                           int addr, int nb,
-                                           uint8_t *req)
+/* Gives the request a new transaction ID */
+static void _modbus_tcp_renew_request(modbus_t *ctx, uint8_t *req)
 {
     modbus_tcp_t *ctx_tcp = ctx->backend_data;
 
@@ -112,6 +111,13 @@ static int _modbus_tcp_build_request_basis(modbus_t *ctx, int function,
         ctx_tcp->t_id = 0;
     req[0] = ctx_tcp->t_id >> 8;
     req[1] = ctx_tcp->t_id & 0x00ff;
+}
+
+static int _modbus_tcp_build_request_basis(modbus_t *ctx, int function,
+                                           int addr, int nb,
+                                           uint8_t *req)
+{
+    _modbus_tcp_renew_request(ctx, req);
 
     /* Protocol Modbus */
     req[2] = 0;
@@ -206,7 +212,7 @@ static int _modbus_tcp_pre_check_confirmation(modbus_t *ctx, const uint8_t *req,
     }
 
     /* Check protocol ID */
-    if (rsp[2] != 0x0 && rsp[3] != 0x0) {
+    if (rsp[2] != 0x0 || rsp[3] != 0x0) {
         if (ctx->debug) {
             fprintf(stderr, "Invalid protocol ID received 0x%X (not 0x0)\n",
                     (rsp[2] << 8) + rsp[3]);
@@ -280,16 +286,13 @@ static int _connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen,
 #else
     if (rc == -1 && errno == EINPROGRESS) {
 #endif
-        fd_set wset;
         int optval;
         socklen_t optlen = sizeof(optval);
         struct timeval tv = *ro_tv;
 
         /* Wait to be available in writing */
-        FD_ZERO(&wset);
-        FD_SET(sockfd, &wset);
-        rc = select(sockfd + 1, NULL, &wset, NULL, &tv);
-        if (rc <= 0) {
+        rc = _modbus_wait_fd(sockfd, _MODBUS_WAIT_WRITE, &tv);
+        if (rc == -1) {
             /* Timeout or fail */
             return -1;
         }
@@ -652,6 +655,30 @@ int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection)
     return new_s;
 }
 
+/* Requests modbus_submit_*() may keep in flight on the connection, the
+   confirmations are matched by transaction ID */
+int modbus_tcp_set_pipeline_depth(modbus_t *ctx, int depth)
+{
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP ||
+        depth < 1 || depth > MODBUS_TCP_MAX_PIPELINE_DEPTH) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->pipeline_depth = depth;
+    return 0;
+}
+
+int modbus_tcp_get_pipeline_depth(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ctx->pipeline_depth;
+}
+
 int modbus_tcp_accept(modbus_t *ctx, int *s)
 {
     struct sockaddr_in addr;
@@ -713,28 +740,11 @@ int modbus_tcp_pi_accept(modbus_t *ctx, int *s)
     return ctx->s;
 }
 
-static int _modbus_tcp_select(modbus_t *ctx, fd_set *rset, struct timeval *tv, int length_to_read)
+static int _modbus_tcp_wait(modbus_t *ctx, struct timeval *tv, int length_to_read)
 {
-    int s_rc;
-    while ((s_rc = select(ctx->s+1, rset, NULL, NULL, tv)) == -1) {
-        if (errno == EINTR) {
-            if (ctx->debug) {
-                fprintf(stderr, "A non blocked signal was caught\n");
-            }
-            /* Necessary after an error */
-            FD_ZERO(rset);
-            FD_SET(ctx->s, rset);
-        } else {
-            return -1;
-        }
-    }
-
-    if (s_rc == 0) {
-        errno = ETIMEDOUT;
-        return -1;
-    }
+    (void)length_to_read; /* unused */
 
-    return s_rc;
+    return _modbus_wait_fd(ctx->s, _MODBUS_WAIT_READ, tv);
 }
 
 static void _modbus_tcp_free(modbus_t *ctx) {
@@ -752,15 +762,17 @@ const modbus_backend_t _modbus_tcp_backend = {
     _modbus_tcp_build_response_basis,
     _modbus_tcp_prepare_response_tid,
     _modbus_tcp_send_msg_pre,
+    _modbus_tcp_renew_request,
     _modbus_tcp_send,
     _modbus_tcp_receive,
     _modbus_tcp_recv,
     _modbus_tcp_check_integrity,
+    NULL,
     _modbus_tcp_pre_check_confirmation,
     _modbus_tcp_connect,
     _modbus_tcp_close,
     _modbus_tcp_flush,
-    _modbus_tcp_select,
+    _modbus_tcp_wait,
     _modbus_tcp_free
 };
 
@@ -775,15 +787,17 @@ const modbus_backend_t _modbus_tcp_pi_backend = {
     _modbus_tcp_build_response_basis,
     _modbus_tcp_prepare_response_tid,
     _modbus_tcp_send_msg_pre,
+    _modbus_tcp_renew_request,
     _modbus_tcp_send,
     _modbus_tcp_receive,
     _modbus_tcp_recv,
     _modbus_tcp_check_integrity,
+    NULL,
     _modbus_tcp_pre_check_confirmation,
     _modbus_tcp_pi_connect,
     _modbus_tcp_close,
     _modbus_tcp_flush,
-    _modbus_tcp_select,
+    _modbus_tcp_wait,
     _modbus_tcp_free
 };
 
@@ -51,10 +51,17 @@ MODBUS_BEGIN_DECLS
  */
 #define MODBUS_TCP_MAX_ADU_LENGTH  260
 
+/* Requests a TCP context may keep in flight, see
+   modbus_tcp_set_pipeline_depth() */
+#define MODBUS_TCP_MAX_PIPELINE_DEPTH  16
+
 MODBUS_API modbus_t* modbus_new_tcp(const char *ip_address, int port);
 MODBUS_API int modbus_tcp_listen(modbus_t *ctx, int nb_connection);
 MODBUS_API int modbus_tcp_accept(modbus_t *ctx, int *s);
 
+MODBUS_API int modbus_tcp_set_pipeline_depth(modbus_t *ctx, int depth);
+MODBUS_API int modbus_tcp_get_pipeline_depth(modbus_t *ctx);
+
 MODBUS_API modbus_t* modbus_new_tcp_pi(const char *node, const char *service);
 MODBUS_API int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection);
 MODBUS_API int modbus_tcp_pi_accept(modbus_t *ctx, int *s);
@@ -29,6 +29,11 @@
 #ifndef _MSC_VER
 #include <unistd.h>
 #endif
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <poll.h>
+#endif
 
 #include <config.h>
 
@@ -102,24 +107,52 @@ void _error_print(modbus_t *ctx, const char *context)
     }
 }
 
-static void _sleep_response_timeout(modbus_t *ctx)
+static void _sleep_timeval(const struct timeval *tv)
 {
-    /* Response timeout is always positive */
 #ifdef _WIN32
     /* usleep doesn't exist on Windows */
-    Sleep((ctx->response_timeout.tv_sec * 1000) +
-          (ctx->response_timeout.tv_usec / 1000));
+    Sleep((tv->tv_sec * 1000) + (tv->tv_usec / 1000));
 #else
     /* usleep source code */
     struct timespec request, remaining;
-    request.tv_sec = ctx->response_timeout.tv_sec;
-    request.tv_nsec = ((long int)ctx->response_timeout.tv_usec) * 1000;
+    request.tv_sec = tv->tv_sec;
+    request.tv_nsec = ((long int)tv->tv_usec) * 1000;
     while (nanosleep(&request, &remaining) == -1 && errno == EINTR) {
         request = remaining;
     }
 #endif
 }
 
+static void _sleep_response_timeout(modbus_t *ctx)
+{
+    /* Response timeout is always positive */
+    _sleep_timeval(&ctx->response_timeout);
+}
+
+/* A request to slave 0 of a serial line reaches every slave and none of
+   them answers. TCP gateways use unit 0 to address themselves. */
+static int _modbus_is_broadcast(modbus_t *ctx)
+{
+    return ctx->slave == MODBUS_BROADCAST_ADDRESS &&
+        ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP;
+}
+
+/* Called once a write is sent, a broadcast has no confirmation to wait for
+   but the slaves are given the turnaround delay to carry it out before the
+   next request. Returns TRUE when the write is over. */
+static int _modbus_broadcast_sent(modbus_t *ctx)
+{
+    if (!_modbus_is_broadcast(ctx)) {
+        return FALSE;
+    }
+
+    if (ctx->debug) {
+        printf("Broadcast, no confirmation\n");
+    }
+    _sleep_timeval(&ctx->broadcast_delay);
+    return TRUE;
+}
+
 int modbus_flush(modbus_t *ctx)
 {
     int rc;
@@ -175,8 +208,8 @@ static unsigned int compute_response_length_from_request(modbus_t *ctx, uint8_t
     return offset + length + ctx->backend->checksum_length;
 }
 
-/* Sends a request/response */
-static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
+/* Sends a request/response whose checksum is computed */
+static int send_adu(modbus_t *ctx, const uint8_t *msg, int msg_length)
 {
     int rc;
     int i;
@@ -185,8 +218,6 @@ static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
         modbus_flush(ctx); // Without this we might receive junk
     }
 
-    msg_length = ctx->backend->send_msg_pre(msg, msg_length);
-
     if (ctx->debug) {
         for (i = 0; i < msg_length; i++)
             printf("[%.2X]", msg[i]);
@@ -224,6 +255,23 @@ static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
     return rc;
 }
 
+/* Builds the header of a request, its function is remembered for the
+   timeouts of the confirmation */
+static int build_request_basis(modbus_t *ctx, int function, int addr, int nb,
+                               uint8_t *req)
+{
+    ctx->request_function = function;
+    return ctx->backend->build_request_basis(ctx, function, addr, nb, req);
+}
+
+/* Sends a request/response */
+static int send_msg(modbus_t *ctx, uint8_t *msg, int msg_length)
+{
+    msg_length = ctx->backend->send_msg_pre(msg, msg_length);
+
+    return send_adu(ctx, msg, msg_length);
+}
+
 int modbus_send_raw_request(modbus_t *ctx, uint8_t *raw_req, int raw_req_length)
 {
     sft_t sft;
@@ -243,6 +291,7 @@ int modbus_send_raw_request(modbus_t *ctx, uint8_t *raw_req, int raw_req_length)
 
     sft.slave = raw_req[0];
     sft.function = raw_req[1];
+    ctx->request_function = sft.function;
     /* The t_id is left to zero */
     sft.t_id = 0;
     /* This response function only set the header so it's convenient here */
@@ -353,15 +402,405 @@ static int compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg,msg_type_t
    - read() or recv() error codes
 */
 
-int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
+/* Monotonic time for timing frames, in micro seconds */
+uint64_t _modbus_time_us(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000 +
+        (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+
+    /* not gettimeofday(), the wall clock can be stepped under a frame */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Histogram bucket of a duration: 0-3 us exactly, then 4 buckets per
+   octave */
+static int _latency_bucket(uint64_t us)
+{
+    int e = 2;
+    int bucket;
+
+    if (us < 4) {
+        return (int)us;
+    }
+
+    while ((us >> (e + 1)) != 0) {
+        e++;
+    }
+
+    bucket = 4 * (e - 1) + (int)((us >> (e - 2)) & 3);
+    return (bucket < _MODBUS_LATENCY_BUCKETS) ? bucket : _MODBUS_LATENCY_BUCKETS - 1;
+}
+
+/* Largest duration that falls in the bucket */
+static uint64_t _latency_bucket_max(int bucket)
+{
+    int e;
+
+    if (bucket < 4) {
+        return bucket;
+    }
+
+    e = bucket / 4 + 1;
+    return ((uint64_t)(5 + bucket % 4) << (e - 2)) - 1;
+}
+
+static void _latency_reset(_modbus_latency_t *lat, int slave)
+{
+    memset(lat, 0, sizeof(*lat));
+    lat->slave = slave;
+}
+
+static void _latency_add(_modbus_latency_t *lat, uint64_t us)
+{
+    int i;
+
+    if (lat->count == 0 && lat->ewma == 0) {
+        lat->ewma = (uint32_t)us;
+    } else {
+        lat->ewma = (uint32_t)((int64_t)lat->ewma + ((int64_t)us - (int64_t)lat->ewma) / 8);
+    }
+
+    lat->histogram[_latency_bucket(us)]++;
+    lat->failures = 0;
+
+    /* Old samples fade out so a firmware update or a new cable is
+       followed */
+    if (++lat->count >= _MODBUS_LATENCY_WINDOW) {
+        lat->count = 0;
+        for (i = 0; i < _MODBUS_LATENCY_BUCKETS; i++) {
+            lat->histogram[i] /= 2;
+            lat->count += lat->histogram[i];
+        }
+    }
+}
+
+/* Upper bound of the given per mille of the samples */
+static uint64_t _latency_percentile(const _modbus_latency_t *lat, int permille)
+{
+    uint32_t wanted = ((uint32_t)lat->count * permille + 999) / 1000;
+    uint32_t seen = 0;
+    int i;
+
+    for (i = 0; i < _MODBUS_LATENCY_BUCKETS; i++) {
+        seen += lat->histogram[i];
+        if (seen >= wanted && seen > 0) {
+            return _latency_bucket_max(i);
+        }
+    }
+
+    return _latency_bucket_max(_MODBUS_LATENCY_BUCKETS - 1);
+}
+
+/* Slot of a slave, the least recently used one is recycled when asked to
+   create it */
+static _modbus_latency_t *_latency_slot(modbus_t *ctx, int slave, int create)
+{
+    _modbus_latency_t *oldest = &ctx->latency[0];
+    int i;
+
+    for (i = 0; i < _MODBUS_LATENCY_SLAVES; i++) {
+        _modbus_latency_t *lat = &ctx->latency[i];
+
+        if (lat->slave == slave) {
+            lat->last_use = ++ctx->latency_clock;
+            return lat;
+        }
+        if (lat->slave == -1) {
+            if (oldest->slave != -1) {
+                oldest = lat;
+            }
+        } else if (oldest->slave != -1 && lat->last_use < oldest->last_use) {
+            oldest = lat;
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    _latency_reset(oldest, slave);
+    oldest->last_use = ++ctx->latency_clock;
+    return oldest;
+}
+
+static void _us_to_timeval(uint64_t us, struct timeval *tv)
+{
+    tv->tv_sec = (long)(us / 1000000);
+    tv->tv_usec = (long)(us % 1000000);
+}
+
+static uint64_t _timeval_to_us(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* Waits until fd is ready for the events, at most tv or forever when tv is
+   NULL. Unlike an fd_set, poll() takes descriptors numbered above
+   FD_SETSIZE and needs no rebuilding after a signal. As select() does on
+   Linux, tv is left with the time remaining, the callers time a whole frame
+   with it. Returns 1 when ready, otherwise -1 and errno is ETIMEDOUT or the
+   error of the wait. */
+int _modbus_wait_fd(int fd, int events, struct timeval *tv)
+{
+#if defined(_WIN32)
+    /* A win32 fd_set lists the sockets, it isn't limited by their value */
+    fd_set set;
+    int rc;
+
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    rc = select(fd + 1, (events & _MODBUS_WAIT_READ) ? &set : NULL,
+                (events & _MODBUS_WAIT_WRITE) ? &set : NULL, NULL, tv);
+    if (rc == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    return (rc > 0) ? 1 : -1;
+#else
+    struct pollfd pfd;
+    uint64_t deadline = 0;
+    uint64_t now;
+    int rc;
+
+    pfd.fd = fd;
+    pfd.events = ((events & _MODBUS_WAIT_READ) ? POLLIN : 0) |
+        ((events & _MODBUS_WAIT_WRITE) ? POLLOUT : 0);
+    if (tv != NULL) {
+        deadline = _modbus_time_us() + _timeval_to_us(tv);
+    }
+
+    do {
+        int timeout = -1;
+
+        if (tv != NULL) {
+            now = _modbus_time_us();
+            /* Rounded up, poll() counts in milliseconds */
+            timeout = (now < deadline) ? (int)((deadline - now + 999) / 1000) : 0;
+        }
+        rc = poll(&pfd, 1, timeout);
+    } while (rc == -1 && errno == EINTR);
+
+    if (tv != NULL) {
+        now = _modbus_time_us();
+        _us_to_timeval((now < deadline) ? deadline - now : 0, tv);
+    }
+
+    if (rc == -1) {
+        return -1;
+    }
+
+    if (rc == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    /* An error or a hang up is reported by the following read */
+    if (pfd.revents & POLLNVAL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    return 1;
+#endif
+}
+
+/* Only the confirmations of reads are timed. A write can make the slave
+   commit to its EEPROM and take far longer than the reads polled all day,
+   it keeps the configured timeouts. */
+static int _modbus_is_timed_function(int function)
+{
+    return function >= MODBUS_FC_READ_COILS &&
+        function <= MODBUS_FC_READ_INPUT_REGISTERS;
+}
+
+/* Timeouts for the next confirmation of ctx->slave. The configured ones
+   stay the ceiling, the learned ones only shorten them:
+   - a known slave gets twice its 99th percentile,
+   - an unknown one four times the percentile of the whole bus, so empty
+     addresses of a scan do not each cost the full timeout,
+   - a slave that stopped answering is only given what the bus needs. */
+static void _modbus_adaptive_timeouts(modbus_t *ctx, struct timeval *response,
+                                      struct timeval *byte)
+{
+    const uint64_t configured = _timeval_to_us(&ctx->response_timeout);
+    const uint64_t configured_byte = _timeval_to_us(&ctx->byte_timeout);
+    const uint64_t margin = _MODBUS_LATENCY_MARGIN + 8 * (uint64_t)ctx->char_time;
+    const int bus_known = ctx->latency_bus.count >= _MODBUS_LATENCY_MIN_SAMPLES;
+    _modbus_latency_t *lat = _latency_slot(ctx, ctx->slave, FALSE);
+    uint64_t timeout = configured;
+
+    if (lat != NULL && lat->count >= _MODBUS_LATENCY_MIN_SAMPLES) {
+        timeout = 2 * _latency_percentile(lat, 990) + margin;
+    } else if (bus_known) {
+        timeout = 4 * _latency_percentile(&ctx->latency_bus, 990) + margin;
+    }
+
+    if (lat != NULL && lat->failures >= _MODBUS_LATENCY_DEAD_FAILURES) {
+        uint64_t dead = bus_known ?
+            2 * _latency_percentile(&ctx->latency_bus, 990) + margin : configured / 4;
+
+        if (dead < timeout) {
+            timeout = dead;
+        }
+    }
+
+    if (timeout < margin) {
+        timeout = margin;
+    }
+    if (timeout < configured) {
+        _us_to_timeval(timeout, response);
+    }
+
+    /* A byte timeout of 0 disables it, that is left alone */
+    if (configured_byte > 0 && ctx->latency_gap.count >= _MODBUS_LATENCY_MIN_SAMPLES) {
+        uint64_t gap = 2 * _latency_percentile(&ctx->latency_gap, 990) + margin;
+
+        if (gap < configured_byte) {
+            _us_to_timeval(gap, byte);
+        }
+    }
+}
+
+/* A response of slave arrived first_us after the request, with at most
+   gap_us of silence inside the frame */
+static void _latency_learn(modbus_t *ctx, int slave, uint64_t first_us, uint64_t gap_us)
+{
+    _latency_add(_latency_slot(ctx, slave, TRUE), first_us);
+    _latency_add(&ctx->latency_bus, first_us);
+    _latency_add(&ctx->latency_gap, gap_us);
+}
+
+static void _latency_timeout(modbus_t *ctx, int slave)
+{
+    _modbus_latency_t *lat = _latency_slot(ctx, slave, TRUE);
+
+    if (lat->failures < UINT16_MAX) {
+        lat->failures++;
+    }
+}
+
+/* Prepares rx for a new frame in msg */
+static void _modbus_rx_start(modbus_t *ctx, _modbus_rx_t *rx, uint8_t *msg)
+{
+    /* We need to analyse the message step by step.  At the first step, we want
+     * to reach the function code because all packets contain this
+     * information. */
+    rx->step = _STEP_FUNCTION;
+    rx->length_to_read = ctx->backend->header_length + 1;
+    rx->msg_length = 0;
+    rx->first = 0;
+    rx->last = 0;
+    rx->largest_gap = 0;
+    if (ctx->backend->recv_progress) {
+        ctx->backend->recv_progress(ctx, msg, 0);
+    }
+    if (ctx->slave > 99) rx->length_to_read = ctx->backend->header_length + 1 + 4; //DKOH
+}
+
+/* Reads once from the backend, wait() must have reported data. Returns 1
+   when the frame is complete, 0 when more bytes are expected and -1 on
+   error. */
+static int _modbus_rx_read(modbus_t *ctx, _modbus_rx_t *rx, uint8_t *msg,
+                           msg_type_t msg_type)
+{
+    uint64_t now;
+    int rc;
+
+    rc = ctx->backend->recv(ctx, msg + rx->msg_length, rx->length_to_read);
+    if (rc == 0) {
+        errno = ECONNRESET;
+        rc = -1;
+    }
+
+    if (rc == -1) {
+        _error_print(ctx, "read");
+        return -1;
+    }
+
+    /* -- BEGIN QMODBUS MODIFICATION -- */
+    if (ctx->monitor_raw_data) {
+        ctx->monitor_raw_data(ctx, msg + rx->msg_length, rc, ( rx->step == _STEP_DATA && rx->length_to_read-rc == 0 ) ? 1 : 0 );
+    }
+    /* -- END QMODBUS MODIFICATION -- */
+
+    /* Display the hex code of each character received */
+    if (ctx->debug) {
+        int i;
+        for (i=0; i < rc; i++)
+            printf("<%.2X>", msg[rx->msg_length + i]);
+    }
+
+    now = _modbus_time_us();
+    if (rx->msg_length == 0) {
+        rx->first = now;
+    } else if (now - rx->last > rx->largest_gap) {
+        rx->largest_gap = now - rx->last;
+    }
+    rx->last = now;
+
+    /* Sums bytes received */
+    rx->msg_length += rc;
+    /* Computes remaining bytes */
+    rx->length_to_read -= rc;
+
+    /* Lets the backend checksum the bytes while waiting for the next */
+    if (ctx->backend->recv_progress) {
+        ctx->backend->recv_progress(ctx, msg, rx->msg_length);
+    }
+
+    if (rx->length_to_read == 0) {
+        switch (rx->step) {
+        case _STEP_FUNCTION:
+            /* Function code position */
+            rx->length_to_read = compute_meta_length_after_function( (ctx->slave > 99) ? msg[ctx->backend->header_length + 4] : msg[ctx->backend->header_length], msg_type ); // DKOH
+            if (rx->length_to_read != 0) {
+                rx->step = _STEP_META;
+                break;
+            } /* else switches straight to the next step */
+        case _STEP_META:
+            rx->length_to_read = compute_data_length_after_meta(ctx, msg, msg_type);
+            if ((rx->msg_length + rx->length_to_read) > (int)ctx->backend->max_adu_length) {
+                errno = EMBBADDATA;
+                _error_print(ctx, "too many data");
+                return -1;
+            }
+            rx->step = _STEP_DATA;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return rx->length_to_read == 0;
+}
+
+/* Reads one frame, waiting at most response_timeout for its first byte.
+   The number of bytes read is left in received even when it fails. When
+   learn is set the response time is added to the statistics of
+   ctx->slave. */
+static int _modbus_receive_frame(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type,
+                                 const struct timeval *response_timeout,
+                                 const struct timeval *byte_timeout,
+                                 int learn, int *received)
 {
     int rc;
-    fd_set rset;
     struct timeval tv;
     struct timeval *p_tv;
-    int length_to_read;
-    int msg_length = 0;
-    _step_t step;
+    _modbus_rx_t rx;
+    uint64_t start = learn ? _modbus_time_us() : 0;
+
+    *received = 0;
 
     if (ctx->debug) {
         if (msg_type == MSG_INDICATION) {
@@ -371,16 +810,7 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
         }
     }
 
-    /* Add a file descriptor to the set */
-    FD_ZERO(&rset);
-    FD_SET(ctx->s, &rset);
-
-    /* We need to analyse the message step by step.  At the first step, we want
-     * to reach the function code because all packets contain this
-     * information. */
-    step = _STEP_FUNCTION;
-    length_to_read = ctx->backend->header_length + 1;
-    if (ctx->slave > 99) length_to_read = ctx->backend->header_length + 1 + 4; //DKOH
+    _modbus_rx_start(ctx, &rx, msg);
 
 #if 0
     if (msg_type == MSG_INDICATION) {
@@ -391,15 +821,17 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
          * received */
         p_tv = NULL;
     } else {
-        tv.tv_sec = ctx->response_timeout.tv_sec;
-        tv.tv_usec = ctx->response_timeout.tv_usec;
+        tv = *response_timeout;
         p_tv = &tv;
     }
 
-    while (length_to_read != 0) {
-        rc = ctx->backend->select(ctx, &rset, p_tv, length_to_read);
+    do {
+        rc = ctx->backend->wait(ctx, p_tv, rx.length_to_read);
         if (rc == -1) {
-            _error_print(ctx, "select");
+            _error_print(ctx, "wait");
+            if (learn && rx.msg_length == 0 && errno == ETIMEDOUT) {
+                _latency_timeout(ctx, ctx->slave);
+            }
             if (ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) {
                 int saved_errno = errno;
 
@@ -416,14 +848,9 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
             return -1;
         }
 
-        rc = ctx->backend->recv(ctx, msg + msg_length, length_to_read);
-        if (rc == 0) {
-            errno = ECONNRESET;
-            rc = -1;
-        }
-
+        rc = _modbus_rx_read(ctx, &rx, msg, msg_type);
+        *received = rx.msg_length;
         if (rc == -1) {
-            _error_print(ctx, "read");
             if ((ctx->error_recovery & MODBUS_ERROR_RECOVERY_LINK) &&
                 (errno == ECONNRESET || errno == ECONNREFUSED ||
                  errno == EBADF)) {
@@ -436,64 +863,45 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
             return -1;
         }
 
-		/* -- BEGIN QMODBUS MODIFICATION -- */
-        if (ctx->monitor_raw_data) {
-		    ctx->monitor_raw_data(ctx, msg + msg_length, rc, ( step == _STEP_DATA && length_to_read-rc == 0 ) ? 1 : 0 );
-        }
-        /* -- END QMODBUS MODIFICATION -- */
-
-        /* Display the hex code of each character received */
-        if (ctx->debug) {
-            int i;
-            for (i=0; i < rc; i++)
-                printf("<%.2X>", msg[msg_length + i]);
-        }
-
-        /* Sums bytes received */
-        msg_length += rc;
-        /* Computes remaining bytes */
-        length_to_read -= rc;
-
-        if (length_to_read == 0) {
-            switch (step) {
-            case _STEP_FUNCTION:
-                /* Function code position */
-                length_to_read = compute_meta_length_after_function( (ctx->slave > 99) ? msg[ctx->backend->header_length + 4] : msg[ctx->backend->header_length], msg_type ); // DKOH
-                if (length_to_read != 0) {
-                    step = _STEP_META;
-                    break;
-                } /* else switches straight to the next step */
-            case _STEP_META:
-                length_to_read = compute_data_length_after_meta(ctx, msg, msg_type);
-                if ((msg_length + length_to_read) > (int)ctx->backend->max_adu_length) {
-                    errno = EMBBADDATA;
-                    _error_print(ctx, "too many data");
-                    return -1;
-                }
-                step = _STEP_DATA;
-                break;
-            default:
-                break;
-            }
-        }
-
-        if (length_to_read > 0 &&
-            (ctx->byte_timeout.tv_sec > 0 || ctx->byte_timeout.tv_usec > 0)) {
+        if (rx.length_to_read > 0 &&
+            (byte_timeout->tv_sec > 0 || byte_timeout->tv_usec > 0)) {
             /* If there is no character in the buffer, the allowed timeout
                interval between two consecutive bytes is defined by
                byte_timeout */
-            tv.tv_sec = ctx->byte_timeout.tv_sec;
-            tv.tv_usec = ctx->byte_timeout.tv_usec;
+            tv = *byte_timeout;
             p_tv = &tv;
         }
         /* else timeout isn't set again, the full response must be read before
            expiration of response timeout (for CONFIRMATION only) */
-    }
+    } while (rc == 0);
 
     if (ctx->debug)
         printf("\n");
 
-    return ctx->backend->check_integrity(ctx, msg, msg_length);
+    rc = ctx->backend->check_integrity(ctx, msg, rx.msg_length);
+
+    /* Only answers of the slave asked count, with a good checksum */
+    if (learn && rc > 0) {
+        _latency_learn(ctx, ctx->slave, rx.first - start, rx.largest_gap);
+    }
+
+    return rc;
+}
+
+int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
+{
+    struct timeval response_timeout = ctx->response_timeout;
+    struct timeval byte_timeout = ctx->byte_timeout;
+    const int learn = ctx->adaptive_timeout && msg_type == MSG_CONFIRMATION &&
+        _modbus_is_timed_function(ctx->request_function);
+    int received;
+
+    if (learn) {
+        _modbus_adaptive_timeouts(ctx, &response_timeout, &byte_timeout);
+    }
+
+    return _modbus_receive_frame(ctx, msg, msg_type, &response_timeout,
+                                 &byte_timeout, learn, &received);
 }
 
 /* Receive the request from a modbus master */
@@ -526,10 +934,10 @@ int modbus_receive_confirmation(modbus_t *ctx, uint8_t *rsp)
 }
 
 
-static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp_length)
+static int check_confirmation_length(modbus_t *ctx, uint8_t *req, uint8_t *rsp,
+                                     int rsp_length, int rsp_length_computed)
 {
     int rc;
-    int rsp_length_computed;
     int offset = ctx->backend->header_length;
     if (req[offset - 1] == 0xFA) offset+=4; // DKOH
     int function = rsp[offset];
@@ -539,7 +947,7 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp
     if (ctx->monitor_add_item) {
         ctx->monitor_add_item(ctx, 1,
                 //req[offset - 1],  /* slave */ // DKOH 
-                (req[0] == 0xFA) ? (req[1] << 8) + (req[2]<< 8) + (req[3]<< 8) + (req[4]) : req[offset - 1], // DKOH
+                (req[0] == 0xFA) ? (req[1] << 24) | (req[2] << 16) | (req[3] << 8) | req[4] : req[offset - 1], // DKOH
                 req[offset],  /* func */
                 ( req[offset + 1] << 8 ) + req[offset + 2], /* addr */
                 ( req[offset + 3] << 8 ) + req[offset + 4], /* nb */
@@ -558,8 +966,6 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp
         }
     }
 
-    rsp_length_computed = compute_response_length_from_request(ctx, req);
-
     /* Exception code */
     if (function >= 0x80) {
         if (rsp_length == (offset + 2 + (int)ctx->backend->checksum_length) &&
@@ -657,7 +1063,7 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp
 				break;
 		}
         if (ctx->monitor_add_item) {
-            ctx->monitor_add_item(ctx, 0, (rsp[0] == 0xFA) ? (rsp[1] << 8) + (rsp[2]<< 8) + (rsp[3]<< 8) + (rsp[4]) : rsp[offset-1], rsp[offset+0],
+            ctx->monitor_add_item(ctx, 0, (rsp[0] == 0xFA) ? (rsp[1] << 24) | (rsp[2] << 16) | (rsp[3] << 8) | rsp[4] : rsp[offset-1], rsp[offset+0],
 						   addr, num_items,
 							ctx->last_crc_expected,
 							ctx->last_crc_received
@@ -700,6 +1106,13 @@ static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp
     return rc;
 }
 
+/* Checks the confirmation against the request it answers */
+static int check_confirmation(modbus_t *ctx, uint8_t *req, uint8_t *rsp, int rsp_length)
+{
+    return check_confirmation_length(ctx, req, rsp, rsp_length,
+                                     compute_response_length_from_request(ctx, req));
+}
+
 static int response_io_status(int address, int nb,
                               uint8_t *tab_io_status,
                               uint8_t *rsp, int offset)
@@ -1162,7 +1575,50 @@ int modbus_reply_exception(modbus_t *ctx, const uint8_t *req,
     }
 }
 
+/* Where the values of a read confirmation start, after the byte count */
+static int _modbus_values_offset(modbus_t *ctx, const uint8_t *rsp)
+{
+    int offset = ctx->backend->header_length;
+
+    if (rsp[offset - 1] == 0xFA) offset += 4; // DKOH
+    return offset + 2;
+}
+
 /* Reads IO status */
+/* Stores the rc bytes of bits of the confirmation in dest, one value per
+   bit */
+static void unpack_bits(modbus_t *ctx, const uint8_t *rsp, int rc, int nb,
+                        uint8_t *dest)
+{
+    int i, temp, bit;
+    int pos = 0;
+    int offset = _modbus_values_offset(ctx, rsp);
+    int offset_end = offset + rc;
+
+    for (i = offset; i < offset_end; i++) {
+        /* Shift reg hi_byte to temp */
+        temp = rsp[i];
+
+        for (bit = 0x01; (bit & 0xff) && (pos < nb);) {
+            dest[pos++] = (temp & bit) ? TRUE : FALSE;
+            bit = bit << 1;
+        }
+    }
+}
+
+/* Stores the rc registers of the confirmation in dest */
+static void unpack_registers(modbus_t *ctx, const uint8_t *rsp, int rc,
+                             uint16_t *dest)
+{
+    const uint8_t *src = rsp + _modbus_values_offset(ctx, rsp);
+    int i;
+
+    for (i = 0; i < rc; i++) {
+        /* shift reg hi_byte to temp OR with lo_byte */
+        dest[i] = (src[i << 1] << 8) | src[(i << 1) + 1];
+    }
+}
+
 static int read_io_status(modbus_t *ctx, int function,
                           int addr, int nb, uint8_t *dest)
 {
@@ -1172,15 +1628,10 @@ static int read_io_status(modbus_t *ctx, int function,
     uint8_t req[_MIN_REQ_LENGTH];
     uint8_t rsp[MAX_MESSAGE_LENGTH];
 
-    req_length = ctx->backend->build_request_basis(ctx, function, addr, nb, req);
+    req_length = build_request_basis(ctx, function, addr, nb, req);
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
-        int i, temp, bit;
-        int pos = 0;
-        int offset;
-        int offset_end;
-
         rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
         if (rc == -1)
             return -1;
@@ -1189,18 +1640,7 @@ static int read_io_status(modbus_t *ctx, int function,
         if (rc == -1)
             return -1;
 
-        offset = ctx->backend->header_length + 2;
-        offset_end = offset + rc;
-        for (i = offset; i < offset_end; i++) {
-            /* Shift reg hi_byte to temp */
-            temp = rsp[i];
-
-            for (bit = 0x01; (bit & 0xff) && (pos < nb);) {
-                dest[pos++] = (temp & bit) ? TRUE : FALSE;
-                bit = bit << 1;
-            }
-
-        }
+        unpack_bits(ctx, rsp, rc, nb, dest);
     }
 
     return rc;
@@ -1265,13 +1705,13 @@ int modbus_read_input_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest)
 }
 
 /* Reads the data from a remove device and put that data into an array */
-static int read_registers(modbus_t *ctx, int function, int addr, int nb,
-                          uint16_t *dest)
+/* Receives the confirmation in rsp, returns the number of registers */
+static int read_registers_adu(modbus_t *ctx, int function, int addr, int nb,
+                              uint8_t *rsp)
 {
     int rc;
     int req_length;
     uint8_t req[_MIN_REQ_LENGTH];
-    uint8_t rsp[MAX_MESSAGE_LENGTH];
 
     if (nb > MODBUS_MAX_READ_REGISTERS) {
         if (ctx->debug) {
@@ -1284,29 +1724,54 @@ static int read_registers(modbus_t *ctx, int function, int addr, int nb,
     }
 
     // will twesk the msg if extended slave id is active
-    req_length = ctx->backend->build_request_basis(ctx, function, addr, nb, req);
+    req_length = build_request_basis(ctx, function, addr, nb, req);
 
     rc = send_msg(ctx, req, req_length);
 
     if (rc > 0) {
-        int offset;
-        int i;
-
         rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
         if (rc == -1)
             return -1;
 
         rc = check_confirmation(ctx, req, rsp, rc);
-        if (rc == -1)
-            return -1;
+    }
+
+    return rc;
+}
 
-        offset = ctx->backend->header_length;
+static int read_registers(modbus_t *ctx, int function, int addr, int nb,
+                          uint16_t *dest)
+{
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
+    int rc;
 
-        for (i = 0; i < rc; i++) {
-            /* shift reg hi_byte to temp OR with lo_byte */
-            dest[i] = (rsp[offset + 2 + (i << 1)] << 8) |
-                rsp[offset + 3 + (i << 1)];
-        }
+    rc = read_registers_adu(ctx, function, addr, nb, rsp);
+    if (rc > 0) {
+        unpack_registers(ctx, rsp, rc, dest);
+    }
+
+    return rc;
+}
+
+/* The confirmation is received in rsp (MODBUS_MAX_ADU_LENGTH bytes) and
+   left there, view points at its registers */
+static int read_registers_view(modbus_t *ctx, int function, int addr, int nb,
+                               uint8_t *rsp, modbus_reg_view_t *view)
+{
+    int rc;
+
+    if (ctx == NULL || rsp == NULL || view == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    view->data = NULL;
+    view->nb = 0;
+
+    rc = read_registers_adu(ctx, function, addr, nb, rsp);
+    if (rc > 0) {
+        view->data = rsp + _modbus_values_offset(ctx, rsp);
+        view->nb = rc;
     }
 
     return rc;
@@ -1363,6 +1828,141 @@ int modbus_read_input_registers(modbus_t *ctx, int addr, int nb,
     return status;
 }
 
+/* Reads the holding registers of remote device without copying them out
+   of the confirmation */
+int modbus_read_registers_view(modbus_t *ctx, int addr, int nb, uint8_t *rsp,
+                               modbus_reg_view_t *view)
+{
+    return read_registers_view(ctx, MODBUS_FC_READ_HOLDING_REGISTERS,
+                               addr, nb, rsp, view);
+}
+
+int modbus_read_input_registers_view(modbus_t *ctx, int addr, int nb,
+                                     uint8_t *rsp, modbus_reg_view_t *view)
+{
+    return read_registers_view(ctx, MODBUS_FC_READ_INPUT_REGISTERS,
+                               addr, nb, rsp, view);
+}
+
+/* Builds the request once, checksum and length of the confirmation
+   included, polling the same registers then costs a single write */
+static modbus_prepared_t *prepare_read_registers(modbus_t *ctx, int function,
+                                                 int addr, int nb)
+{
+    modbus_prepared_t *prep;
+    int req_length;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (nb > MODBUS_MAX_READ_REGISTERS) {
+        if (ctx->debug) {
+            fprintf(stderr,
+                    "ERROR Too many registers requested (%d > %d)\n",
+                    nb, MODBUS_MAX_READ_REGISTERS);
+        }
+        errno = EMBMDATA;
+        return NULL;
+    }
+
+    prep = (modbus_prepared_t *)malloc(sizeof(modbus_prepared_t));
+    if (prep == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    req_length = build_request_basis(ctx, function, addr, nb, prep->req);
+    prep->req_length = ctx->backend->send_msg_pre(prep->req, req_length);
+    prep->rsp_length = compute_response_length_from_request(ctx, prep->req);
+    prep->backend = ctx->backend;
+    prep->slave = ctx->slave;
+    prep->function = function;
+    prep->nb = nb;
+
+    return prep;
+}
+
+modbus_prepared_t *modbus_prepare_read_registers(modbus_t *ctx, int addr, int nb)
+{
+    return prepare_read_registers(ctx, MODBUS_FC_READ_HOLDING_REGISTERS, addr, nb);
+}
+
+modbus_prepared_t *modbus_prepare_read_input_registers(modbus_t *ctx, int addr, int nb)
+{
+    return prepare_read_registers(ctx, MODBUS_FC_READ_INPUT_REGISTERS, addr, nb);
+}
+
+/* Sends the prepared request and receives its confirmation in rsp, the
+   slave must still be the one it was prepared for */
+static int read_prepared_adu(modbus_t *ctx, modbus_prepared_t *prep, uint8_t *rsp)
+{
+    int rc;
+
+    if (ctx == NULL || prep == NULL || prep->backend != ctx->backend ||
+        prep->slave != ctx->slave) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ctx->backend->renew_request) {
+        ctx->backend->renew_request(ctx, prep->req);
+    }
+
+    ctx->request_function = prep->function;
+    rc = send_adu(ctx, prep->req, prep->req_length);
+    if (rc > 0) {
+        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
+        if (rc == -1)
+            return -1;
+
+        rc = check_confirmation_length(ctx, prep->req, rsp, rc, prep->rsp_length);
+    }
+
+    return rc;
+}
+
+int modbus_read_prepared(modbus_t *ctx, modbus_prepared_t *prep, uint16_t *dest)
+{
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
+    int rc;
+
+    rc = read_prepared_adu(ctx, prep, rsp);
+    if (rc > 0) {
+        unpack_registers(ctx, rsp, rc, dest);
+    }
+
+    return rc;
+}
+
+int modbus_read_prepared_view(modbus_t *ctx, modbus_prepared_t *prep,
+                              uint8_t *rsp, modbus_reg_view_t *view)
+{
+    int rc;
+
+    if (rsp == NULL || view == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    view->data = NULL;
+    view->nb = 0;
+
+    rc = read_prepared_adu(ctx, prep, rsp);
+    if (rc > 0) {
+        view->data = rsp + _modbus_values_offset(ctx, rsp);
+        view->nb = rc;
+    }
+
+    return rc;
+}
+
+void modbus_prepared_free(modbus_prepared_t *prep)
+{
+    free(prep);
+}
+
 /* Write a value to the specified register of the remote device.
    Used by write_bit and write_register */
 static int write_single(modbus_t *ctx, int function, int addr, int value)
@@ -1376,9 +1976,12 @@ static int write_single(modbus_t *ctx, int function, int addr, int value)
         return -1;
     }
 
-    req_length = ctx->backend->build_request_basis(ctx, function, addr, value, req);
+    req_length = build_request_basis(ctx, function, addr, value, req);
 
     rc = send_msg(ctx, req, req_length);
+    if (rc > 0 && _modbus_broadcast_sent(ctx)) {
+        return 1;
+    }
     if (rc > 0) {
         /* Used by write_bit and write_register */
         uint8_t rsp[MAX_MESSAGE_LENGTH];
@@ -1416,15 +2019,47 @@ int modbus_write_register(modbus_t *ctx, int addr, int value)
     return write_single(ctx, MODBUS_FC_WRITE_SINGLE_REGISTER, addr, value);
 }
 
-/* Write the bits of the array in the remote device */
-int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
+/* Builds the request writing the nb bits of src, returns its length */
+static int build_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src,
+                            uint8_t *req)
 {
-    int rc;
     int i;
     int byte_count;
     int req_length;
     int bit_check = 0;
     int pos = 0;
+
+    req_length = build_request_basis(ctx,
+                                     MODBUS_FC_WRITE_MULTIPLE_COILS,
+                                     addr, nb, req);
+    byte_count = (nb / 8) + ((nb % 8) ? 1 : 0);
+    req[req_length++] = byte_count;
+
+    for (i = 0; i < byte_count; i++) {
+        int bit;
+
+        bit = 0x01;
+        req[req_length] = 0;
+
+        while ((bit & 0xFF) && (bit_check++ < nb)) {
+            if (src[pos++])
+                req[req_length] |= bit;
+            else
+                req[req_length] &=~ bit;
+
+            bit = bit << 1;
+        }
+        req_length++;
+    }
+
+    return req_length;
+}
+
+/* Write the bits of the array in the remote device */
+int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
+{
+    int rc;
+    int req_length;
     uint8_t req[MAX_MESSAGE_LENGTH];
 
     if (ctx == NULL) {
@@ -1441,30 +2076,76 @@ int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
         return -1;
     }
 
-    req_length = ctx->backend->build_request_basis(ctx,
-                                                   MODBUS_FC_WRITE_MULTIPLE_COILS,
-                                                   addr, nb, req);
-    byte_count = (nb / 8) + ((nb % 8) ? 1 : 0);
+    req_length = build_write_bits(ctx, addr, nb, src, req);
+
+    rc = send_msg(ctx, req, req_length);
+    if (rc > 0 && _modbus_broadcast_sent(ctx)) {
+        return nb;
+    }
+    if (rc > 0) {
+        uint8_t rsp[MAX_MESSAGE_LENGTH];
+
+        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
+        if (rc == -1)
+            return -1;
+
+        rc = check_confirmation(ctx, req, rsp, rc);
+    }
+
+
+    return rc;
+}
+
+/* Builds the request writing the nb registers of src, returns its length */
+static int build_write_registers(modbus_t *ctx, int addr, int nb,
+                                 const uint16_t *src, uint8_t *req)
+{
+    int i;
+    int req_length;
+    int byte_count;
+
+    req_length = build_request_basis(ctx,
+                                     MODBUS_FC_WRITE_MULTIPLE_REGISTERS,
+                                     addr, nb, req);
+    byte_count = nb * 2;
     req[req_length++] = byte_count;
 
-    for (i = 0; i < byte_count; i++) {
-        int bit;
+    for (i = 0; i < nb; i++) {
+        req[req_length++] = src[i] >> 8;
+        req[req_length++] = src[i] & 0x00FF;
+    }
 
-        bit = 0x01;
-        req[req_length] = 0;
+    return req_length;
+}
 
-        while ((bit & 0xFF) && (bit_check++ < nb)) {
-            if (src[pos++])
-                req[req_length] |= bit;
-            else
-                req[req_length] &=~ bit;
+/* Write the values from the array to the registers of the remote device */
+int modbus_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *src)
+{
+    int rc;
+    int req_length;
+    uint8_t req[MAX_MESSAGE_LENGTH];
 
-            bit = bit << 1;
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (nb > MODBUS_MAX_WRITE_REGISTERS) {
+        if (ctx->debug) {
+            fprintf(stderr,
+                    "ERROR Trying to write to too many registers (%d > %d)\n",
+                    nb, MODBUS_MAX_WRITE_REGISTERS);
         }
-        req_length++;
+        errno = EMBMDATA;
+        return -1;
     }
 
+    req_length = build_write_registers(ctx, addr, nb, src, req);
+
     rc = send_msg(ctx, req, req_length);
+    if (rc > 0 && _modbus_broadcast_sent(ctx)) {
+        return nb;
+    }
     if (rc > 0) {
         uint8_t rsp[MAX_MESSAGE_LENGTH];
 
@@ -1475,214 +2156,701 @@ int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
         rc = check_confirmation(ctx, req, rsp, rc);
     }
 
+    return rc;
+}
+
+int modbus_mask_write_register(modbus_t *ctx, int addr, uint16_t and_mask, uint16_t or_mask)
+{
+    int rc;
+    int req_length;
+    uint8_t req[_MIN_REQ_LENGTH];
+
+    req_length = build_request_basis(ctx,
+                                     MODBUS_FC_MASK_WRITE_REGISTER,
+                                     addr, 0, req);
+
+    /* HACKISH, count is not used */
+    req_length -=2;
+
+    req[req_length++] = and_mask >> 8;
+    req[req_length++] = and_mask & 0x00ff;
+    req[req_length++] = or_mask >> 8;
+    req[req_length++] = or_mask & 0x00ff;
+
+    rc = send_msg(ctx, req, req_length);
+    if (rc > 0 && _modbus_broadcast_sent(ctx)) {
+        return 1;
+    }
+    if (rc > 0) {
+        /* Used by write_bit and write_register */
+        uint8_t rsp[MAX_MESSAGE_LENGTH];
+
+        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
+        if (rc == -1)
+            return -1;
+
+        rc = check_confirmation(ctx, req, rsp, rc);
+    }
 
     return rc;
 }
 
-/* Write the values from the array to the registers of the remote device */
-int modbus_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *src)
+/* Write multiple registers from src array to remote device and read multiple
+   registers from remote device to dest array. */
+int modbus_write_and_read_registers(modbus_t *ctx,
+                                    int write_addr, int write_nb,
+                                    const uint16_t *src,
+                                    int read_addr, int read_nb,
+                                    uint16_t *dest)
+
 {
     int rc;
-    int i;
     int req_length;
+    int i;
     int byte_count;
     uint8_t req[MAX_MESSAGE_LENGTH];
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
 
     if (ctx == NULL) {
         errno = EINVAL;
         return -1;
     }
 
-    if (nb > MODBUS_MAX_WRITE_REGISTERS) {
+    if (write_nb > MODBUS_MAX_WR_WRITE_REGISTERS) {
+        if (ctx->debug) {
+            fprintf(stderr,
+                    "ERROR Too many registers to write (%d > %d)\n",
+                    write_nb, MODBUS_MAX_WR_WRITE_REGISTERS);
+        }
+        errno = EMBMDATA;
+        return -1;
+    }
+
+    if (read_nb > MODBUS_MAX_WR_READ_REGISTERS) {
+        if (ctx->debug) {
+            fprintf(stderr,
+                    "ERROR Too many registers requested (%d > %d)\n",
+                    read_nb, MODBUS_MAX_WR_READ_REGISTERS);
+        }
+        errno = EMBMDATA;
+        return -1;
+    }
+    req_length = build_request_basis(ctx,
+                                     MODBUS_FC_WRITE_AND_READ_REGISTERS,
+                                     read_addr, read_nb, req);
+
+    req[req_length++] = write_addr >> 8;
+    req[req_length++] = write_addr & 0x00ff;
+    req[req_length++] = write_nb >> 8;
+    req[req_length++] = write_nb & 0x00ff;
+    byte_count = write_nb * 2;
+    req[req_length++] = byte_count;
+
+    for (i = 0; i < write_nb; i++) {
+        req[req_length++] = src[i] >> 8;
+        req[req_length++] = src[i] & 0x00FF;
+    }
+
+    rc = send_msg(ctx, req, req_length);
+    if (rc > 0) {
+        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
+        if (rc == -1)
+            return -1;
+
+        rc = check_confirmation(ctx, req, rsp, rc);
+        if (rc == -1)
+            return -1;
+
+        unpack_registers(ctx, rsp, rc, dest);
+    }
+
+    return rc;
+}
+
+/* Send a request to get the slave ID of the device (only available in serial
+   communication). */
+int modbus_report_slave_id(modbus_t *ctx, int max_dest, uint8_t *dest)
+{
+    int rc;
+    int req_length;
+    uint8_t req[_MIN_REQ_LENGTH];
+
+    if (ctx == NULL || max_dest <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    req_length = build_request_basis(ctx, MODBUS_FC_REPORT_SLAVE_ID,
+                                     0, 0, req);
+
+    /* HACKISH, addr and count are not used */
+    req_length -= 4;
+
+    rc = send_msg(ctx, req, req_length);
+    if (rc > 0) {
+        int i;
+        int offset;
+        uint8_t rsp[MAX_MESSAGE_LENGTH];
+
+        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
+        if (rc == -1)
+            return -1;
+
+        rc = check_confirmation(ctx, req, rsp, rc);
+        if (rc == -1)
+            return -1;
+
+        offset = ctx->backend->header_length + 2;
+
+        /* Byte count, slave id, run indicator status and
+           additional data. Truncate copy to max_dest. */
+        for (i=0; i < rc && i < max_dest; i++) {
+            dest[i] = rsp[offset + i];
+        }
+    }
+
+    return rc;
+}
+
+/*
+ * Non-blocking transactions
+ *
+ * modbus_submit_*() sends the request and returns, modbus_process_io()
+ * assembles the confirmations as their bytes arrive and calls the
+ * completion callbacks. Frames are read with the same backend wait() and
+ * recv() hooks as the blocking calls, so one thread polling the sockets of
+ * many contexts can drive them all. A serial context has one transaction
+ * in flight, a TCP one up to its pipeline depth, the confirmations are then
+ * matched to their requests by transaction ID in whatever order they come.
+ */
+
+/* A free slot for a new transaction */
+static _modbus_pending_t *_modbus_submit_slot(modbus_t *ctx)
+{
+    int i;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (ctx->nb_pending < ctx->pipeline_depth) {
+        for (i = 0; i < MODBUS_TCP_MAX_PIPELINE_DEPTH; i++) {
+            if (!ctx->pending[i].active) {
+                return &ctx->pending[i];
+            }
+        }
+    }
+
+    errno = EBUSY;
+    return NULL;
+}
+
+/* The transaction submitted first among the ones in flight */
+static _modbus_pending_t *_modbus_pending_oldest(modbus_t *ctx)
+{
+    _modbus_pending_t *oldest = NULL;
+    int i;
+
+    for (i = 0; i < MODBUS_TCP_MAX_PIPELINE_DEPTH; i++) {
+        _modbus_pending_t *p = &ctx->pending[i];
+
+        if (p->active && (oldest == NULL || (int32_t)(p->seq - oldest->seq) < 0)) {
+            oldest = p;
+        }
+    }
+
+    return oldest;
+}
+
+/* The transaction the confirmation in ctx->rsp answers, NULL for a late
+   answer to one already timed out */
+static _modbus_pending_t *_modbus_pending_match(modbus_t *ctx)
+{
+    int i;
+
+    if (ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        _modbus_pending_t *p = _modbus_pending_oldest(ctx);
+
+        /* Nothing answers a broadcast */
+        return (p != NULL && !p->broadcast) ? p : NULL;
+    }
+
+    for (i = 0; i < MODBUS_TCP_MAX_PIPELINE_DEPTH; i++) {
+        _modbus_pending_t *p = &ctx->pending[i];
+
+        if (p->active && p->req[0] == ctx->rsp[0] && p->req[1] == ctx->rsp[1]) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/* Sends the request built in p->req */
+static int _modbus_submit(modbus_t *ctx, _modbus_pending_t *p, int function,
+                          int req_length, int nb, void *dest,
+                          modbus_completion_fnc_t cb, void *user_data)
+{
+    struct timeval response_timeout = ctx->response_timeout;
+    int rc;
+
+    /* Only writes can be broadcast, a read would complete without data */
+    if (dest != NULL && _modbus_is_broadcast(ctx)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    p->byte_timeout = ctx->byte_timeout;
+    if (ctx->adaptive_timeout && _modbus_is_timed_function(function)) {
+        _modbus_adaptive_timeouts(ctx, &response_timeout, &p->byte_timeout);
+    }
+
+    rc = send_msg(ctx, p->req, req_length);
+    if (rc == -1) {
+        return -1;
+    }
+
+    if (ctx->debug) {
+        printf("Waiting for a confirmation...\n");
+    }
+
+    if (ctx->nb_pending == 0) {
+        _modbus_rx_start(ctx, &ctx->rx, ctx->rsp);
+        ctx->rx_deadline = 0;
+    }
+
+    p->active = TRUE;
+    p->seq = ctx->pending_seq++;
+    p->slave = ctx->slave;
+    p->function = function;
+    p->nb = nb;
+    p->dest = dest;
+    p->callback = cb;
+    p->user_data = user_data;
+    p->start = _modbus_time_us();
+    p->broadcast = _modbus_is_broadcast(ctx);
+    /* A broadcast stays in flight for the turnaround delay, then succeeds */
+    if (p->broadcast) {
+        p->deadline = p->start + _timeval_to_us(&ctx->broadcast_delay);
+    } else {
+        p->deadline = p->start + _timeval_to_us(&response_timeout);
+    }
+    ctx->nb_pending++;
+
+    return 0;
+}
+
+/* Ends a transaction, errno is left for the callback */
+static void _modbus_complete(modbus_t *ctx, _modbus_pending_t *p, int rc)
+{
+    /* Freed first so the callback can submit the next request */
+    p->active = FALSE;
+    ctx->nb_pending--;
+    if (p->callback) {
+        p->callback(ctx, rc, p->user_data);
+    }
+}
+
+/* The confirmation in ctx->rsp is complete, checks it and stores the
+   values. Returns the number of transactions completed. */
+static int _modbus_finish(modbus_t *ctx)
+{
+    _modbus_pending_t *p;
+    int rc;
+
+    if (ctx->debug)
+        printf("\n");
+
+    p = _modbus_pending_match(ctx);
+    if (p == NULL) {
+        if (ctx->debug) {
+            fprintf(stderr, "Confirmation of transaction 0x%X ignored\n",
+                    (ctx->rsp[0] << 8) + ctx->rsp[1]);
+        }
+        return 0;
+    }
+
+    rc = ctx->backend->check_integrity(ctx, ctx->rsp, ctx->rx.msg_length);
+    if (rc == -1) {
+        _modbus_complete(ctx, p, -1);
+        return 1;
+    }
+
+    if (ctx->adaptive_timeout && rc > 0) {
+        _latency_learn(ctx, p->slave, ctx->rx.first - p->start, ctx->rx.largest_gap);
+    }
+
+    rc = check_confirmation(ctx, p->req, ctx->rsp, rc);
+    if (rc != -1) {
+        switch (p->function) {
+        case MODBUS_FC_READ_COILS:
+        case MODBUS_FC_READ_DISCRETE_INPUTS:
+            unpack_bits(ctx, ctx->rsp, rc, p->nb, p->dest);
+            rc = p->nb;
+            break;
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+            unpack_registers(ctx, ctx->rsp, rc, p->dest);
+            break;
+        default:
+            break;
+        }
+    }
+
+    _modbus_complete(ctx, p, rc);
+    return 1;
+}
+
+/* Fails the transactions whose time is over. A confirmation stuck half way
+   fails them all, the stream can't be trusted any more. */
+static int _modbus_expire(modbus_t *ctx)
+{
+    const uint64_t now = _modbus_time_us();
+    const int receiving = ctx->rx.msg_length > 0 && ctx->rx_deadline != 0;
+    _modbus_pending_t *expired[MODBUS_TCP_MAX_PIPELINE_DEPTH];
+    int nb_expired = 0;
+    int i;
+
+    if (receiving && now < ctx->rx_deadline) {
+        return 0;
+    }
+
+    /* Listed first, the callbacks may submit into the freed slots */
+    for (i = 0; i < MODBUS_TCP_MAX_PIPELINE_DEPTH; i++) {
+        _modbus_pending_t *p = &ctx->pending[i];
+
+        if (p->active && (receiving || now >= p->deadline)) {
+            expired[nb_expired++] = p;
+        }
+    }
+
+    if (nb_expired == 0) {
+        return 0;
+    }
+
+    if (receiving || (nb_expired == ctx->nb_pending && ctx->rx.msg_length > 0)) {
+        _modbus_rx_start(ctx, &ctx->rx, ctx->rsp);
+        ctx->rx_deadline = 0;
+        modbus_flush(ctx);
+    }
+
+    for (i = 0; i < nb_expired; i++) {
+        if (expired[i]->broadcast && !receiving) {
+            _modbus_complete(ctx, expired[i], expired[i]->nb);
+            continue;
+        }
+        if (ctx->adaptive_timeout && !receiving) {
+            _latency_timeout(ctx, expired[i]->slave);
+        }
+        errno = ETIMEDOUT;
+        _error_print(ctx, "wait");
+        _modbus_complete(ctx, expired[i], -1);
+    }
+
+    return nb_expired;
+}
+
+/* The link or the framing is broken, nothing in flight will be answered.
+   Fails every transaction with errno. */
+static int _modbus_fail_all(modbus_t *ctx)
+{
+    const int saved_errno = errno;
+    const uint32_t end = ctx->pending_seq;
+    _modbus_pending_t *p;
+    int nb_failed = 0;
+
+    _modbus_rx_start(ctx, &ctx->rx, ctx->rsp);
+    ctx->rx_deadline = 0;
+
+    /* The callbacks may submit again, only the ones in flight now fail */
+    while ((p = _modbus_pending_oldest(ctx)) != NULL &&
+           (int32_t)(p->seq - end) < 0) {
+        errno = saved_errno;
+        _modbus_complete(ctx, p, -1);
+        nb_failed++;
+    }
+
+    return nb_failed;
+}
+
+static int submit_read_io_status(modbus_t *ctx, int function, int addr, int nb,
+                                 uint8_t *dest, modbus_completion_fnc_t cb,
+                                 void *user_data)
+{
+    _modbus_pending_t *p = _modbus_submit_slot(ctx);
+    int req_length;
+
+    if (p == NULL) {
+        return -1;
+    }
+
+    if (nb > MODBUS_MAX_READ_BITS) {
+        if (ctx->debug) {
+            fprintf(stderr,
+                    "ERROR Too many bits requested (%d > %d)\n",
+                    nb, MODBUS_MAX_READ_BITS);
+        }
+        errno = EMBMDATA;
+        return -1;
+    }
+
+    req_length = build_request_basis(ctx, function, addr, nb, p->req);
+    return _modbus_submit(ctx, p, function, req_length, nb, dest, cb, user_data);
+}
+
+int modbus_submit_read_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                            modbus_completion_fnc_t cb, void *user_data)
+{
+    return submit_read_io_status(ctx, MODBUS_FC_READ_COILS, addr, nb, dest,
+                                 cb, user_data);
+}
+
+int modbus_submit_read_input_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                                  modbus_completion_fnc_t cb, void *user_data)
+{
+    return submit_read_io_status(ctx, MODBUS_FC_READ_DISCRETE_INPUTS, addr, nb,
+                                 dest, cb, user_data);
+}
+
+static int submit_read_registers(modbus_t *ctx, int function, int addr, int nb,
+                                 uint16_t *dest, modbus_completion_fnc_t cb,
+                                 void *user_data)
+{
+    _modbus_pending_t *p = _modbus_submit_slot(ctx);
+    int req_length;
+
+    if (p == NULL) {
+        return -1;
+    }
+
+    if (nb > MODBUS_MAX_READ_REGISTERS) {
         if (ctx->debug) {
             fprintf(stderr,
-                    "ERROR Trying to write to too many registers (%d > %d)\n",
-                    nb, MODBUS_MAX_WRITE_REGISTERS);
+                    "ERROR Too many registers requested (%d > %d)\n",
+                    nb, MODBUS_MAX_READ_REGISTERS);
         }
         errno = EMBMDATA;
         return -1;
     }
 
-    req_length = ctx->backend->build_request_basis(ctx,
-                                                   MODBUS_FC_WRITE_MULTIPLE_REGISTERS,
-                                                   addr, nb, req);
-    byte_count = nb * 2;
-    req[req_length++] = byte_count;
+    req_length = build_request_basis(ctx, function, addr, nb, p->req);
+    return _modbus_submit(ctx, p, function, req_length, nb, dest, cb, user_data);
+}
 
-    for (i = 0; i < nb; i++) {
-        req[req_length++] = src[i] >> 8;
-        req[req_length++] = src[i] & 0x00FF;
-    }
+int modbus_submit_read_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest,
+                                 modbus_completion_fnc_t cb, void *user_data)
+{
+    return submit_read_registers(ctx, MODBUS_FC_READ_HOLDING_REGISTERS, addr,
+                                 nb, dest, cb, user_data);
+}
 
-    rc = send_msg(ctx, req, req_length);
-    if (rc > 0) {
-        uint8_t rsp[MAX_MESSAGE_LENGTH];
+int modbus_submit_read_input_registers(modbus_t *ctx, int addr, int nb,
+                                       uint16_t *dest,
+                                       modbus_completion_fnc_t cb, void *user_data)
+{
+    return submit_read_registers(ctx, MODBUS_FC_READ_INPUT_REGISTERS, addr,
+                                 nb, dest, cb, user_data);
+}
 
-        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
-        if (rc == -1)
-            return -1;
+static int submit_write_single(modbus_t *ctx, int function, int addr, int value,
+                               modbus_completion_fnc_t cb, void *user_data)
+{
+    _modbus_pending_t *p = _modbus_submit_slot(ctx);
+    int req_length;
 
-        rc = check_confirmation(ctx, req, rsp, rc);
+    if (p == NULL) {
+        return -1;
     }
 
-    return rc;
+    req_length = build_request_basis(ctx, function, addr, value, p->req);
+    return _modbus_submit(ctx, p, function, req_length, 1, NULL, cb, user_data);
 }
 
-int modbus_mask_write_register(modbus_t *ctx, int addr, uint16_t and_mask, uint16_t or_mask)
+int modbus_submit_write_bit(modbus_t *ctx, int addr, int status,
+                            modbus_completion_fnc_t cb, void *user_data)
 {
-    int rc;
-    int req_length;
-    uint8_t req[_MIN_REQ_LENGTH];
-
-    req_length = ctx->backend->build_request_basis(ctx,
-                                                   MODBUS_FC_MASK_WRITE_REGISTER,
-                                                   addr, 0, req);
-
-    /* HACKISH, count is not used */
-    req_length -=2;
+    return submit_write_single(ctx, MODBUS_FC_WRITE_SINGLE_COIL, addr,
+                               status ? 0xFF00 : 0, cb, user_data);
+}
 
-    req[req_length++] = and_mask >> 8;
-    req[req_length++] = and_mask & 0x00ff;
-    req[req_length++] = or_mask >> 8;
-    req[req_length++] = or_mask & 0x00ff;
+int modbus_submit_write_register(modbus_t *ctx, int addr, int value,
+                                 modbus_completion_fnc_t cb, void *user_data)
+{
+    return submit_write_single(ctx, MODBUS_FC_WRITE_SINGLE_REGISTER, addr,
+                               value, cb, user_data);
+}
 
-    rc = send_msg(ctx, req, req_length);
-    if (rc > 0) {
-        /* Used by write_bit and write_register */
-        uint8_t rsp[MAX_MESSAGE_LENGTH];
+int modbus_submit_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src,
+                             modbus_completion_fnc_t cb, void *user_data)
+{
+    _modbus_pending_t *p = _modbus_submit_slot(ctx);
+    int req_length;
 
-        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
-        if (rc == -1)
-            return -1;
+    if (p == NULL) {
+        return -1;
+    }
 
-        rc = check_confirmation(ctx, req, rsp, rc);
+    if (nb > MODBUS_MAX_WRITE_BITS) {
+        if (ctx->debug) {
+            fprintf(stderr, "ERROR Writing too many bits (%d > %d)\n",
+                    nb, MODBUS_MAX_WRITE_BITS);
+        }
+        errno = EMBMDATA;
+        return -1;
     }
 
-    return rc;
+    req_length = build_write_bits(ctx, addr, nb, src, p->req);
+    return _modbus_submit(ctx, p, MODBUS_FC_WRITE_MULTIPLE_COILS, req_length,
+                          nb, NULL, cb, user_data);
 }
 
-/* Write multiple registers from src array to remote device and read multiple
-   registers from remote device to dest array. */
-int modbus_write_and_read_registers(modbus_t *ctx,
-                                    int write_addr, int write_nb,
-                                    const uint16_t *src,
-                                    int read_addr, int read_nb,
-                                    uint16_t *dest)
-
+int modbus_submit_write_registers(modbus_t *ctx, int addr, int nb,
+                                  const uint16_t *src,
+                                  modbus_completion_fnc_t cb, void *user_data)
 {
-    int rc;
+    _modbus_pending_t *p = _modbus_submit_slot(ctx);
     int req_length;
-    int i;
-    int byte_count;
-    uint8_t req[MAX_MESSAGE_LENGTH];
-    uint8_t rsp[MAX_MESSAGE_LENGTH];
 
-    if (ctx == NULL) {
-        errno = EINVAL;
+    if (p == NULL) {
         return -1;
     }
 
-    if (write_nb > MODBUS_MAX_WR_WRITE_REGISTERS) {
+    if (nb > MODBUS_MAX_WRITE_REGISTERS) {
         if (ctx->debug) {
             fprintf(stderr,
-                    "ERROR Too many registers to write (%d > %d)\n",
-                    write_nb, MODBUS_MAX_WR_WRITE_REGISTERS);
+                    "ERROR Trying to write to too many registers (%d > %d)\n",
+                    nb, MODBUS_MAX_WRITE_REGISTERS);
         }
         errno = EMBMDATA;
         return -1;
     }
 
-    if (read_nb > MODBUS_MAX_WR_READ_REGISTERS) {
-        if (ctx->debug) {
-            fprintf(stderr,
-                    "ERROR Too many registers requested (%d > %d)\n",
-                    read_nb, MODBUS_MAX_WR_READ_REGISTERS);
-        }
-        errno = EMBMDATA;
+    req_length = build_write_registers(ctx, addr, nb, src, p->req);
+    return _modbus_submit(ctx, p, MODBUS_FC_WRITE_MULTIPLE_REGISTERS, req_length,
+                          nb, NULL, cb, user_data);
+}
+
+/* Advances the transactions in flight. events tells what the event loop
+   saw on the socket, MODBUS_IO_READ when it is readable, MODBUS_IO_NONE
+   when the time given by modbus_get_io_timeout() is over. Returns the
+   number of transactions completed, their callbacks have been called. */
+int modbus_process_io(modbus_t *ctx, int events)
+{
+    int nb_completed = 0;
+    int rc;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
         return -1;
     }
-    req_length = ctx->backend->build_request_basis(ctx,
-                                                   MODBUS_FC_WRITE_AND_READ_REGISTERS,
-                                                   read_addr, read_nb, req);
-
-    req[req_length++] = write_addr >> 8;
-    req[req_length++] = write_addr & 0x00ff;
-    req[req_length++] = write_nb >> 8;
-    req[req_length++] = write_nb & 0x00ff;
-    byte_count = write_nb * 2;
-    req[req_length++] = byte_count;
 
-    for (i = 0; i < write_nb; i++) {
-        req[req_length++] = src[i] >> 8;
-        req[req_length++] = src[i] & 0x00FF;
+    if (ctx->nb_pending == 0) {
+        return 0;
     }
 
-    rc = send_msg(ctx, req, req_length);
-    if (rc > 0) {
-        int offset;
+    if (events & MODBUS_IO_READ) {
+        /* The backend wait() is asked without waiting before each read,
+           the serial backends of win32 read in their wait(). Several
+           confirmations may be waiting on a pipelined socket. */
+        while (ctx->nb_pending > 0) {
+            struct timeval tv;
 
-        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
-        if (rc == -1)
-            return -1;
+            tv.tv_sec = 0;
+            tv.tv_usec = 0;
 
-        rc = check_confirmation(ctx, req, rsp, rc);
-        if (rc == -1)
-            return -1;
+            rc = ctx->backend->wait(ctx, &tv, ctx->rx.length_to_read);
+            if (rc == -1) {
+                if (errno == ETIMEDOUT) {
+                    /* Everything there was read */
+                    break;
+                }
+                _error_print(ctx, "wait");
+                return nb_completed + _modbus_fail_all(ctx);
+            }
+
+            rc = _modbus_rx_read(ctx, &ctx->rx, ctx->rsp, MSG_CONFIRMATION);
+            if (rc == -1) {
+                return nb_completed + _modbus_fail_all(ctx);
+            }
 
-        offset = ctx->backend->header_length;
-        for (i = 0; i < rc; i++) {
-            /* shift reg hi_byte to temp OR with lo_byte */
-            dest[i] = (rsp[offset + 2 + (i << 1)] << 8) |
-                rsp[offset + 3 + (i << 1)];
+            if (rc == 1) {
+                nb_completed += _modbus_finish(ctx);
+                _modbus_rx_start(ctx, &ctx->rx, ctx->rsp);
+                ctx->rx_deadline = 0;
+            } else {
+                _modbus_pending_t *oldest = _modbus_pending_oldest(ctx);
+
+                if (oldest->byte_timeout.tv_sec > 0 || oldest->byte_timeout.tv_usec > 0) {
+                    ctx->rx_deadline = ctx->rx.last + _timeval_to_us(&oldest->byte_timeout);
+                }
+            }
         }
     }
 
-    return rc;
+    return nb_completed + _modbus_expire(ctx);
 }
 
-/* Send a request to get the slave ID of the device (only available in serial
-   communication). */
-int modbus_report_slave_id(modbus_t *ctx, int max_dest, uint8_t *dest)
+/* Milliseconds left before the next transaction in flight times out, to
+   be given to poll() or epoll_wait(). -1 when nothing is in flight. */
+int modbus_get_io_timeout(modbus_t *ctx)
 {
-    int rc;
-    int req_length;
-    uint8_t req[_MIN_REQ_LENGTH];
+    uint64_t deadline = 0;
+    uint64_t now;
+    int i;
 
-    if (ctx == NULL || max_dest <= 0) {
+    if (ctx == NULL) {
         errno = EINVAL;
         return -1;
     }
 
-    req_length = ctx->backend->build_request_basis(ctx, MODBUS_FC_REPORT_SLAVE_ID,
-                                                   0, 0, req);
-
-    /* HACKISH, addr and count are not used */
-    req_length -= 4;
+    if (ctx->nb_pending == 0) {
+        return -1;
+    }
 
-    rc = send_msg(ctx, req, req_length);
-    if (rc > 0) {
-        int i;
-        int offset;
-        uint8_t rsp[MAX_MESSAGE_LENGTH];
+    if (ctx->rx.msg_length > 0 && ctx->rx_deadline != 0) {
+        deadline = ctx->rx_deadline;
+    } else {
+        for (i = 0; i < MODBUS_TCP_MAX_PIPELINE_DEPTH; i++) {
+            const _modbus_pending_t *p = &ctx->pending[i];
 
-        rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
-        if (rc == -1)
-            return -1;
+            if (p->active && (deadline == 0 || p->deadline < deadline)) {
+                deadline = p->deadline;
+            }
+        }
+    }
 
-        rc = check_confirmation(ctx, req, rsp, rc);
-        if (rc == -1)
-            return -1;
+    now = _modbus_time_us();
+    if (now >= deadline) {
+        return 0;
+    }
 
-        offset = ctx->backend->header_length + 2;
+    /* Rounded up, waking up early would only spin */
+    return (int)((deadline - now + 999) / 1000);
+}
 
-        /* Byte count, slave id, run indicator status and
-           additional data. Truncate copy to max_dest. */
-        for (i=0; i < rc && i < max_dest; i++) {
-            dest[i] = rsp[offset + i];
-        }
+/* Number of transactions in flight */
+int modbus_is_busy(modbus_t *ctx)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
     }
 
-    return rc;
+    return ctx->nb_pending;
+}
+
+/* Drops the transactions in flight without calling back */
+void _modbus_reset_pending(modbus_t *ctx)
+{
+    int i;
+
+    for (i = 0; i < MODBUS_TCP_MAX_PIPELINE_DEPTH; i++) {
+        ctx->pending[i].active = FALSE;
+    }
+    ctx->nb_pending = 0;
+    ctx->rx.msg_length = 0;
+    ctx->rx_deadline = 0;
 }
 
 void _modbus_init_common(modbus_t *ctx)
@@ -1700,8 +2868,20 @@ void _modbus_init_common(modbus_t *ctx)
     ctx->byte_timeout.tv_sec = 0;
     ctx->byte_timeout.tv_usec = _BYTE_TIMEOUT;
 
+    ctx->broadcast_delay.tv_sec = 0;
+    ctx->broadcast_delay.tv_usec = _BROADCAST_DELAY;
+
     ctx->monitor_add_item = NULL;
     ctx->monitor_raw_data = NULL;
+
+    ctx->char_time = 0;
+    ctx->adaptive_timeout = FALSE;
+    ctx->request_function = -1;
+    _modbus_reset_latency(ctx);
+
+    ctx->pipeline_depth = 1;
+    ctx->pending_seq = 0;
+    _modbus_reset_pending(ctx);
 }
 
 /* Define the slave number */
@@ -1801,6 +2981,81 @@ int modbus_set_byte_timeout(modbus_t *ctx, uint32_t to_sec, uint32_t to_usec)
     return 0;
 }
 
+/* Get the time given to the slaves to carry out a broadcast */
+int modbus_get_broadcast_delay(modbus_t *ctx, uint32_t *to_sec, uint32_t *to_usec)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *to_sec = ctx->broadcast_delay.tv_sec;
+    *to_usec = ctx->broadcast_delay.tv_usec;
+    return 0;
+}
+
+int modbus_set_broadcast_delay(modbus_t *ctx, uint32_t to_sec, uint32_t to_usec)
+{
+    /* The delay can be disabled when both values are zero */
+    if (ctx == NULL || to_usec > 999999) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->broadcast_delay.tv_sec = to_sec;
+    ctx->broadcast_delay.tv_usec = to_usec;
+    return 0;
+}
+
+/* Lets the response and byte timeouts follow the response times seen for
+   each slave, the configured timeouts become upper bounds */
+int modbus_set_adaptive_timeout(modbus_t *ctx, int enable)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->adaptive_timeout = enable ? TRUE : FALSE;
+    return 0;
+}
+
+/* Returns the number of response times known for the slave, their moving
+   average and 99th percentile in micro seconds */
+int modbus_get_slave_latency(modbus_t *ctx, int slave, uint32_t *ewma_us, uint32_t *p99_us)
+{
+    _modbus_latency_t *lat;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    lat = _latency_slot(ctx, slave, FALSE);
+    if (lat == NULL || lat->count == 0) {
+        *ewma_us = 0;
+        *p99_us = 0;
+        return 0;
+    }
+
+    *ewma_us = lat->ewma;
+    *p99_us = (uint32_t)_latency_percentile(lat, 990);
+    return lat->count;
+}
+
+/* Forgets what was learned, e.g. after the baud rate or the cable changed */
+void _modbus_reset_latency(modbus_t *ctx)
+{
+    int i;
+
+    ctx->latency_clock = 0;
+    _latency_reset(&ctx->latency_bus, -1);
+    _latency_reset(&ctx->latency_gap, -1);
+    for (i = 0; i < _MODBUS_LATENCY_SLAVES; i++) {
+        _latency_reset(&ctx->latency[i], -1);
+    }
+}
+
 int modbus_get_header_length(modbus_t *ctx)
 {
     if (ctx == NULL) {
@@ -1826,6 +3081,8 @@ void modbus_close(modbus_t *ctx)
     if (ctx == NULL)
         return;
 
+    /* Transactions in flight are dropped without calling back */
+    _modbus_reset_pending(ctx);
     ctx->backend->close(ctx);
 }
 
@@ -2000,77 +3257,94 @@ void modbus_register_monitor_raw_data_fnc(modbus_t *ctx,
     } 
 } 
 
+/* Works out what a frame seen on the bus is about and reports it to the
+   monitor, the CRC of the frame must already be in last_crc_* */
+void _modbus_monitor_decode(modbus_t *ctx, const uint8_t *msg, int msg_len)
+{
+	/* the slave is the last byte of the header, the function code follows */
+	int o = ctx->backend->header_length - 1;
+	int slave = msg[o+0];
+	if( o == 0 && msg[0] == 0xFA )	/* DKOH, addressed by serial number */
+	{
+		slave = ( msg[1] << 24 ) | ( msg[2] << 16 ) | ( msg[3] << 8 ) | msg[4];
+		o += 4;
+	}
+	const int func = msg[o+1];
+	const int datalen = msg_len - o - ctx->backend->checksum_length - 2;
+	int addr = 0;
+	int nb = -1;
+	int isQuery = 1;
+	switch( func )
+	{
+		case MODBUS_FC_READ_COILS:
+		case MODBUS_FC_READ_DISCRETE_INPUTS:
+			if( msg[o+2] == datalen-1 )
+			{
+				isQuery = 0;
+				nb = (datalen-1) * 8;
+			}
+			break;
+		case MODBUS_FC_READ_HOLDING_REGISTERS:
+		case MODBUS_FC_READ_INPUT_REGISTERS:
+			if( msg[o+2] == datalen-1 )
+			{
+				isQuery = 0;
+				nb = (datalen-1) / 2;
+			}
+			break;
+		case MODBUS_FC_WRITE_SINGLE_COIL:
+		case MODBUS_FC_WRITE_SINGLE_REGISTER:
+			/* can't decide from message whether it is a query or response */
+			isQuery = 0;
+			nb = 1;
+			addr = ( msg[o+2] << 8 ) | msg[o+3];
+			break;
+		case MODBUS_FC_REPORT_SLAVE_ID:
+			nb = 0;
+		case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+		case MODBUS_FC_WRITE_MULTIPLE_COILS:
+		default:
+			/* can't decide from message whether it is a query or response */
+			isQuery = 0;
+			break;
+	}
+	if( nb == -1 )	/* is query or a write-response? */
+	{
+		addr = ( msg[o+2] << 8 ) | msg[o+3];
+		nb = ( msg[o+4] << 8 ) | msg[o+5];
+	}
+	if (ctx->monitor_add_item) {
+		ctx->monitor_add_item(ctx, isQuery,				/* is query */
+				slave,				/* slave */
+				func,				/* func */
+				addr,				/* addr */
+				nb,				/* nb */
+				ctx->last_crc_expected,
+				ctx->last_crc_received
+				//( msg[msg_len-2] << 8 ) | msg[msg_len-1]	/* CRC */
+			);
+	}
+}
+
 void modbus_poll(modbus_t* ctx)
 {
 	uint8_t msg[MAX_MESSAGE_LENGTH];
-	uint8_t msg_len = 0;
+	struct timeval response_timeout;
+	int msg_len = 0;
+	int ret;
 
     	if (ctx == NULL) {
         	return;
     	}
 
-	modbus_set_response_timeout( ctx, 0, 500);
-	const int ret = _modbus_receive_msg( ctx, &msg_len, MSG_CONFIRMATION );	/* wait for 0.5 ms */
-	modbus_set_response_timeout( ctx, 0, _RESPONSE_TIMEOUT);
+	/* only peeks at the line, the configured timeouts are not touched */
+	response_timeout.tv_sec = 0;
+	response_timeout.tv_usec = 500;
+	ret = _modbus_receive_frame( ctx, msg, MSG_CONFIRMATION, &response_timeout,
+	                             &ctx->byte_timeout, FALSE, &msg_len );
 	if( ( ret < 0 && msg_len > 0 ) || ret >= 0 )
 	{
-		const int o = ctx->backend->header_length;
-		const int slave = msg[o+0];
-		const int func = msg[o+1];
-		const int datalen = msg_len - ctx->backend->header_length - ctx->backend->checksum_length - 2;
-		int addr = 0;
-		int nb = -1;
-		int isQuery = 1;
-		switch( func )
-		{
-			case MODBUS_FC_READ_COILS:
-			case MODBUS_FC_READ_DISCRETE_INPUTS:
-				if( msg[o+2] == datalen-1 )
-				{
-					isQuery = 0;
-					nb = (datalen-1) * 8;
-				}
-				break;
-			case MODBUS_FC_READ_HOLDING_REGISTERS:
-			case MODBUS_FC_READ_INPUT_REGISTERS:
-				if( msg[o+2] == datalen-1 )
-				{
-					isQuery = 0;
-					nb = (datalen-1) / 2;
-				}
-				break;
-			case MODBUS_FC_WRITE_SINGLE_COIL:
-			case MODBUS_FC_WRITE_SINGLE_REGISTER:
-				/* can't decide from message whether it is a query or response */
-				isQuery = 0;
-				nb = 1;
-				addr = ( msg[o+2] << 8 ) | msg[o+3];
-				break;
-			case MODBUS_FC_REPORT_SLAVE_ID:
-				nb = 0;
-			case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
-			case MODBUS_FC_WRITE_MULTIPLE_COILS:
-			default:
-				/* can't decide from message whether it is a query or response */
-				isQuery = 0;
-				break;
-		}
-		if( nb == -1 )	/* is query or a write-response? */
-		{
-			addr = ( msg[o+2] << 8 ) | msg[o+3];
-			nb = ( msg[o+4] << 8 ) | msg[o+5];
-		}
-		if (ctx->monitor_add_item) {
-			ctx->monitor_add_item(ctx, isQuery,				/* is query */
-					slave,				/* slave */
-					func,				/* func */
-					addr,				/* addr */
-					nb,				/* nb */
-					ctx->last_crc_expected,
-					ctx->last_crc_received
-					//( msg[msg_len-2] << 8 ) | msg[msg_len-1]	/* CRC */
-				);
-		}
+		_modbus_monitor_decode( ctx, msg, msg_len );
 	}
 }
 
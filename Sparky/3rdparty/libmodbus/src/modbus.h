@@ -117,6 +117,10 @@ MODBUS_BEGIN_DECLS
  */
 #define MODBUS_MAX_PDU_LENGTH              253
 
+/* Largest ADU of all backends, the size of a buffer receiving any
+ * confirmation (a DKOH extended RTU frame is 4 bytes longer than 256) */
+#define MODBUS_MAX_ADU_LENGTH              260
+
 /* Random number to avoid errno conflicts */
 #define MODBUS_ENOBASE 112345678
 
@@ -160,6 +164,7 @@ extern const unsigned int libmodbus_version_minor;
 extern const unsigned int libmodbus_version_micro;
 
 typedef struct _modbus modbus_t;
+typedef struct _modbus_prepared modbus_prepared_t;
 
 typedef struct {
     int nb_bits;
@@ -185,6 +190,28 @@ typedef void (*modbus_monitor_add_item_fnc_t)(modbus_t *ctx,
 typedef void (*modbus_monitor_raw_data_fnc_t)(modbus_t *ctx,
         uint8_t *data, uint8_t dataLen, uint8_t addNewline);
 
+/* Called by modbus_process_io() when a submitted transaction ends, rc is
+   what the blocking function would have returned and errno is set when it
+   is -1 */
+typedef void (*modbus_completion_fnc_t)(modbus_t *ctx, int rc, void *user_data);
+
+typedef enum
+{
+    MODBUS_IO_NONE                      = 0,
+    MODBUS_IO_READ                      = (1<<0)
+} modbus_io_events;
+
+/* Registers of a confirmation left in the buffer they were received in,
+   2 bytes each, big-endian as on the wire */
+typedef struct
+{
+    const uint8_t *data;
+    int nb;
+} modbus_reg_view_t;
+
+#define MODBUS_REG_VIEW_GET(view, index) \
+    ((uint16_t)(((view)->data[2 * (index)] << 8) | (view)->data[2 * (index) + 1]))
+
 MODBUS_API int modbus_set_slave(modbus_t *ctx, int slave);
 MODBUS_API int modbus_set_error_recovery(modbus_t *ctx, modbus_error_recovery_mode error_recovery);
 MODBUS_API int modbus_set_socket(modbus_t *ctx, int s);
@@ -196,6 +223,12 @@ MODBUS_API int modbus_set_response_timeout(modbus_t *ctx, uint32_t to_sec, uint3
 MODBUS_API int modbus_get_byte_timeout(modbus_t *ctx, uint32_t *to_sec, uint32_t *to_usec);
 MODBUS_API int modbus_set_byte_timeout(modbus_t *ctx, uint32_t to_sec, uint32_t to_usec);
 
+MODBUS_API int modbus_get_broadcast_delay(modbus_t *ctx, uint32_t *to_sec, uint32_t *to_usec);
+MODBUS_API int modbus_set_broadcast_delay(modbus_t *ctx, uint32_t to_sec, uint32_t to_usec);
+
+MODBUS_API int modbus_set_adaptive_timeout(modbus_t *ctx, int enable);
+MODBUS_API int modbus_get_slave_latency(modbus_t *ctx, int slave, uint32_t *ewma_us, uint32_t *p99_us);
+
 MODBUS_API int modbus_get_header_length(modbus_t *ctx);
 
 MODBUS_API int modbus_connect(modbus_t *ctx);
@@ -212,6 +245,17 @@ MODBUS_API int modbus_read_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest);
 MODBUS_API int modbus_read_input_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest);
 MODBUS_API int modbus_read_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest);
 MODBUS_API int modbus_read_input_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest);
+MODBUS_API int modbus_read_registers_view(modbus_t *ctx, int addr, int nb, uint8_t *rsp,
+                                          modbus_reg_view_t *view);
+MODBUS_API int modbus_read_input_registers_view(modbus_t *ctx, int addr, int nb, uint8_t *rsp,
+                                                modbus_reg_view_t *view);
+
+MODBUS_API modbus_prepared_t *modbus_prepare_read_registers(modbus_t *ctx, int addr, int nb);
+MODBUS_API modbus_prepared_t *modbus_prepare_read_input_registers(modbus_t *ctx, int addr, int nb);
+MODBUS_API int modbus_read_prepared(modbus_t *ctx, modbus_prepared_t *prep, uint16_t *dest);
+MODBUS_API int modbus_read_prepared_view(modbus_t *ctx, modbus_prepared_t *prep, uint8_t *rsp,
+                                         modbus_reg_view_t *view);
+MODBUS_API void modbus_prepared_free(modbus_prepared_t *prep);
 MODBUS_API int modbus_write_bit(modbus_t *ctx, int coil_addr, int status);
 MODBUS_API int modbus_write_register(modbus_t *ctx, int reg_addr, int value);
 MODBUS_API int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *data);
@@ -222,6 +266,26 @@ MODBUS_API int modbus_write_and_read_registers(modbus_t *ctx, int write_addr, in
                                                uint16_t *dest);
 MODBUS_API int modbus_report_slave_id(modbus_t *ctx, int max_dest, uint8_t *dest);
 
+MODBUS_API int modbus_submit_read_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                                      modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_read_input_bits(modbus_t *ctx, int addr, int nb, uint8_t *dest,
+                                            modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_read_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest,
+                                           modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_read_input_registers(modbus_t *ctx, int addr, int nb, uint16_t *dest,
+                                                 modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_write_bit(modbus_t *ctx, int coil_addr, int status,
+                                      modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_write_register(modbus_t *ctx, int reg_addr, int value,
+                                           modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *data,
+                                       modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_submit_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *data,
+                                            modbus_completion_fnc_t cb, void *user_data);
+MODBUS_API int modbus_process_io(modbus_t *ctx, int events);
+MODBUS_API int modbus_get_io_timeout(modbus_t *ctx);
+MODBUS_API int modbus_is_busy(modbus_t *ctx);
+
 MODBUS_API modbus_mapping_t* modbus_mapping_new(int nb_bits, int nb_input_bits,
                                             int nb_registers, int nb_input_registers);
 MODBUS_API void modbus_mapping_free(modbus_mapping_t *mb_mapping);
@@ -267,6 +331,23 @@ MODBUS_API float modbus_get_float_dcba(const uint16_t *src);
 MODBUS_API void modbus_set_float(float f, uint16_t *dest);
 MODBUS_API void modbus_set_float_dcba(float f, uint16_t *dest);
 
+/* Byte order of a float in 2 registers, bytes named from the most
+   significant one (A) in the order they are sent on the wire */
+typedef enum
+{
+    MODBUS_FLOAT_ABCD,
+    MODBUS_FLOAT_CDAB,
+    MODBUS_FLOAT_BADC,
+    MODBUS_FLOAT_DCBA
+} modbus_float_order_t;
+
+MODBUS_API float modbus_get_float_ordered(const uint16_t *src, modbus_float_order_t order);
+MODBUS_API void modbus_set_float_ordered(float f, uint16_t *dest, modbus_float_order_t order);
+MODBUS_API void modbus_get_float_array(const uint16_t *src, float *dest, int nb,
+                                       modbus_float_order_t order);
+MODBUS_API void modbus_get_float_array_be(const uint8_t *src, float *dest, int nb,
+                                          modbus_float_order_t order);
+
 #include "modbus-tcp.h"
 #include "modbus-rtu.h"
 #include "modbus-ascii.h"
@@ -0,0 +1,238 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include <modbus.h>
+
+#define NB_LOOPS        1000
+#define SERVER_ID       17
+#define ADDRESS         100
+
+static double cputime_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double) ts.tv_sec * 1000000 + ts.tv_nsec / 1000.0;
+}
+
+static double walltime_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1000000 + ts.tv_nsec / 1000.0;
+}
+
+static uint8_t hex_ascii_to_nibble(char digit)
+{
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    } else if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    } else if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    return 0xff;
+}
+
+/* Answers each read of holding registers received on the master side of
+   the pseudo terminal with addr + i, the whole frame in one write */
+static void serve(int fd)
+{
+    char query[64];
+    int length = 0;
+
+    for (;;) {
+        uint8_t rsp[MODBUS_ASCII_MAX_ADU_LENGTH];
+        char out[2 * MODBUS_ASCII_MAX_ADU_LENGTH + 3];
+        uint8_t lrc = 0;
+        int rc = read(fd, query + length, sizeof(query) - length);
+        int addr;
+        int nb;
+        int k = 0;
+        int n;
+        int i;
+
+        if (rc <= 0) {
+            break;
+        }
+        length += rc;
+        /* ':' 6 bytes LRC "\r\n" */
+        if (length < 17) {
+            continue;
+        }
+        length = 0;
+
+        addr = (hex_ascii_to_nibble(query[5]) << 12) | (hex_ascii_to_nibble(query[6]) << 8) |
+            (hex_ascii_to_nibble(query[7]) << 4) | hex_ascii_to_nibble(query[8]);
+        nb = (hex_ascii_to_nibble(query[11]) << 4) | hex_ascii_to_nibble(query[12]);
+        rsp[k++] = SERVER_ID;
+        rsp[k++] = 0x03;
+        rsp[k++] = 2 * nb;
+        for (i = 0; i < nb; i++) {
+            rsp[k++] = (addr + i) >> 8;
+            rsp[k++] = (addr + i) & 0xFF;
+        }
+        for (i = 0; i < k; i++) {
+            lrc += rsp[i];
+        }
+        rsp[k++] = -lrc;
+
+        n = sprintf(out, ":");
+        for (i = 0; i < k; i++) {
+            n += sprintf(out + n, "%02X", rsp[i]);
+        }
+        n += sprintf(out + n, "\r\n");
+        if (write(fd, out, n) == -1) {
+            break;
+        }
+    }
+
+    exit(0);
+}
+
+/* The former receive path of the ASCII backend: a wait and a read per
+   character, a nibble decoded at a time and the LRC summed afterwards */
+static int read_per_char(int fd, int nb, uint16_t *dest)
+{
+    uint8_t rsp[MODBUS_ASCII_MAX_ADU_LENGTH];
+    char req[32];
+    uint8_t lrc = 0;
+    int length = 0;
+    int i;
+
+    lrc = -(SERVER_ID + 0x03 + (ADDRESS >> 8) + (ADDRESS & 0xFF) + nb);
+    sprintf(req, ":%02X03%04X%04X%02X\r\n", SERVER_ID, ADDRESS, nb, lrc);
+    if (write(fd, req, 17) != 17) {
+        return -1;
+    }
+
+    while (length < 5 + 2 * nb + 2) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        char c;
+
+        if (poll(&pfd, 1, 500) != 1 || read(fd, &c, 1) != 1) {
+            return -1;
+        }
+        if (c == ':' || c == '\r' || c == '\n') {
+            rsp[length] = c;
+        } else {
+            rsp[length] = hex_ascii_to_nibble(c) << 4;
+            if (poll(&pfd, 1, 500) != 1 || read(fd, &c, 1) != 1) {
+                return -1;
+            }
+            rsp[length] |= hex_ascii_to_nibble(c);
+        }
+        length++;
+    }
+
+    lrc = 0;
+    for (i = 1; i < length - 2; i++) {
+        lrc += rsp[i];
+    }
+    if (lrc != 0) {
+        errno = EMBBADCRC;
+        return -1;
+    }
+
+    for (i = 0; i < nb; i++) {
+        dest[i] = (rsp[4 + 2 * i] << 8) | rsp[5 + 2 * i];
+    }
+
+    return nb;
+}
+
+int main(void)
+{
+    static const int sizes[] = { 2, 16, 60 };
+    modbus_t *ctx;
+    pid_t server;
+    int nb_errors = 0;
+    int master;
+    unsigned int s;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1) {
+        fprintf(stderr, "Pseudo terminal: %s\n", strerror(errno));
+        return 1;
+    }
+
+    ctx = modbus_new_ascii(ptsname(master), 115200, 'N', 8, 1);
+    if (ctx == NULL || modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        modbus_free(ctx);
+        return 1;
+    }
+    modbus_set_slave(ctx, SERVER_ID);
+
+    /* The child would print what is still buffered */
+    fflush(stdout);
+    server = fork();
+    if (server == 0) {
+        serve(master);
+    }
+
+    printf("Time per transaction in us, CPU / wall\n");
+    printf("  registers       per character     modbus_read_registers\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int nb = sizes[s];
+        int mode;
+
+        printf("  %9d", nb);
+        for (mode = 0; mode < 2; mode++) {
+            uint16_t tab_reg[MODBUS_MAX_READ_REGISTERS];
+            double cpu_start = cputime_us();
+            double wall_start = walltime_us();
+            int i;
+
+            for (i = 0; i < NB_LOOPS; i++) {
+                int rc = (mode == 0) ?
+                    read_per_char(modbus_get_socket(ctx), nb, tab_reg) :
+                    modbus_read_registers(ctx, ADDRESS, nb, tab_reg);
+
+                if (rc != nb || tab_reg[nb - 1] != ADDRESS + nb - 1) {
+                    printf("\nRead %d of %d registers: %s\n", i, nb, modbus_strerror(errno));
+                    nb_errors++;
+                    break;
+                }
+            }
+
+            printf("  %10.1f / %6.1f", (cputime_us() - cpu_start) / NB_LOOPS,
+                   (walltime_us() - wall_start) / NB_LOOPS);
+            if (mode == 0) {
+                printf("    ");
+            }
+        }
+        printf("\n");
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    modbus_close(ctx);
+    modbus_free(ctx);
+    close(master);
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+
+    return 0;
+}
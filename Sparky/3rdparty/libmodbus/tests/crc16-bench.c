@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#ifndef _MSC_VER
+#include <sys/time.h>
+#endif
+#include <string.h>
+#include <stdlib.h>
+
+#include <modbus.h>
+
+#define NB_LOOPS    200000
+
+/* Sizes met on the bus: exception, request or FC05/06 echo, a read of 4
+   floats, the calibration block, 60 floats of a profile and a full ADU */
+static const int frame_sizes[] = { 5, 8, 21, 45, 125, 256 };
+
+static uint8_t table_crc_hi[256];
+static uint8_t table_crc_lo[256];
+
+static double gettime_us(void)
+{
+#if !defined(_MSC_VER)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+    return GetTickCount() * 1000.0;
+#endif
+}
+
+/* Bit by bit, the definition the other two are checked against */
+static uint16_t bitwise_crc16(const uint8_t *buffer, int length)
+{
+    uint16_t crc = 0xFFFF;
+    int i;
+
+    while (length-- > 0) {
+        crc ^= *buffer++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return (uint16_t) ((crc << 8) | (crc >> 8));
+}
+
+static void init_byte_tables(void)
+{
+    int i;
+    int b;
+
+    for (i = 0; i < 256; i++) {
+        uint16_t crc = i;
+
+        for (b = 0; b < 8; b++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        table_crc_hi[i] = crc & 0xFF;
+        table_crc_lo[i] = crc >> 8;
+    }
+}
+
+/* The byte at a time two table loop libmodbus used before */
+static uint16_t byte_crc16(const uint8_t *buffer, int length)
+{
+    uint8_t crc_hi = 0xFF;
+    uint8_t crc_lo = 0xFF;
+    unsigned int i;
+
+    while (length--) {
+        i = crc_hi ^ *buffer++;
+        crc_hi = crc_lo ^ table_crc_hi[i];
+        crc_lo = table_crc_lo[i];
+    }
+
+    return (crc_hi << 8 | crc_lo);
+}
+
+int main(void)
+{
+    uint8_t frame[MODBUS_RTU_MAX_ADU_LENGTH];
+    volatile uint16_t sink = 0;
+    int nb_errors = 0;
+    unsigned int s;
+    int length;
+    int loop;
+    int i;
+
+    init_byte_tables();
+
+    srand(1);
+    for (i = 0; i < MODBUS_RTU_MAX_ADU_LENGTH; i++)
+        frame[i] = rand() & 0xFF;
+
+    /* Every length and every alignment of the slices */
+    for (length = 0; length <= MODBUS_RTU_MAX_ADU_LENGTH; length++) {
+        for (i = 0; i < 8 && i + length <= MODBUS_RTU_MAX_ADU_LENGTH; i++) {
+            uint16_t ref = bitwise_crc16(frame + i, length);
+
+            if (byte_crc16(frame + i, length) != ref ||
+                modbus_rtu_crc16(frame + i, length) != ref) {
+                printf("Length %d at %d: %04X, byte %04X, sliced %04X\n", length, i,
+                       ref, byte_crc16(frame + i, length), modbus_rtu_crc16(frame + i, length));
+                nb_errors++;
+            }
+        }
+    }
+
+    /* Known frame: read 2 input registers at 2 of slave 1 */
+    {
+        const uint8_t req[] = { 0x01, 0x04, 0x00, 0x02, 0x00, 0x02 };
+
+        if (modbus_rtu_crc16(req, sizeof(req)) != 0xD00B) {
+            printf("Request CRC %04X instead of D00B\n", modbus_rtu_crc16(req, sizeof(req)));
+            nb_errors++;
+        }
+    }
+
+    printf("CRC16 of %d frames, ns/frame (ns/byte)\n", NB_LOOPS);
+    printf("  bytes     byte table      slice-by-8\n");
+    for (s = 0; s < sizeof(frame_sizes) / sizeof(frame_sizes[0]); s++) {
+        double start;
+        double elapsed[2];
+
+        length = frame_sizes[s];
+
+        start = gettime_us();
+        for (loop = 0; loop < NB_LOOPS; loop++) {
+            frame[0] = loop;
+            sink += byte_crc16(frame, length);
+        }
+        elapsed[0] = (gettime_us() - start) * 1000 / NB_LOOPS;
+
+        start = gettime_us();
+        for (loop = 0; loop < NB_LOOPS; loop++) {
+            frame[0] = loop;
+            sink += modbus_rtu_crc16(frame, length);
+        }
+        elapsed[1] = (gettime_us() - start) * 1000 / NB_LOOPS;
+
+        printf("  %5d  %7.1f (%5.2f)  %7.1f (%5.2f)\n", length,
+               elapsed[0], elapsed[0] / length, elapsed[1], elapsed[1] / length);
+    }
+
+    if (nb_errors) {
+        printf("%d CRCs computed wrong\n", nb_errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#ifndef _MSC_VER
+#include <sys/time.h>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <modbus.h>
+
+#define NB_FLOATS   (MODBUS_MAX_READ_REGISTERS / 2)
+#define NB_LOOPS    2000
+
+static double gettime_us(void)
+{
+#if !defined(_MSC_VER)
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+#else
+    return GetTickCount() * 1000.0;
+#endif
+}
+
+/* The decoding formerly done by the application: hex text, then a text of
+   '0' and '1', then the mantissa summed with pow() */
+static float string_get_float(const uint16_t *src)
+{
+    char hex[16];
+    char bin[40];
+    unsigned long long bits;
+    double mantissa = 0;
+    int sign = 1;
+    int len;
+    int exponent;
+    int i;
+
+    snprintf(hex, sizeof(hex), "%04x%04x", src[0], src[1]);
+    bits = strtoull(hex, NULL, 16);
+
+    len = 0;
+    for (i = 31; i >= 0; i--) {
+        if (len == 0 && i > 0 && !(bits >> i & 1))
+            continue;
+        bin[len++] = (bits >> i & 1) ? '1' : '0';
+    }
+    bin[len] = '\0';
+
+    if (len == 32) {
+        if (bin[0] == '1')
+            sign = -1;
+        memmove(bin, bin + 1, len--);
+    }
+
+    for (i = 0; i < 23 && len - 23 + i >= 0; i++) {
+        if (bin[len - 23 + i] == '1')
+            mantissa += 1.0 / pow(2, i + 1);
+    }
+
+    exponent = 0;
+    for (i = 0; i < len - 23; i++) {
+        exponent = exponent * 2 + (bin[i] == '1');
+    }
+    exponent -= 127;
+
+    return sign * pow(2, exponent) * (mantissa + 1.0);
+}
+
+int main(void)
+{
+    uint16_t tab_reg[NB_FLOATS * 2];
+    float ref[NB_FLOATS];
+    float out[NB_FLOATS];
+    volatile float sink = 0;
+    double start;
+    double elapsed[3];
+    int nb_errors = 0;
+    int order;
+    int loop;
+    int i;
+
+    srand(1);
+    for (i = 0; i < NB_FLOATS; i++) {
+        ref[i] = (float) (rand() - RAND_MAX / 2) / (1 + rand() % 1000);
+        modbus_set_float_ordered(ref[i], tab_reg + 2 * i, MODBUS_FLOAT_ABCD);
+    }
+
+    /* Every byte order must round trip, through the array path too */
+    for (order = MODBUS_FLOAT_ABCD; order <= MODBUS_FLOAT_DCBA; order++) {
+        uint16_t tab_order[NB_FLOATS * 2];
+
+        for (i = 0; i < NB_FLOATS; i++)
+            modbus_set_float_ordered(ref[i], tab_order + 2 * i, order);
+        modbus_get_float_array(tab_order, out, NB_FLOATS, order);
+        for (i = 0; i < NB_FLOATS; i++) {
+            if (out[i] != ref[i] ||
+                modbus_get_float_ordered(tab_order + 2 * i, order) != ref[i]) {
+                printf("Order %d, float %d: %f decoded as %f\n", order, i, ref[i], out[i]);
+                nb_errors++;
+            }
+        }
+    }
+
+    /* Check all the paths agree before timing them */
+    modbus_get_float_array(tab_reg, out, NB_FLOATS, MODBUS_FLOAT_ABCD);
+    for (i = 0; i < NB_FLOATS; i++) {
+        if (out[i] != ref[i] ||
+            modbus_get_float_ordered(tab_reg + 2 * i, MODBUS_FLOAT_ABCD) != ref[i] ||
+            fabsf(string_get_float(tab_reg + 2 * i) - ref[i]) > fabsf(ref[i]) * 1e-6) {
+            printf("Float %d: %f decoded as %f\n", i, ref[i], out[i]);
+            nb_errors++;
+        }
+    }
+
+    start = gettime_us();
+    for (loop = 0; loop < NB_LOOPS / 100; loop++) {
+        for (i = 0; i < NB_FLOATS; i++)
+            sink += string_get_float(tab_reg + 2 * i);
+    }
+    elapsed[0] = (gettime_us() - start) * 100;
+
+    start = gettime_us();
+    for (loop = 0; loop < NB_LOOPS; loop++) {
+        for (i = 0; i < NB_FLOATS; i++)
+            sink += modbus_get_float_ordered(tab_reg + 2 * i, MODBUS_FLOAT_ABCD);
+    }
+    elapsed[1] = gettime_us() - start;
+
+    start = gettime_us();
+    for (loop = 0; loop < NB_LOOPS; loop++) {
+        modbus_get_float_array(tab_reg, out, NB_FLOATS, MODBUS_FLOAT_ABCD);
+        sink += out[loop % NB_FLOATS];
+    }
+    elapsed[2] = gettime_us() - start;
+
+    printf("Decoding %d floats %d times (ABCD)\n", NB_FLOATS, NB_LOOPS);
+    printf("* string:  %8.2f ns/float\n", elapsed[0] * 1000 / ((double) NB_LOOPS * NB_FLOATS));
+    printf("* ordered: %8.2f ns/float\n", elapsed[1] * 1000 / ((double) NB_LOOPS * NB_FLOATS));
+    printf("* array:   %8.2f ns/float\n", elapsed[2] * 1000 / ((double) NB_LOOPS * NB_FLOATS));
+
+    if (nb_errors) {
+        printf("%d floats decoded wrong\n", nb_errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+#include <modbus.h>
+
+#define PORT            1503
+#define NB_LOOPS        4000
+#define NB_REGISTERS    10
+#define NB_QUEUED       64
+
+/* Reply of the stand-in server, sent once its time has come */
+typedef struct {
+    double due;
+    int length;
+    uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+} reply_t;
+
+/* Request of the client in flight */
+typedef struct {
+    int busy;
+    int addr;
+    uint16_t tab_reg[NB_REGISTERS];
+} job_t;
+
+static int nb_errors;
+static int nb_done;
+static int nb_submitted;
+static job_t jobs[MODBUS_TCP_MAX_PIPELINE_DEPTH];
+
+static double gettime_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Answers reads of holding registers with addr + i after latency us, plus
+   up to 3/4 of it depending on the transaction ID so the answers overtake
+   each other like behind a gateway polling several lines */
+static void serve(int latency)
+{
+    modbus_t *ctx;
+    reply_t queue[NB_QUEUED];
+    int nb_queued = 0;
+    int s = -1;
+
+    ctx = modbus_new_tcp("127.0.0.1", PORT);
+    /* Indications wait for the response timeout too */
+    modbus_set_response_timeout(ctx, 10, 0);
+    modbus_set_slave(ctx, 1);
+    s = modbus_tcp_listen(ctx, 1);
+    if (s == -1 || modbus_tcp_accept(ctx, &s) == -1) {
+        fprintf(stderr, "Server: %s\n", modbus_strerror(errno));
+        exit(1);
+    }
+
+    for (;;) {
+        struct pollfd pfd;
+        double now = gettime_us();
+        int timeout = -1;
+        int i;
+
+        for (i = 0; i < nb_queued; i++) {
+            int left = (int)((queue[i].due - now + 999) / 1000);
+
+            if (timeout == -1 || left < timeout) {
+                timeout = left > 0 ? left : 0;
+            }
+        }
+
+        pfd.fd = modbus_get_socket(ctx);
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout) > 0) {
+            uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+            int rc = modbus_receive(ctx, query);
+            int t_id = (query[0] << 8) | query[1];
+            int addr = (query[8] << 8) | query[9];
+            int nb = (query[10] << 8) | query[11];
+            reply_t *r;
+
+            if (rc == -1) {
+                break;
+            }
+            if (rc == 0 || nb_queued == NB_QUEUED) {
+                continue;
+            }
+
+            r = &queue[nb_queued++];
+            r->due = gettime_us() + latency + (t_id % 4) * latency / 4;
+            memcpy(r->rsp, query, 7);
+            r->rsp[4] = 0;
+            r->rsp[5] = 3 + 2 * nb;
+            r->rsp[7] = MODBUS_FC_READ_HOLDING_REGISTERS;
+            r->rsp[8] = 2 * nb;
+            for (i = 0; i < nb; i++) {
+                r->rsp[9 + 2 * i] = (addr + i) >> 8;
+                r->rsp[10 + 2 * i] = (addr + i) & 0xFF;
+            }
+            r->length = 9 + 2 * nb;
+        }
+
+        now = gettime_us();
+        for (i = 0; i < nb_queued;) {
+            if (queue[i].due <= now) {
+                send(modbus_get_socket(ctx), queue[i].rsp, queue[i].length, 0);
+                queue[i] = queue[--nb_queued];
+            } else {
+                i++;
+            }
+        }
+    }
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+    exit(0);
+}
+
+static void completed(modbus_t *ctx, int rc, void *user_data);
+
+static void submit(modbus_t *ctx, job_t *job)
+{
+    job->busy = 1;
+    job->addr = nb_submitted++ % 1000;
+    if (modbus_submit_read_registers(ctx, job->addr, NB_REGISTERS, job->tab_reg,
+                                     completed, job) == -1) {
+        printf("Submit failed: %s\n", modbus_strerror(errno));
+        job->busy = 0;
+        nb_errors++;
+    }
+}
+
+static void completed(modbus_t *ctx, int rc, void *user_data)
+{
+    job_t *job = user_data;
+    int i;
+
+    job->busy = 0;
+    nb_done++;
+
+    if (rc != NB_REGISTERS) {
+        printf("Read at %d: %s\n", job->addr, modbus_strerror(errno));
+        nb_errors++;
+    } else {
+        for (i = 0; i < NB_REGISTERS; i++) {
+            if (job->tab_reg[i] != job->addr + i) {
+                printf("Read at %d: register %d is %d\n", job->addr, i,
+                       job->tab_reg[i]);
+                nb_errors++;
+                break;
+            }
+        }
+    }
+
+    if (nb_submitted < NB_LOOPS) {
+        submit(ctx, job);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    static const int depths[] = { 1, 2, 4, 8, 16 };
+    int latency = 1000;
+    unsigned int d;
+
+    if (argc > 1) {
+        latency = atoi(argv[1]);
+    }
+
+    printf("Reads of %d registers, server answering after %d-%d us\n",
+           NB_REGISTERS, latency, latency + 3 * latency / 4);
+    printf("  depth   requests/s   us/request\n");
+
+    for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        modbus_t *ctx;
+        pid_t server;
+        double start;
+        double elapsed;
+        int i;
+
+        /* The child would print what is still buffered */
+        fflush(stdout);
+        server = fork();
+        if (server == 0) {
+            serve(latency);
+        }
+
+        ctx = modbus_new_tcp("127.0.0.1", PORT);
+        for (i = 0; i < 50; i++) {
+            if (modbus_connect(ctx) == 0)
+                break;
+            usleep(20000);
+        }
+        if (i == 50) {
+            fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+            kill(server, SIGTERM);
+            modbus_free(ctx);
+            return 1;
+        }
+        modbus_set_slave(ctx, 1);
+        modbus_tcp_set_pipeline_depth(ctx, depths[d]);
+
+        nb_done = 0;
+        nb_submitted = 0;
+        start = gettime_us();
+        for (i = 0; i < depths[d]; i++) {
+            submit(ctx, &jobs[i]);
+        }
+
+        while (modbus_is_busy(ctx) > 0) {
+            struct pollfd pfd;
+            int rc;
+
+            pfd.fd = modbus_get_socket(ctx);
+            pfd.events = POLLIN;
+            rc = poll(&pfd, 1, modbus_get_io_timeout(ctx));
+            modbus_process_io(ctx, rc > 0 ? MODBUS_IO_READ : MODBUS_IO_NONE);
+        }
+        elapsed = gettime_us() - start;
+
+        printf("  %5d  %11.0f  %11.1f\n", depths[d],
+               nb_done * 1000000.0 / elapsed, elapsed / nb_done);
+
+        modbus_close(ctx);
+        modbus_free(ctx);
+        waitpid(server, NULL, 0);
+    }
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+
+    return 0;
+}
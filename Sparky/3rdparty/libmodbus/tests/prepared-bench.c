@@ -0,0 +1,217 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include <modbus.h>
+
+#define NB_LOOPS        1000
+#define SERVER_ID       17
+#define ADDRESS         100
+
+/* Modes of reading compared */
+enum {
+    READ_REGISTERS,
+    READ_VIEW,
+    READ_PREPARED,
+    READ_PREPARED_VIEW
+};
+
+static const char *mode_names[] = {
+    "modbus_read_registers",
+    "modbus_read_registers_view",
+    "modbus_read_prepared",
+    "modbus_read_prepared_view"
+};
+
+static double cputime_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double) ts.tv_sec * 1000000 + ts.tv_nsec / 1000.0;
+}
+
+/* Answers each read of holding registers received on the master side of
+   the pseudo terminal with addr + i, without libmodbus so the time spent by
+   the client is all that is measured */
+static void serve(int fd)
+{
+    uint8_t query[8];
+    uint8_t rsp[MODBUS_RTU_MAX_ADU_LENGTH];
+    int length = 0;
+
+    for (;;) {
+        int rc = read(fd, query + length, sizeof(query) - length);
+        int addr;
+        int nb;
+        int i;
+        uint16_t crc;
+
+        if (rc <= 0) {
+            break;
+        }
+        length += rc;
+        if (length < (int)sizeof(query)) {
+            continue;
+        }
+        length = 0;
+
+        addr = (query[2] << 8) | query[3];
+        nb = (query[4] << 8) | query[5];
+        rsp[0] = query[0];
+        rsp[1] = query[1];
+        rsp[2] = 2 * nb;
+        for (i = 0; i < nb; i++) {
+            rsp[3 + 2 * i] = (addr + i) >> 8;
+            rsp[4 + 2 * i] = (addr + i) & 0xFF;
+        }
+        crc = modbus_rtu_crc16(rsp, 3 + 2 * nb);
+        rsp[3 + 2 * nb] = crc >> 8;
+        rsp[4 + 2 * nb] = crc & 0xFF;
+        if (write(fd, rsp, 5 + 2 * nb) == -1) {
+            break;
+        }
+    }
+
+    exit(0);
+}
+
+static int check(int mode, int nb, const uint16_t *tab_reg,
+                 const modbus_reg_view_t *view)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        int value = (mode == READ_VIEW || mode == READ_PREPARED_VIEW) ?
+            MODBUS_REG_VIEW_GET(view, i) : tab_reg[i];
+
+        if (value != ADDRESS + i) {
+            printf("%s: register %d is %d\n", mode_names[mode], i, value);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static const int sizes[] = { 2, 16, 60 };
+    modbus_t *ctx;
+    pid_t server;
+    int nb_errors = 0;
+    int master;
+    unsigned int s;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1) {
+        fprintf(stderr, "Pseudo terminal: %s\n", strerror(errno));
+        return 1;
+    }
+
+    ctx = modbus_new_rtu(ptsname(master), 115200, 'N', 8, 1);
+    if (ctx == NULL || modbus_connect(ctx) == -1) {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        modbus_free(ctx);
+        return 1;
+    }
+    modbus_set_slave(ctx, SERVER_ID);
+
+    /* The child would print what is still buffered */
+    fflush(stdout);
+    server = fork();
+    if (server == 0) {
+        serve(master);
+    }
+
+    printf("Client CPU time per transaction in us\n");
+    printf("  registers");
+    for (s = 0; s < 4; s++) {
+        printf("  %s", mode_names[s]);
+    }
+    printf("\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        modbus_prepared_t *prep;
+        int nb = sizes[s];
+        int mode;
+
+        prep = modbus_prepare_read_registers(ctx, ADDRESS, nb);
+        if (prep == NULL) {
+            fprintf(stderr, "Prepare failed: %s\n", modbus_strerror(errno));
+            nb_errors++;
+            break;
+        }
+
+        printf("  %9d", nb);
+        for (mode = READ_REGISTERS; mode <= READ_PREPARED_VIEW; mode++) {
+            uint16_t tab_reg[MODBUS_MAX_READ_REGISTERS];
+            uint8_t rsp[MODBUS_MAX_ADU_LENGTH];
+            modbus_reg_view_t view;
+            double start;
+            int i;
+
+            start = cputime_us();
+            for (i = 0; i < NB_LOOPS; i++) {
+                int rc;
+
+                switch (mode) {
+                case READ_REGISTERS:
+                    rc = modbus_read_registers(ctx, ADDRESS, nb, tab_reg);
+                    break;
+                case READ_VIEW:
+                    rc = modbus_read_registers_view(ctx, ADDRESS, nb, rsp, &view);
+                    break;
+                case READ_PREPARED:
+                    rc = modbus_read_prepared(ctx, prep, tab_reg);
+                    break;
+                default:
+                    rc = modbus_read_prepared_view(ctx, prep, rsp, &view);
+                    break;
+                }
+
+                if (rc != nb) {
+                    printf("%s: %s\n", mode_names[mode], modbus_strerror(errno));
+                    nb_errors++;
+                    break;
+                }
+            }
+
+            printf("  %*.2f", (int)strlen(mode_names[mode]),
+                   (cputime_us() - start) / NB_LOOPS);
+            if (check(mode, nb, tab_reg, &view) == -1) {
+                nb_errors++;
+            }
+        }
+        printf("\n");
+
+        modbus_prepared_free(prep);
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    modbus_close(ctx);
+    modbus_free(ctx);
+    close(master);
+
+    if (nb_errors) {
+        printf("%d errors\n", nb_errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sys/select.h>
 #include <modbus.h>
 
 #include "unit-test.h"
@@ -26,6 +27,9 @@ int send_crafted_request(modbus_t *ctx, int function,
                          uint16_t max_value, uint16_t bytes,
                          int backend_length, int backend_offset);
 
+void submit_completed(modbus_t *ctx, int rc, void *user_data);
+int wait_submitted(modbus_t *ctx);
+
 #define BUG_REPORT(_cond, _format, _args ...) \
     printf("\nLine %d: assertion error for '%s': " _format "\n", __LINE__, # _cond, ## _args)
 
@@ -50,7 +54,10 @@ int main(int argc, char *argv[])
     int nb_points;
     int rc;
     float real;
+    float reals[5];
     uint32_t ireal;
+    uint8_t adu[MODBUS_MAX_ADU_LENGTH];
+    modbus_reg_view_t view;
     uint32_t old_response_to_sec;
     uint32_t old_response_to_usec;
     uint32_t new_response_to_sec;
@@ -58,6 +65,7 @@ int main(int argc, char *argv[])
     uint32_t old_byte_to_sec;
     uint32_t old_byte_to_usec;
     int use_backend;
+    int value_rc;
 
     if (argc > 1) {
         if (strcmp(argv[1], "tcp") == 0) {
@@ -258,7 +266,7 @@ int main(int argc, char *argv[])
     rc = modbus_read_input_registers(ctx, UT_INPUT_REGISTERS_ADDRESS,
                                      UT_INPUT_REGISTERS_NB,
                                      tab_rp_registers);
-    printf("1/1 modbus_read_input_registers: ");
+    printf("1/2 modbus_read_input_registers: ");
     ASSERT_TRUE(rc == UT_INPUT_REGISTERS_NB, "FAILED (nb points %d)\n", rc);
 
     for (i=0; i < UT_INPUT_REGISTERS_NB; i++) {
@@ -267,9 +275,22 @@ int main(int argc, char *argv[])
                     tab_rp_registers[i], UT_INPUT_REGISTERS_TAB[i]);
     }
 
+    rc = modbus_read_input_registers_view(ctx, UT_INPUT_REGISTERS_ADDRESS,
+                                          UT_INPUT_REGISTERS_NB, adu, &view);
+    printf("2/2 modbus_read_input_registers_view: ");
+    ASSERT_TRUE(rc == UT_INPUT_REGISTERS_NB && view.nb == rc &&
+                view.data > adu && view.data < adu + sizeof(adu),
+                "FAILED (nb points %d)\n", rc);
+
+    for (i=0; i < UT_INPUT_REGISTERS_NB; i++) {
+        ASSERT_TRUE(MODBUS_REG_VIEW_GET(&view, i) == UT_INPUT_REGISTERS_TAB[i],
+                    "FAILED (%0X != %0X)\n",
+                    MODBUS_REG_VIEW_GET(&view, i), UT_INPUT_REGISTERS_TAB[i]);
+    }
+
     printf("\nTEST FLOATS\n");
     /** FLOAT **/
-    printf("1/4 Set float: ");
+    printf("1/5 Set float: ");
     modbus_set_float(UT_REAL, tab_rp_registers);
     if (tab_rp_registers[1] == (UT_IREAL >> 16) &&
         tab_rp_registers[0] == (UT_IREAL & 0xFFFF)) {
@@ -283,11 +304,11 @@ int main(int argc, char *argv[])
         goto close;
     }
 
-    printf("2/4 Get float: ");
+    printf("2/5 Get float: ");
     real = modbus_get_float(tab_rp_registers);
     ASSERT_TRUE(real == UT_REAL, "FAILED (%f != %f)\n", real, UT_REAL);
 
-    printf("3/4 Set float in DBCA order: ");
+    printf("3/5 Set float in DBCA order: ");
     modbus_set_float_dcba(UT_REAL, tab_rp_registers);
     ireal = (uint32_t) tab_rp_registers[0] & 0xFFFF;
     ireal |= (uint32_t) tab_rp_registers[1] << 16;
@@ -295,10 +316,50 @@ int main(int argc, char *argv[])
                 tab_rp_registers[0] == (UT_IREAL_DCBA & 0xFFFF),
                 "FAILED (%x != %x)\n", ireal, UT_IREAL_DCBA);
 
-    printf("4/4 Get float in DCBA order: ");
+    printf("4/5 Get float in DCBA order: ");
     real = modbus_get_float_dcba(tab_rp_registers);
     ASSERT_TRUE(real == UT_REAL, "FAILED (%f != %f)\n", real, UT_REAL);
 
+    printf("5/5 Get floats from big-endian registers: ");
+    for (i = 0; i < 5; i++) {
+        MODBUS_SET_INT16_TO_INT8(adu, 4 * i, UT_IREAL >> 16);
+        MODBUS_SET_INT16_TO_INT8(adu, 4 * i + 2, UT_IREAL & 0xFFFF);
+    }
+    modbus_get_float_array_be(adu, reals, 5, MODBUS_FLOAT_ABCD);
+    for (i = 0; i < 5; i++) {
+        ASSERT_TRUE(reals[i] == UT_REAL, "FAILED (%f != %f)\n", reals[i], UT_REAL);
+    }
+
+    /** NON-BLOCKING **/
+    printf("\nTEST NON-BLOCKING:\n");
+    memset(tab_rp_registers, 0, UT_INPUT_REGISTERS_NB * sizeof(uint16_t));
+    rc = modbus_submit_read_input_registers(ctx, UT_INPUT_REGISTERS_ADDRESS,
+                                            UT_INPUT_REGISTERS_NB,
+                                            tab_rp_registers,
+                                            submit_completed, &value_rc);
+    printf("1/4 modbus_submit_read_input_registers: ");
+    ASSERT_TRUE(rc == 0 && modbus_is_busy(ctx) == 1, "FAILED (%d)\n", rc);
+
+    rc = modbus_submit_read_registers(ctx, UT_REGISTERS_ADDRESS, 1,
+                                      tab_rp_registers, submit_completed,
+                                      &value_rc);
+    printf("2/4 Second submit while busy: ");
+    ASSERT_TRUE(rc == -1 && errno == EBUSY, "FAILED (%d)\n", rc);
+
+    rc = wait_submitted(ctx);
+    printf("3/4 Completion: ");
+    ASSERT_TRUE(rc == 0 && value_rc == UT_INPUT_REGISTERS_NB &&
+                modbus_is_busy(ctx) == 0, "FAILED (%d)\n", value_rc);
+
+    printf("4/4 Values: ");
+    for (i=0; i < UT_INPUT_REGISTERS_NB; i++) {
+        if (tab_rp_registers[i] != UT_INPUT_REGISTERS_TAB[i])
+            break;
+    }
+    ASSERT_TRUE(i == UT_INPUT_REGISTERS_NB,
+                "FAILED (%0X != %0X)\n",
+                tab_rp_registers[i], UT_INPUT_REGISTERS_TAB[i]);
+
     printf("\nAt this point, error messages doesn't mean the test has failed\n");
 
     /** ILLEGAL DATA ADDRESS **/
@@ -781,3 +842,34 @@ int send_crafted_request(modbus_t *ctx, int function,
 close:
     return -1;
 }
+
+void submit_completed(modbus_t *ctx, int rc, void *user_data)
+{
+    *(int *)user_data = rc;
+}
+
+/* Runs the event loop of an application until the submitted transaction
+   completes */
+int wait_submitted(modbus_t *ctx)
+{
+    while (modbus_is_busy(ctx) == 1) {
+        fd_set rset;
+        struct timeval tv;
+        int timeout = modbus_get_io_timeout(ctx);
+        int rc;
+
+        FD_ZERO(&rset);
+        FD_SET(modbus_get_socket(ctx), &rset);
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+
+        rc = select(modbus_get_socket(ctx) + 1, &rset, NULL, NULL, &tv);
+        if (rc == -1 && errno != EINTR) {
+            return -1;
+        }
+
+        modbus_process_io(ctx, rc > 0 ? MODBUS_IO_READ : MODBUS_IO_NONE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright © 2008-2014 Stéphane Raimbault <stephane.raimbault@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the BSD License.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#include <modbus.h>
+
+#define PORT            1504
+#define NB_WAITS        200000
+#define NB_READS        2000
+#define NB_REGISTERS    10
+
+static double gettime_us(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Opens idle descriptors until the next one is numbered at least n */
+static int open_idle(int n)
+{
+    int fds[2];
+
+    for (;;) {
+        if (pipe(fds) == -1) {
+            return -1;
+        }
+        if (fds[1] >= n - 1) {
+            return 0;
+        }
+    }
+}
+
+/* Both find the socket readable at once, only the cost of asking is left */
+static void bench_wait(int fd)
+{
+    struct pollfd pfd;
+    double start;
+    double select_ns;
+    double poll_ns;
+    int i;
+
+    start = gettime_us();
+    for (i = 0; i < NB_WAITS; i++) {
+        fd_set rset;
+        struct timeval tv = { 0, 0 };
+
+        FD_ZERO(&rset);
+        FD_SET(fd, &rset);
+        select(fd + 1, &rset, NULL, NULL, &tv);
+    }
+    select_ns = (gettime_us() - start) * 1000 / NB_WAITS;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    start = gettime_us();
+    for (i = 0; i < NB_WAITS; i++) {
+        poll(&pfd, 1, 0);
+    }
+    poll_ns = (gettime_us() - start) * 1000 / NB_WAITS;
+
+    printf("  %10d  %9.0f  %7.0f\n", fd, select_ns, poll_ns);
+}
+
+static void serve(void)
+{
+    modbus_t *ctx;
+    modbus_mapping_t *mb_mapping;
+    int s;
+    int i;
+
+    ctx = modbus_new_tcp("127.0.0.1", PORT);
+    modbus_set_slave(ctx, 1);
+    mb_mapping = modbus_mapping_new(0, 0, NB_REGISTERS, 0);
+    for (i = 0; i < NB_REGISTERS; i++) {
+        mb_mapping->tab_registers[i] = i;
+    }
+
+    s = modbus_tcp_listen(ctx, 1);
+    if (s == -1 || modbus_tcp_accept(ctx, &s) == -1) {
+        fprintf(stderr, "Server: %s\n", modbus_strerror(errno));
+        exit(1);
+    }
+
+    for (;;) {
+        uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+        int rc = modbus_receive(ctx, query);
+
+        if (rc > 0) {
+            modbus_reply(ctx, query, rc, mb_mapping);
+        } else if (rc == -1) {
+            break;
+        }
+    }
+
+    modbus_mapping_free(mb_mapping);
+    modbus_close(ctx);
+    modbus_free(ctx);
+    exit(0);
+}
+
+/* Reads registers over a socket numbered above FD_SETSIZE, out of reach of
+   an fd_set */
+static int bench_high_socket(void)
+{
+    struct rlimit rl;
+    modbus_t *ctx;
+    uint16_t tab_reg[NB_REGISTERS];
+    pid_t server;
+    double start;
+    int nb_errors = 0;
+    int i;
+
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < FD_SETSIZE + 64) {
+        rl.rlim_cur = (rl.rlim_max < FD_SETSIZE + 64) ? rl.rlim_max : FD_SETSIZE + 64;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur < FD_SETSIZE + 64) {
+        printf("Only %d descriptors allowed, socket above FD_SETSIZE skipped\n",
+               (int)rl.rlim_cur);
+        return 0;
+    }
+
+    /* The child would print what is still buffered */
+    fflush(stdout);
+    server = fork();
+    if (server == 0) {
+        serve();
+    }
+
+    if (open_idle(FD_SETSIZE) == -1) {
+        fprintf(stderr, "Idle descriptors: %s\n", strerror(errno));
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    ctx = modbus_new_tcp("127.0.0.1", PORT);
+    for (i = 0; i < 50; i++) {
+        if (modbus_connect(ctx) == 0)
+            break;
+        usleep(20000);
+    }
+    if (i == 50) {
+        fprintf(stderr, "Connection failed: %s\n", modbus_strerror(errno));
+        kill(server, SIGTERM);
+        modbus_free(ctx);
+        return 1;
+    }
+    modbus_set_slave(ctx, 1);
+
+    start = gettime_us();
+    for (i = 0; i < NB_READS; i++) {
+        if (modbus_read_registers(ctx, 0, NB_REGISTERS, tab_reg) != NB_REGISTERS ||
+            tab_reg[NB_REGISTERS - 1] != NB_REGISTERS - 1) {
+            printf("Read %d: %s\n", i, modbus_strerror(errno));
+            nb_errors++;
+            break;
+        }
+    }
+    printf("Socket %d (FD_SETSIZE %d): %d reads, %.1f us/read\n",
+           modbus_get_socket(ctx), FD_SETSIZE, i, (gettime_us() - start) / NB_READS);
+
+    modbus_close(ctx);
+    modbus_free(ctx);
+    waitpid(server, NULL, 0);
+
+    return nb_errors;
+}
+
+int main(void)
+{
+    static const int nb_idle[] = { 16, 128, 512, 1000 };
+    unsigned int n;
+    int sv[2];
+
+    printf("Wait for a readable socket among idle descriptors, ns per call\n");
+    printf("  descriptor     select     poll\n");
+
+    for (n = 0; n < sizeof(nb_idle) / sizeof(nb_idle[0]); n++) {
+        if (open_idle(nb_idle[n]) == -1 ||
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            fprintf(stderr, "Descriptors: %s\n", strerror(errno));
+            return 1;
+        }
+        if (write(sv[1], "x", 1) != 1) {
+            return 1;
+        }
+
+        bench_wait(sv[0]);
+    }
+
+    return bench_high_socket() ? 1 : 0;
+}
@@ -7,6 +7,14 @@ QT += gui widgets charts
 SOURCES += src/main.cpp \
     src/mainwindow.cpp \
     src/BatchProcessor.cpp \
+    src/LoopWorker.cpp \
+    src/CalibrationOrchestrator.cpp \
+    src/TelemetryPoller.cpp \
+    src/DiscoveryEngine.cpp \
+    src/PortInventory.cpp \
+    src/RegisterMap.cpp \
+    src/BusMonitorModel.cpp \
+    src/ProfileModel.cpp \
     3rdparty/qextserialport/qextserialport.cpp	\
     3rdparty/libmodbus/src/modbus.c \
     3rdparty/libmodbus/src/modbus-data.c \
@@ -20,6 +28,14 @@ SOURCES += src/main.cpp \
 
 HEADERS += src/mainwindow.h \
     src/BatchProcessor.h \
+    src/LoopWorker.h \
+    src/CalibrationOrchestrator.h \
+    src/TelemetryPoller.h \
+    src/DiscoveryEngine.h \
+    src/PortInventory.h \
+    src/RegisterMap.h \
+    src/BusMonitorModel.h \
+    src/ProfileModel.h \
     3rdparty/qextserialport/qextserialport.h \
     3rdparty/qextserialport/qextserialenumerator.h \
     3rdparty/libmodbus/src/modbus.h \
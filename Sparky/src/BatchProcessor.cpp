@@ -35,10 +35,10 @@
 
 
 
-BatchProcessor::BatchProcessor( QWidget *parent, modbus_t *modbus ) :
+BatchProcessor::BatchProcessor( QWidget *parent, LoopWorker *worker ) :
 	QDialog( parent ),
 	ui( new Ui::BatchProcessor ),
-	m_modbus( modbus ),
+	m_worker( worker ),
 	m_timer()
 {
 	ui->setupUi(this);
@@ -142,78 +142,34 @@ void BatchProcessor::runBatch()
 
 QString BatchProcessor::sendModbusRequest( int slaveID, int func, int addr )
 {
-	if( m_modbus == NULL )
+	if( m_worker == NULL || !m_worker->isConfigured() )
 	{
 		return QString();
 	}
 
 	const int num = 1;
-	uint8_t dest[num*sizeof(uint16_t)];
-	uint16_t * dest16 = (uint16_t *) dest;
-
-	memset( dest, 0, sizeof( dest ) );
-
-	int ret = -1;
-	bool is16Bit = false;
-
-	modbus_set_slave( m_modbus, slaveID );
 
 	switch( func )
 	{
 		case MODBUS_FC_READ_COILS:
-			ret = modbus_read_bits( m_modbus, addr, num, dest );
-			break;
 		case MODBUS_FC_READ_DISCRETE_INPUTS:
-			ret = modbus_read_input_bits( m_modbus, addr, num, dest );
-			break;
 		case MODBUS_FC_READ_HOLDING_REGISTERS:
-			ret = modbus_read_registers( m_modbus, addr, num, dest16 );
-			is16Bit = true;
-			break;
 		case MODBUS_FC_READ_INPUT_REGISTERS:
-			ret = modbus_read_input_registers( m_modbus, addr, num, dest16 );
-			is16Bit = true;
-			break; 
-/*		case MODBUS_FC_WRITE_SINGLE_COIL:
-			ret = modbus_write_bit( m_modbus, addr,ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) ? 1 : 0 );
-			writeAccess = true;
-			num = 1;
 			break;
+/*		case MODBUS_FC_WRITE_SINGLE_COIL:
 		case MODBUS_FC_WRITE_SINGLE_REGISTER:
-			ret = modbus_write_register( m_modbus, addr,ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) );
-			writeAccess = true;
-			num = 1;
-			break;
 		case MODBUS_FC_WRITE_MULTIPLE_COILS:
-		{
-			uint8_t * data = new uint8_t[num];
-			for( int i = 0; i < num; ++i )
-			{
-				data[i] = ui->regTable->item( i, DataColumn )->text().toInt(0, 0);
-			}
-			ret = modbus_write_bits( m_modbus, addr, num, data );
-			delete[] data;
-			writeAccess = true;
-			break;
-		}
-		case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
-		{
-			uint16_t * data = new uint16_t[num];
-			for( int i = 0; i < num; ++i )
-			{
-				data[i] = ui->regTable->item( i, DataColumn )->text().toInt(0, 0);
-			}
-			ret = modbus_write_registers( m_modbus, addr, num, data );
-			delete[] data;
-			writeAccess = true;
-			break;
-		}*/
+		case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:*/
 
 		default:
 			QMessageBox::warning( this, tr( "Unimplemented function code" ), tr( "Function code %1 not implemented" ).arg( func ) );
-			break;
+			return "-1 (NO VALID DATA RECEIVED)";
 	}
 
+	// runs on the loop thread, the dialog stays responsive meanwhile
+	const LOOP_RESPONSE response = m_worker->execute( LoopWorker::readRequest( slaveID, func, addr, num, LoopWorker::RawValue ) );
+	const int ret = response.ret;
+
 	if( ret == num )
 	{
 		bool b_hex = false;//is16Bit && ui->checkBoxHexData->checkState() == Qt::Checked;
@@ -221,7 +177,7 @@ QString BatchProcessor::sendModbusRequest( int slaveID, int func, int addr )
 
 		for( int i = 0; i < num; ++i )
 		{
-			int data = is16Bit ? dest16[i] : dest[i];
+			int data = response.regs.value( i );
 
 			qs_num += QString().sprintf( b_hex ? "0x%04x" : "%d", data);
 		}
@@ -234,9 +190,9 @@ QString BatchProcessor::sendModbusRequest( int slaveID, int func, int addr )
 		{
 			if(
 #ifdef WIN32
-					errno == WSAETIMEDOUT ||
+					response.error == WSAETIMEDOUT ||
 #endif
-					errno == EIO
+					response.error == EIO
 																	)
 			{
 				QMessageBox::critical( this, tr( "I/O error" ),
@@ -247,7 +203,7 @@ QString BatchProcessor::sendModbusRequest( int slaveID, int func, int addr )
 				QMessageBox::critical( this, tr( "Protocol error" ),
 					tr( "Slave threw exception \"%1\" or "
 						"function not implemented." ).
-								arg( modbus_strerror( errno ) ) );
+								arg( modbus_strerror( response.error ) ) );
 			}
 		}
 		else
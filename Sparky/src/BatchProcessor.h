@@ -30,6 +30,7 @@
 #include <QDialog>
 
 #include "modbus.h"
+#include "LoopWorker.h"
 
 
 namespace Ui
@@ -41,7 +42,7 @@ class BatchProcessor : public QDialog
 {
 	Q_OBJECT
 public:
-	BatchProcessor( QWidget *parent, modbus_t *modbus );
+	BatchProcessor( QWidget *parent, LoopWorker *worker );
 	~BatchProcessor();
 
 
@@ -56,7 +57,7 @@ private:
 	QString sendModbusRequest( int slaveID, int func, int addr );
 
 	Ui::BatchProcessor *ui;
-	modbus_t *m_modbus;
+	LoopWorker *m_worker;
 	QTimer m_timer;
 	QFile m_outputFile;
 
@@ -0,0 +1,416 @@
+/*
+ * BusMonitorModel.cpp - implementation of BusMonitorModel and RawDataModel classes
+ *
+ * Entries arriving from the loops are only queued. A single-shot timer
+ * moves them into the ring and tells the views with one remove and one
+ * insert notification per batch, whatever the traffic.
+ */
+
+#include <QBrush>
+
+#include <string.h>
+
+#include "BusMonitorModel.h"
+
+
+
+BusMonitorModel::BusMonitorModel( QObject * parent ) :
+	QAbstractTableModel( parent ),
+	m_frames( BUS_MONITOR_FRAMES ),
+	m_pending(),
+	m_flushTimer()
+{
+	m_flushTimer.setSingleShot( true );
+	m_flushTimer.setInterval( BUS_MONITOR_FLUSH_INTERVAL );
+	connect( &m_flushTimer, SIGNAL( timeout() ), this, SLOT( flush() ) );
+}
+
+
+
+void BusMonitorModel::addFrame( const BUS_MONITOR_FRAME & frame )
+{
+	m_pending.append( frame );
+
+	if( !m_flushTimer.isActive() )
+	{
+		m_flushTimer.start();
+	}
+}
+
+
+
+void BusMonitorModel::clear()
+{
+	beginResetModel();
+	m_frames.clear();
+	m_pending.clear();
+	endResetModel();
+}
+
+
+
+void BusMonitorModel::flush()
+{
+	if( m_pending.isEmpty() )
+	{
+		return;
+	}
+
+	// more than a ring full in one batch, only the newest ones are kept
+	if( m_pending.size() > m_frames.capacity() )
+	{
+		m_pending.remove( 0, m_pending.size() - m_frames.capacity() );
+	}
+
+	const int drop = qMax( 0, m_frames.size() + m_pending.size() - m_frames.capacity() );
+	if( drop > 0 )
+	{
+		beginRemoveRows( QModelIndex(), 0, drop-1 );
+		for( int i = 0; i < drop; ++i )
+		{
+			m_frames.popFirst();
+		}
+		endRemoveRows();
+	}
+
+	beginInsertRows( QModelIndex(), m_frames.size(), m_frames.size() + m_pending.size() - 1 );
+	for( int i = 0; i < m_pending.size(); ++i )
+	{
+		m_frames.push( m_pending[i] );
+	}
+	endInsertRows();
+
+	m_pending.clear();
+}
+
+
+
+int BusMonitorModel::rowCount( const QModelIndex & parent ) const
+{
+	return parent.isValid() ? 0 : m_frames.size();
+}
+
+
+
+int BusMonitorModel::columnCount( const QModelIndex & parent ) const
+{
+	return parent.isValid() ? 0 : ColumnCount;
+}
+
+
+
+QVariant BusMonitorModel::data( const QModelIndex & index, int role ) const
+{
+	if( !index.isValid() || index.row() >= m_frames.size() )
+	{
+		return QVariant();
+	}
+
+	const BUS_MONITOR_FRAME & frame = m_frames.at( index.row() );
+	const bool isException = frame.func > 127;
+
+	if( role == Qt::ForegroundRole )
+	{
+		if( ( index.column() == FuncColumn && isException ) ||
+			( index.column() == CrcColumn && !isException && frame.expectedCRC != frame.actualCRC ) )
+		{
+			return QBrush( Qt::red );
+		}
+		return QVariant();
+	}
+
+	if( role != Qt::DisplayRole )
+	{
+		return QVariant();
+	}
+
+	switch( index.column() )
+	{
+		case IoColumn:
+			return frame.isRequest ? tr( "Req >>" ) : tr( "<< Resp" );
+		case SlaveColumn:
+			return QString::number( frame.slave );
+		case FuncColumn:
+			return isException ? tr( "Exception (%1)" ).arg( frame.func-128 ) : QString::number( frame.func );
+		case AddrColumn:
+			return isException ? QString() : QString::number( frame.addr );
+		case NumColumn:
+			return isException ? QString() : QString::number( frame.num );
+		case CrcColumn:
+			if( isException )
+			{
+				return QString();
+			}
+			if( frame.expectedCRC == frame.actualCRC )
+			{
+				return QString( "%1" ).arg( frame.actualCRC, 4, 16, QChar( '0' ) );
+			}
+			return QString( "%1 (%2)" ).arg( frame.actualCRC, 4, 16, QChar( '0' ) )
+										.arg( frame.expectedCRC, 4, 16, QChar( '0' ) );
+		default:
+			break;
+	}
+
+	return QVariant();
+}
+
+
+
+QVariant BusMonitorModel::headerData( int section, Qt::Orientation orientation, int role ) const
+{
+	if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+	{
+		return QAbstractTableModel::headerData( section, orientation, role );
+	}
+
+	switch( section )
+	{
+		case IoColumn:		return tr( "I/O" );
+		case SlaveColumn:	return tr( "Slave ID" );
+		case FuncColumn:	return tr( "Function code" );
+		case AddrColumn:	return tr( "Start address" );
+		case NumColumn:		return tr( "Byte(s)" );
+		case CrcColumn:		return tr( "CRC" );
+		default:			break;
+	}
+
+	return QVariant();
+}
+
+
+
+
+RawDataModel::RawDataModel( QObject * parent ) :
+	QAbstractListModel( parent ),
+	m_bytes( BUS_MONITOR_RAW_BYTES, 0 ),
+	m_written( 0 ),
+	m_lines( BUS_MONITOR_RAW_LINES ),
+	m_pending(),
+	m_pendingNewlines(),
+	m_flushTimer()
+{
+	m_flushTimer.setSingleShot( true );
+	m_flushTimer.setInterval( BUS_MONITOR_FLUSH_INTERVAL );
+	connect( &m_flushTimer, SIGNAL( timeout() ), this, SLOT( flush() ) );
+}
+
+
+
+void RawDataModel::addData( const QByteArray & data, bool addNewline )
+{
+	if( data.isEmpty() )
+	{
+		return;
+	}
+
+	m_pending.append( data );
+	if( addNewline )
+	{
+		m_pendingNewlines.append( m_pending.size() );
+	}
+
+	if( !m_flushTimer.isActive() )
+	{
+		m_flushTimer.start();
+	}
+}
+
+
+
+void RawDataModel::clear()
+{
+	beginResetModel();
+	m_lines.clear();
+	m_pending.clear();
+	m_pendingNewlines.clear();
+	endResetModel();
+}
+
+
+
+void RawDataModel::flush()
+{
+	const int size = m_pending.size();
+
+	if( size == 0 )
+	{
+		return;
+	}
+
+	// lay the pending bytes out in lines, the first ones may complete the
+	// line left open by the previous batch
+	const int oldCount = m_lines.size();
+	bool isOpen = oldCount > 0 && !m_lines.last().complete;
+	bool isOld = isOpen;
+	RAW_LINE line;
+	RAW_LINE oldLine;
+	bool oldChanged = false;
+	QVector<RAW_LINE> added;
+	int newline = 0;
+
+	if( isOpen )
+	{
+		line = m_lines.last();
+	}
+
+	for( int i = 0; i <= size; ++i )
+	{
+		while( newline < m_pendingNewlines.size() && m_pendingNewlines[newline] == i )
+		{
+			if( isOpen )
+			{
+				line.complete = true;
+			}
+			++newline;
+		}
+
+		if( isOpen && ( line.complete || i == size ) )
+		{
+			if( isOld ) { oldLine = line; oldChanged = true; isOld = false; }
+			else added.append( line );
+			isOpen = false;
+		}
+
+		if( i == size )
+		{
+			break;
+		}
+
+		if( !isOpen )
+		{
+			line.start = m_written + i;
+			line.length = 0;
+			line.complete = false;
+			isOpen = true;
+		}
+
+		if( ++line.length == BUS_MONITOR_RAW_LINE_MAX )
+		{
+			line.complete = true;
+		}
+
+		if( line.complete )
+		{
+			if( isOld ) { oldLine = line; oldChanged = true; isOld = false; }
+			else added.append( line );
+			isOpen = false;
+		}
+	}
+
+	// lines whose bytes get overwritten or that do not fit go first
+	const qint64 written = m_written + size;
+	const qint64 oldest = written - m_bytes.size();
+	const int total = oldCount + added.size();
+	int drop = 0;
+
+	while( drop < total &&
+		   ( total - drop > m_lines.capacity() ||
+			 ( drop < oldCount ? m_lines.at( drop ).start : added[drop-oldCount].start ) < oldest ) )
+	{
+		++drop;
+	}
+
+	const bool reset = drop >= oldCount && oldCount > 0;
+
+	if( reset )
+	{
+		beginResetModel();
+		m_lines.clear();
+	}
+	else if( drop > 0 )
+	{
+		beginRemoveRows( QModelIndex(), 0, drop-1 );
+		for( int i = 0; i < drop; ++i )
+		{
+			m_lines.popFirst();
+		}
+		endRemoveRows();
+	}
+
+	// copy the bytes in, in at most two pieces
+	const char * src = m_pending.constData();
+	int remaining = size;
+	qint64 pos = m_written;
+
+	if( remaining > m_bytes.size() )
+	{
+		src += remaining - m_bytes.size();
+		pos += remaining - m_bytes.size();
+		remaining = m_bytes.size();
+	}
+
+	while( remaining > 0 )
+	{
+		const int offset = pos % m_bytes.size();
+		const int chunk = qMin( remaining, m_bytes.size() - offset );
+		memcpy( m_bytes.data() + offset, src, chunk );
+		src += chunk;
+		pos += chunk;
+		remaining -= chunk;
+	}
+	m_written = written;
+
+	m_pending.clear();
+	m_pendingNewlines.clear();
+
+	if( reset )
+	{
+		for( int i = drop - oldCount; i < added.size(); ++i )
+		{
+			m_lines.push( added[i] );
+		}
+		endResetModel();
+		return;
+	}
+
+	if( oldChanged )
+	{
+		m_lines.last() = oldLine;
+		const QModelIndex changed = index( m_lines.size()-1 );
+		emit dataChanged( changed, changed );
+	}
+
+	const int first = qMax( 0, drop - oldCount );
+	if( first < added.size() )
+	{
+		beginInsertRows( QModelIndex(), m_lines.size(), m_lines.size() + added.size() - first - 1 );
+		for( int i = first; i < added.size(); ++i )
+		{
+			m_lines.push( added[i] );
+		}
+		endInsertRows();
+	}
+}
+
+
+
+int RawDataModel::rowCount( const QModelIndex & parent ) const
+{
+	return parent.isValid() ? 0 : m_lines.size();
+}
+
+
+
+// hex text is only built for the rows the view paints
+QVariant RawDataModel::data( const QModelIndex & index, int role ) const
+{
+	static const char hex[] = "0123456789abcdef";
+
+	if( !index.isValid() || index.row() >= m_lines.size() || role != Qt::DisplayRole )
+	{
+		return QVariant();
+	}
+
+	const RAW_LINE & line = m_lines.at( index.row() );
+	QString text( line.length * 3, QChar( ' ' ) );
+	QChar * out = text.data();
+
+	for( int i = 0; i < line.length; ++i )
+	{
+		const uchar byte = m_bytes.at( ( line.start + i ) % m_bytes.size() );
+		out[i*3] = QLatin1Char( hex[byte >> 4] );
+		out[i*3+1] = QLatin1Char( hex[byte & 0xf] );
+	}
+
+	return text;
+}
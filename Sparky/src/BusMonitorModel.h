@@ -0,0 +1,156 @@
+/*
+ * BusMonitorModel.h - header file for BusMonitorModel and RawDataModel classes
+ *
+ * Both monitors keep a fixed number of entries in a ring, the oldest ones
+ * fall out as new ones come in, so an overnight run needs no more memory
+ * than a short one. New entries are handed to the views in batches a few
+ * times a second and text is only rendered for the rows being painted.
+ */
+
+#ifndef _BUS_MONITOR_MODEL_H
+#define _BUS_MONITOR_MODEL_H
+
+#include <QAbstractTableModel>
+#include <QAbstractListModel>
+#include <QVector>
+#include <QByteArray>
+#include <QTimer>
+
+#define BUS_MONITOR_FRAMES          10000   // request/response rows kept
+#define BUS_MONITOR_RAW_BYTES       (256*1024)
+#define BUS_MONITOR_RAW_LINES       10000
+#define BUS_MONITOR_RAW_LINE_MAX    512     // a line without newline is cut here
+#define BUS_MONITOR_FLUSH_INTERVAL  50      // ms, views are updated at 20 Hz at most
+
+
+/// fixed capacity FIFO, pushing into a full ring drops the oldest entry
+template <typename T>
+class RingBuffer
+{
+public:
+	RingBuffer( int capacity ) : m_items( capacity ), m_first( 0 ), m_count( 0 ) { }
+
+	int capacity() const { return m_items.size(); }
+	int size() const { return m_count; }
+	bool isEmpty() const { return m_count == 0; }
+
+	const T & at( int i ) const { return m_items[( m_first + i ) % m_items.size()]; }
+	T & operator[]( int i ) { return m_items[( m_first + i ) % m_items.size()]; }
+	T & last() { return ( *this )[m_count-1]; }
+
+	void push( const T & item )
+	{
+		if( m_count == m_items.size() )
+		{
+			popFirst();
+		}
+		m_items[( m_first + m_count ) % m_items.size()] = item;
+		++m_count;
+	}
+
+	void popFirst()
+	{
+		m_first = ( m_first + 1 ) % m_items.size();
+		--m_count;
+	}
+
+	void clear() { m_first = 0; m_count = 0; }
+
+
+private:
+	QVector<T> m_items;
+	int m_first;
+	int m_count;
+
+} ;
+
+
+typedef struct bus_monitor_frame
+{
+    bool isRequest;
+    quint8 func;
+    quint16 slave;
+    quint16 addr;
+    quint16 num;
+    quint16 expectedCRC;
+    quint16 actualCRC;
+
+} BUS_MONITOR_FRAME;
+
+
+class BusMonitorModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	enum Columns
+	{
+		IoColumn,
+		SlaveColumn,
+		FuncColumn,
+		AddrColumn,
+		NumColumn,
+		CrcColumn,
+		ColumnCount
+	} ;
+
+	BusMonitorModel( QObject * parent = 0 );
+
+	void addFrame( const BUS_MONITOR_FRAME & frame );
+	void clear();
+
+	int rowCount( const QModelIndex & parent = QModelIndex() ) const;
+	int columnCount( const QModelIndex & parent = QModelIndex() ) const;
+	QVariant data( const QModelIndex & index, int role = Qt::DisplayRole ) const;
+	QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const;
+
+
+public slots:
+	void flush();
+
+
+private:
+	RingBuffer<BUS_MONITOR_FRAME> m_frames;
+	QVector<BUS_MONITOR_FRAME> m_pending;
+	QTimer m_flushTimer;
+
+} ;
+
+
+/// raw bytes seen on the bus, one row per frame, shown in hex
+class RawDataModel : public QAbstractListModel
+{
+	Q_OBJECT
+public:
+	RawDataModel( QObject * parent = 0 );
+
+	void addData( const QByteArray & data, bool addNewline );
+	void clear();
+
+	int rowCount( const QModelIndex & parent = QModelIndex() ) const;
+	QVariant data( const QModelIndex & index, int role = Qt::DisplayRole ) const;
+
+
+public slots:
+	void flush();
+
+
+private:
+	typedef struct raw_line
+	{
+		qint64 start;           // position of the first byte in the stream
+		int length;
+		bool complete;          // a newline was seen
+
+	} RAW_LINE;
+
+	QByteArray m_bytes;         // ring of the last BUS_MONITOR_RAW_BYTES bytes
+	qint64 m_written;           // bytes ever written to the ring
+	RingBuffer<RAW_LINE> m_lines;
+	QByteArray m_pending;
+	QVector<int> m_pendingNewlines; // offsets in m_pending that end a line
+	QTimer m_flushTimer;
+
+} ;
+
+
+#endif // _BUS_MONITOR_MODEL_H
@@ -0,0 +1,251 @@
+/*
+ * CalibrationOrchestrator.cpp - implementation of CalibrationOrchestrator class
+ *
+ * Every tick queues one block read per running pipe on the worker of its
+ * loop. A pipe whose previous read has not come back yet is skipped for
+ * that tick, so a slow slave never piles up requests on its bus.
+ */
+
+#include <QTextStream>
+
+#include "CalibrationOrchestrator.h"
+
+
+// the run moves on to the next stage file once the meter is this warm
+static const float STAGE_TEMPERATURE[] = { 20.0f, 55.0f };
+
+
+CalibrationOrchestrator::CalibrationOrchestrator( LoopWorker * workers[CALIBRATION_LOOPS], QObject * parent ) :
+	QObject( parent ),
+	m_timer()
+{
+	for( int i = 0; i < CALIBRATION_LOOPS; ++i )
+	{
+		m_workers[i] = workers[i];
+		connect( m_workers[i], SIGNAL( responded( LOOP_RESPONSE ) ),
+					this, SLOT( onResponse( LOOP_RESPONSE ) ), Qt::QueuedConnection );
+	}
+
+	for( int i = 0; i < CALIBRATION_PIPES; ++i )
+	{
+		m_pipes[i].running = false;
+		m_pipes[i].pendingId = 0;
+	}
+
+	m_timer.setInterval( CALIBRATION_INTERVAL );
+	connect( &m_timer, SIGNAL( timeout() ), this, SLOT( tick() ) );
+}
+
+
+
+
+CalibrationOrchestrator::~CalibrationOrchestrator()
+{
+	for( int i = 0; i < CALIBRATION_PIPES; ++i )
+	{
+		stop( i );
+	}
+}
+
+
+
+bool CalibrationOrchestrator::start( int pipe, int slave, const QStringList & stageFiles,
+									int regWatercut, int regTemperature, int regFrequency, int regOilRp )
+{
+	if( pipe < 0 || pipe >= CALIBRATION_PIPES || stageFiles.isEmpty() )
+	{
+		return false;
+	}
+
+	stop( pipe );
+
+	CALIBRATION_PIPE & p = m_pipes[pipe];
+
+	p.slave = slave;
+	p.regWatercut = regWatercut;
+	p.regTemperature = regTemperature;
+	p.regFrequency = regFrequency;
+	p.regOilRp = regOilRp;
+	p.stageFiles = stageFiles;
+	p.samples = 0;
+	p.overruns = 0;
+
+	// one read covers all four floats, the registers in between come along
+	p.addr = qMin( qMin( regWatercut, regTemperature ), qMin( regFrequency, regOilRp ) );
+	p.count = qMax( qMax( regWatercut, regTemperature ), qMax( regFrequency, regOilRp ) ) + 2 - p.addr;
+
+	if( p.count > MODBUS_MAX_READ_REGISTERS || !openStageFile( p, 0 ) )
+	{
+		return false;
+	}
+
+	p.runTime.start();
+	p.running = true;
+
+	if( !m_timer.isActive() )
+	{
+		m_timer.start();
+	}
+
+	// first sample right away instead of one interval later
+	tick();
+
+	return true;
+}
+
+
+
+void CalibrationOrchestrator::stop( int pipe )
+{
+	if( pipe < 0 || pipe >= CALIBRATION_PIPES )
+	{
+		return;
+	}
+
+	CALIBRATION_PIPE & p = m_pipes[pipe];
+
+	p.running = false;
+	p.pendingId = 0;
+	p.file.close();
+
+	for( int i = 0; i < CALIBRATION_PIPES; ++i )
+	{
+		if( m_pipes[i].running )
+		{
+			return;
+		}
+	}
+
+	m_timer.stop();
+}
+
+
+
+bool CalibrationOrchestrator::isRunning( int pipe ) const
+{
+	return pipe >= 0 && pipe < CALIBRATION_PIPES && m_pipes[pipe].running;
+}
+
+
+
+void CalibrationOrchestrator::setInterval( int msec )
+{
+	m_timer.setInterval( msec );
+}
+
+
+
+void CalibrationOrchestrator::tick()
+{
+	for( int i = 0; i < CALIBRATION_PIPES; ++i )
+	{
+		CALIBRATION_PIPE & p = m_pipes[i];
+
+		if( !p.running )
+		{
+			continue;
+		}
+
+		if( p.pendingId )
+		{
+			++p.overruns;
+			continue;
+		}
+
+		LOOP_REQUEST request = LoopWorker::readRequest( p.slave, MODBUS_FC_READ_INPUT_REGISTERS,
+												p.addr-1, p.count, LoopWorker::RawValue );
+		request.repeated = true;
+		p.pendingId = m_workers[i/CALIBRATION_PIPES_PER_LOOP]->submit( request );
+	}
+}
+
+
+
+void CalibrationOrchestrator::onResponse( const LOOP_RESPONSE & response )
+{
+	const int first = response.loop * CALIBRATION_PIPES_PER_LOOP;
+
+	for( int i = first; i < first + CALIBRATION_PIPES_PER_LOOP && i < CALIBRATION_PIPES; ++i )
+	{
+		CALIBRATION_PIPE & p = m_pipes[i];
+
+		if( !p.running || p.pendingId != response.id )
+		{
+			continue;
+		}
+
+		p.pendingId = 0;
+
+		if( response.ret != p.count )
+		{
+			emit failed( i, response.ret, response.error );
+			return;
+		}
+
+		const QVector<quint16> & regs = response.regs;
+		float values[4];
+		const int addrs[4] = { p.regWatercut, p.regTemperature, p.regFrequency, p.regOilRp };
+
+		for( int v = 0; v < 4; ++v )
+		{
+			values[v] = modbus_get_float_ordered( regs.constData() + addrs[v] - p.addr, DEVICE_FLOAT_ORDER );
+		}
+
+		writeSample( p, values[0], values[1], values[2], values[3] );
+
+		emit sampled( i, values[0], values[1], values[2], values[3] );
+		return;
+	}
+}
+
+
+
+void CalibrationOrchestrator::writeSample( CALIBRATION_PIPE & pipe, float watercut, float temperature, float frequency, float oilRp )
+{
+	// heating ends at 55 C, the last stage then records the cool down
+	int stage = pipe.stage;
+	while( stage < 2 && temperature >= STAGE_TEMPERATURE[stage] )
+	{
+		++stage;
+	}
+
+	if( stage != pipe.stage && stage < pipe.stageFiles.size() )
+	{
+		openStageFile( pipe, stage );
+	}
+
+	if( !pipe.file.isOpen() )
+	{
+		return;
+	}
+
+	// columns follow the ===== rulers of the file header, the ones the
+	// meter does not report are left blank
+	QTextStream stream( &pipe.file );
+	stream << QString( "%1 %2 %3 %4 %5 %6 %7 %8 %9" )
+				.arg( pipe.runTime.elapsed() / 1000.0, 9, 'f', 1 )
+				.arg( watercut, 7, 'f', 2 )
+				.arg( QString(), 4 )
+				.arg( QString(), 4 )
+				.arg( QString(), 7 )
+				.arg( frequency, 9, 'f', 3 )
+				.arg( QString(), 8 )
+				.arg( oilRp, 9, 'f', 3 )
+				.arg( temperature, 11, 'f', 2 )
+			<< '\n';
+	stream.flush();
+
+	++pipe.samples;
+}
+
+
+
+bool CalibrationOrchestrator::openStageFile( CALIBRATION_PIPE & pipe, int stage )
+{
+	pipe.file.close();
+	pipe.stage = stage;
+	pipe.file.setFileName( pipe.stageFiles.value( stage ) );
+
+	// the header was written by createLoopFiles()
+	return pipe.file.open( QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text );
+}
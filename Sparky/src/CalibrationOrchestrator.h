@@ -0,0 +1,83 @@
+/*
+ * CalibrationOrchestrator.h - header file for CalibrationOrchestrator class
+ *
+ * Samples every running pipe of the six loops once per interval. Each
+ * loop is its own bus served by its own LoopWorker, so the loops are
+ * sampled concurrently while the (up to three) slaves sharing a bus are
+ * interleaved on it.
+ */
+
+#ifndef _CALIBRATION_ORCHESTRATOR_H
+#define _CALIBRATION_ORCHESTRATOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include "LoopWorker.h"
+
+#define CALIBRATION_LOOPS           6
+#define CALIBRATION_PIPES_PER_LOOP  3
+#define CALIBRATION_PIPES           (CALIBRATION_LOOPS*CALIBRATION_PIPES_PER_LOOP)
+#define CALIBRATION_INTERVAL        1000    // ms, every pipe is sampled at 1 Hz
+
+
+typedef struct calibration_pipe
+{
+    bool running;
+    int slave;
+    int pendingId;              // request on the bus, 0 when idle
+    int addr;                   // 1-based first register of the sample block
+    int count;                  // registers in the sample block
+    int regWatercut;            // 1-based float registers sampled
+    int regTemperature;
+    int regFrequency;
+    int regOilRp;
+    int stage;                  // index into stageFiles
+    QStringList stageFiles;     // AMB_020, 020_055, 055_038
+    QFile file;
+    QElapsedTimer runTime;
+    int samples;
+    int overruns;               // ticks skipped because the bus was still busy
+
+} CALIBRATION_PIPE;
+
+
+class CalibrationOrchestrator : public QObject
+{
+	Q_OBJECT
+public:
+	CalibrationOrchestrator( LoopWorker * workers[CALIBRATION_LOOPS], QObject * parent = 0 );
+	~CalibrationOrchestrator();
+
+	bool start( int pipe, int slave, const QStringList & stageFiles,
+				int regWatercut, int regTemperature, int regFrequency, int regOilRp );
+	void stop( int pipe );
+	bool isRunning( int pipe ) const;
+	void setInterval( int msec );
+
+
+signals:
+	void sampled( int pipe, float watercut, float temperature, float frequency, float oilRp );
+	void failed( int pipe, int ret, int error );
+
+
+private slots:
+	void tick();
+	void onResponse( const LOOP_RESPONSE & response );
+
+
+private:
+	void writeSample( CALIBRATION_PIPE & pipe, float watercut, float temperature, float frequency, float oilRp );
+	bool openStageFile( CALIBRATION_PIPE & pipe, int stage );
+
+	LoopWorker * m_workers[CALIBRATION_LOOPS];
+	CALIBRATION_PIPE m_pipes[CALIBRATION_PIPES];
+	QTimer m_timer;
+
+} ;
+
+
+#endif // _CALIBRATION_ORCHESTRATOR_H
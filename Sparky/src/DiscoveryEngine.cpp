@@ -0,0 +1,217 @@
+/*
+ * DiscoveryEngine.cpp - implementation of DiscoveryEngine class
+ *
+ * A loop has one request on its bus at a time: the probe of the next
+ * address, or the next identity block of an analyzer that answered. Other
+ * traffic of the loop (gauges, calibrations) keeps its turn in between and
+ * a scan can be stopped at any address.
+ */
+
+#include <QtNumeric>
+
+#include "DiscoveryEngine.h"
+
+
+
+DiscoveryEngine::DiscoveryEngine( LoopWorker * workers[DISCOVERY_LOOPS], QObject * parent ) :
+	QObject( parent )
+{
+	for( int i = 0; i < DISCOVERY_LOOPS; ++i )
+	{
+		m_workers[i] = workers[i];
+		connect( m_workers[i], SIGNAL( responded( LOOP_RESPONSE ) ),
+					this, SLOT( onResponse( LOOP_RESPONSE ) ), Qt::QueuedConnection );
+
+		m_loops[i].running = false;
+		m_loops[i].pendingId = 0;
+	}
+}
+
+
+
+// regs are the float registers, in DiscoveryValue order
+bool DiscoveryEngine::start( int loop, const REGISTER_DEF * const regs[DiscoveryValues], int firstSlave, int lastSlave )
+{
+	if( loop < 0 || loop >= DISCOVERY_LOOPS || !m_workers[loop]->isConfigured() || firstSlave > lastSlave )
+	{
+		return false;
+	}
+
+	stop( loop );
+
+	DISCOVERY_LOOP & l = m_loops[loop];
+
+	for( int i = 0; i < DiscoveryValues; ++i )
+	{
+		l.regs[i] = regs[i];
+	}
+
+	// the first block holds the serial number and doubles as the probe
+	l.blocks.clear();
+	foreach( const REGISTER_SPAN & span, RegisterMap::planReads( regs, DiscoveryValues ) )
+	{
+		l.blocks.append( LoopWorker::readRequest( 0, MODBUS_FC_READ_INPUT_REGISTERS,
+												span.addr - 1, span.num, LoopWorker::RawValue ) );
+	}
+
+	l.nextSlave = firstSlave;
+	l.lastSlave = lastSlave;
+	l.found = 0;
+	l.block = 0;
+	l.running = true;
+	l.runTime.start();
+
+	submitBlock( loop );
+
+	return true;
+}
+
+
+
+void DiscoveryEngine::stop( int loop )
+{
+	if( loop < 0 || loop >= DISCOVERY_LOOPS )
+	{
+		return;
+	}
+
+	// a request already queued still goes out, its answer is ignored
+	m_loops[loop].running = false;
+	m_loops[loop].pendingId = 0;
+}
+
+
+
+bool DiscoveryEngine::isRunning( int loop ) const
+{
+	return loop >= 0 && loop < DISCOVERY_LOOPS && m_loops[loop].running;
+}
+
+
+
+bool DiscoveryEngine::isRunning() const
+{
+	for( int i = 0; i < DISCOVERY_LOOPS; ++i )
+	{
+		if( m_loops[i].running )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+
+void DiscoveryEngine::submitBlock( int loop )
+{
+	DISCOVERY_LOOP & l = m_loops[loop];
+	LOOP_REQUEST request = l.blocks[l.block];
+
+	request.slave = l.nextSlave;
+
+	if( l.block == 0 )
+	{
+		// an empty address only costs the short wait
+		request.timeout = DISCOVERY_PROBE_TIMEOUT;
+
+		l.device.loop = loop;
+		l.device.slave = l.nextSlave;
+		l.device.serial = 0;
+		for( int i = 0; i < DiscoveryValues; ++i )
+		{
+			l.device.values[i] = qQNaN();
+		}
+
+		emit progress( loop, l.nextSlave );
+	}
+
+	l.pendingId = m_workers[loop]->submit( request );
+}
+
+
+
+void DiscoveryEngine::finish( int loop )
+{
+	DISCOVERY_LOOP & l = m_loops[loop];
+
+	l.running = false;
+	l.pendingId = 0;
+
+	emit finished( loop, l.found, l.runTime.elapsed() );
+}
+
+
+
+void DiscoveryEngine::onResponse( const LOOP_RESPONSE & response )
+{
+	if( response.loop < 0 || response.loop >= DISCOVERY_LOOPS )
+	{
+		return;
+	}
+
+	DISCOVERY_LOOP & l = m_loops[response.loop];
+
+	if( !l.running || l.pendingId != response.id )
+	{
+		return;
+	}
+
+	l.pendingId = 0;
+
+	if( response.ret == response.num )
+	{
+		for( int i = 0; i < DiscoveryValues; ++i )
+		{
+			const int offset = l.regs[i]->addr - 1 - response.addr;
+
+			if( offset >= 0 && offset + 1 < response.regs.size() )
+			{
+				l.device.values[i] = l.regs[i]->scale *
+						modbus_get_float_ordered( response.regs.constData() + offset, l.regs[i]->order );
+			}
+		}
+	}
+
+	// nothing at this address: the probe timed out or came back garbled;
+	// an exception (illegal address, busy...) still means a slave is there
+	const bool isException = response.error >= EMBXILFUN && response.error <= EMBXGTAR;
+	if( l.block == 0 && response.ret != response.num && !isException )
+	{
+		if( ++l.nextSlave > l.lastSlave )
+		{
+			finish( response.loop );
+			return;
+		}
+
+		submitBlock( response.loop );
+		return;
+	}
+
+	// the rest of the identity of an analyzer that answered, what it fails
+	// to give is left NaN
+	if( ++l.block < l.blocks.size() )
+	{
+		submitBlock( response.loop );
+		return;
+	}
+
+	const float serial = l.device.values[DiscoverySerial];
+	if( qIsFinite( serial ) && serial > 0 && serial < 2147483647.0f )
+	{
+		l.device.serial = qRound( serial );
+	}
+
+	++l.found;
+	emit found( l.device );
+
+	l.block = 0;
+	if( ++l.nextSlave > l.lastSlave )
+	{
+		finish( response.loop );
+		return;
+	}
+
+	submitBlock( response.loop );
+}
@@ -0,0 +1,96 @@
+/*
+ * DiscoveryEngine.h - header file for DiscoveryEngine class
+ *
+ * Finds the analyzers on the six loops. Each loop is its own bus served by
+ * its own LoopWorker, so the loops are scanned concurrently. An address is
+ * probed with the first identity read itself and given little time to
+ * answer, so the empty ones go by quickly.
+ */
+
+#ifndef _DISCOVERY_ENGINE_H
+#define _DISCOVERY_ENGINE_H
+
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "LoopWorker.h"
+#include "RegisterMap.h"
+
+#define DISCOVERY_LOOPS             6
+#define DISCOVERY_FIRST_SLAVE       1
+#define DISCOVERY_LAST_SLAVE        99      // higher addresses are serial numbers (extended address)
+#define DISCOVERY_PROBE_TIMEOUT     50      // ms for an address to start answering
+
+
+enum DiscoveryValue
+{
+	DiscoverySerial,
+	DiscoveryFirmware,
+	DiscoveryHardware,
+	DiscoveryModel0,
+	DiscoveryModel1,
+	DiscoveryModel2,
+	DiscoveryModel3,
+	DiscoveryValues
+} ;
+
+typedef struct discovery_device
+{
+    int loop;
+    int slave;                  // address the analyzer answered on
+    int serial;                 // 0 when it could not be read
+    float values[DiscoveryValues];  // NaN when not read
+
+} DISCOVERY_DEVICE;
+
+typedef struct discovery_loop
+{
+    bool running;
+    const REGISTER_DEF * regs[DiscoveryValues]; // float registers read
+    QVector<LOOP_REQUEST> blocks;   // reads covering them, the first one probes
+    int nextSlave;
+    int lastSlave;
+    int pendingId;              // request on the bus, 0 when idle
+    int block;                  // index into blocks
+    DISCOVERY_DEVICE device;    // the one being read
+    int found;
+    QElapsedTimer runTime;
+
+} DISCOVERY_LOOP;
+
+
+class DiscoveryEngine : public QObject
+{
+	Q_OBJECT
+public:
+	DiscoveryEngine( LoopWorker * workers[DISCOVERY_LOOPS], QObject * parent = 0 );
+
+	bool start( int loop, const REGISTER_DEF * const regs[DiscoveryValues],
+				int firstSlave = DISCOVERY_FIRST_SLAVE, int lastSlave = DISCOVERY_LAST_SLAVE );
+	void stop( int loop );
+	bool isRunning( int loop ) const;
+	bool isRunning() const;
+
+
+signals:
+	void found( const DISCOVERY_DEVICE & device );
+	void progress( int loop, int slave );
+	void finished( int loop, int found, int msecs );
+
+
+private slots:
+	void onResponse( const LOOP_RESPONSE & response );
+
+
+private:
+	void submitBlock( int loop );
+	void finish( int loop );
+
+	LoopWorker * m_workers[DISCOVERY_LOOPS];
+	DISCOVERY_LOOP m_loops[DISCOVERY_LOOPS];
+
+} ;
+
+
+#endif // _DISCOVERY_ENGINE_H
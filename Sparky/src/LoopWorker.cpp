@@ -0,0 +1,650 @@
+/*
+ * LoopWorker.cpp - implementation of LoopWorker class
+ *
+ * Requests are queued to the worker thread with submit() and answered by
+ * the responded() signal. execute() wraps both for sequential code such as
+ * the profile upload, keeping the GUI event loop running while it waits.
+ */
+
+#include <QMutexLocker>
+#include <QThread>
+
+#include <errno.h>
+#include <string.h>
+
+#include "LoopWorker.h"
+
+
+
+LoopWorker::LoopWorker( int loop ) :
+	QObject(),
+	m_loop( loop ),
+	m_modbus( NULL ),
+	m_mutex(),
+	m_nextId( 1 ),
+	m_opening( NULL ),
+	m_notifier( NULL ),
+	m_silenceTimer( NULL ),
+	m_pollTimer( NULL ),
+	m_t35( 0 ),
+	m_prepared(),
+	m_preparedClock( 0 )
+{
+	qRegisterMetaType<LOOP_REQUEST>( "LOOP_REQUEST" );
+	qRegisterMetaType<LOOP_RESPONSE>( "LOOP_RESPONSE" );
+
+	connect( this, SIGNAL( requested( LOOP_REQUEST ) ),
+				this, SLOT( process( LOOP_REQUEST ) ), Qt::QueuedConnection );
+}
+
+
+
+
+LoopWorker::~LoopWorker()
+{
+	clearPrepared();
+}
+
+
+
+// the context stays owned by MainWindow, the listener lets go of the
+// descriptor in the loop thread before this returns and the caller closes it
+void LoopWorker::setModbus( modbus_t * modbus )
+{
+	// being opened, it is attached as soon as the port is up
+	if( modbus != NULL && modbus == m_opening )
+	{
+		return;
+	}
+	m_opening = NULL;
+
+	if( QThread::currentThread() == thread() )
+	{
+		attach( modbus );
+	}
+	else
+	{
+		QMetaObject::invokeMethod( this, "attach", Qt::BlockingQueuedConnection, Q_ARG( void *, modbus ) );
+	}
+}
+
+
+
+// Opening a serial port can take its time (USB adapters, a missing
+// device), so the loop thread does it and the caller goes on at once. The
+// requests submitted meanwhile queue up behind it, opened() tells with the
+// id returned here how it went.
+int LoopWorker::open( modbus_t * modbus )
+{
+	const int id = m_nextId.fetchAndAddRelaxed( 1 );
+
+	m_opening = modbus;
+	QMetaObject::invokeMethod( this, "connectModbus", Qt::QueuedConnection,
+								Q_ARG( void *, modbus ), Q_ARG( int, id ) );
+
+	return id;
+}
+
+
+
+void LoopWorker::connectModbus( void * modbus, int id )
+{
+	modbus_t * ctx = static_cast<modbus_t *>( modbus );
+	const bool ok = modbus_connect( ctx ) != -1;
+	const int error = ok ? 0 : errno;
+
+	if( ok )
+	{
+		// timeouts follow how fast the analyzers on the loop answer
+		modbus_set_adaptive_timeout( ctx, TRUE );
+		// USB adapters hand the answers over at once instead of every 16 ms
+		modbus_rtu_set_low_latency( ctx, TRUE );
+	}
+
+	attach( ok ? ctx : NULL );
+
+	emit opened( m_loop, id, ok, error );
+}
+
+
+
+// runs in the loop thread, so never in the middle of a transaction
+void LoopWorker::attach( void * modbus )
+{
+	stopListening();
+
+	{
+		QMutexLocker locker( &m_mutex );
+
+		m_modbus = static_cast<modbus_t *>( modbus );
+		clearPrepared();
+	}
+
+	startListening();
+}
+
+
+
+bool LoopWorker::isConfigured()
+{
+	QMutexLocker locker( &m_mutex );
+
+	return m_modbus != NULL;
+}
+
+
+
+void LoopWorker::startListening()
+{
+	if( m_modbus == NULL )
+	{
+		return;
+	}
+
+	m_t35 = modbus_rtu_get_t35_time( m_modbus );
+
+#ifdef Q_OS_WIN
+	if( m_pollTimer == NULL )
+	{
+		m_pollTimer = new QTimer( this );
+		connect( m_pollTimer, SIGNAL( timeout() ), this, SLOT( onPollTimeout() ) );
+	}
+	m_pollTimer->start( LOOP_POLL_INTERVAL );
+#else
+	if( m_silenceTimer == NULL )
+	{
+		m_silenceTimer = new QTimer( this );
+		m_silenceTimer->setSingleShot( true );
+		m_silenceTimer->setTimerType( Qt::PreciseTimer );
+		connect( m_silenceTimer, SIGNAL( timeout() ), this, SLOT( endFrame() ) );
+	}
+
+	// woken up by the kernel when bytes arrive, idle lines cost nothing
+	m_notifier = new QSocketNotifier( modbus_get_socket( m_modbus ), QSocketNotifier::Read, this );
+	connect( m_notifier, SIGNAL( activated( int ) ), this, SLOT( onReadable() ) );
+#endif
+}
+
+
+
+void LoopWorker::stopListening()
+{
+	delete m_notifier;
+	m_notifier = NULL;
+
+	if( m_silenceTimer )
+	{
+		m_silenceTimer->stop();
+	}
+	if( m_pollTimer )
+	{
+		m_pollTimer->stop();
+	}
+
+	m_frame.clear();
+}
+
+
+
+// bytes of traffic this worker did not ask for, e.g. another master
+void LoopWorker::onReadable()
+{
+	uint8_t buf[MODBUS_RTU_MAX_ADU_LENGTH];
+	const int rc = modbus_rtu_monitor_read( m_modbus, buf, sizeof( buf ) );
+
+	if( rc < 0 )
+	{
+		const int error = errno;
+
+		// the port went away, a hung-up line would wake the notifier
+		// forever, the transactions leave it alone from now on as well
+		m_notifier->setEnabled( false );
+		m_notifier->deleteLater();
+		m_notifier = NULL;
+		m_frame.clear();
+
+		emit lost( m_loop, m_modbus, error );
+		return;
+	}
+
+	// woken up for bytes a transaction has taken meanwhile
+	if( rc == 0 )
+	{
+		return;
+	}
+
+	// a gap longer than t3.5 since the previous bytes ends the frame
+	if( !m_frame.isEmpty() && m_lastRead.nsecsElapsed() / 1000 > m_t35 )
+	{
+		endFrame();
+	}
+
+	m_frame.append( reinterpret_cast<const char *>( buf ), rc );
+	m_lastRead.start();
+
+	if( m_frame.size() >= MODBUS_RTU_MAX_ADU_LENGTH )
+	{
+		endFrame();
+	}
+	else
+	{
+		m_silenceTimer->start( qMax( 1, ( m_t35 + 999 ) / 1000 ) );
+	}
+}
+
+
+
+void LoopWorker::endFrame()
+{
+	if( m_silenceTimer )
+	{
+		m_silenceTimer->stop();
+	}
+
+	if( !m_frame.isEmpty() && m_modbus )
+	{
+		modbus_rtu_monitor_frame( m_modbus, reinterpret_cast<const uint8_t *>( m_frame.constData() ), m_frame.size() );
+	}
+
+	m_frame.clear();
+}
+
+
+
+void LoopWorker::onPollTimeout()
+{
+	QMutexLocker locker( &m_mutex );
+
+	if( m_modbus )
+	{
+		modbus_poll( m_modbus );
+	}
+}
+
+
+
+// the request of a repeated register read, built on its first use, so
+// polling the same block again only costs the write
+modbus_prepared_t * LoopWorker::preparedRead( const LOOP_REQUEST & request )
+{
+	int oldest = 0;
+
+	for( int i = 0; i < m_prepared.size(); ++i )
+	{
+		LOOP_PREPARED & p = m_prepared[i];
+
+		if( p.slave == request.slave && p.func == request.func &&
+			p.addr == request.addr && p.num == request.num )
+		{
+			p.lastUse = ++m_preparedClock;
+			return p.prep;
+		}
+
+		if( p.lastUse < m_prepared[oldest].lastUse )
+		{
+			oldest = i;
+		}
+	}
+
+	LOOP_PREPARED p;
+	p.slave = request.slave;
+	p.func = request.func;
+	p.addr = request.addr;
+	p.num = request.num;
+	p.lastUse = ++m_preparedClock;
+	p.prep = ( request.func == MODBUS_FC_READ_HOLDING_REGISTERS ) ?
+				modbus_prepare_read_registers( m_modbus, request.addr, request.num ) :
+				modbus_prepare_read_input_registers( m_modbus, request.addr, request.num );
+
+	if( p.prep == NULL )
+	{
+		return NULL;
+	}
+
+	if( m_prepared.size() < LOOP_PREPARED_READS )
+	{
+		m_prepared.append( p );
+	}
+	else
+	{
+		modbus_prepared_free( m_prepared[oldest].prep );
+		m_prepared[oldest] = p;
+	}
+
+	return p.prep;
+}
+
+
+
+void LoopWorker::clearPrepared()
+{
+	for( int i = 0; i < m_prepared.size(); ++i )
+	{
+		modbus_prepared_free( m_prepared[i].prep );
+	}
+
+	m_prepared.clear();
+	m_preparedClock = 0;
+}
+
+
+
+// lets a caller know the ids of its requests before any of them is answered
+int LoopWorker::reserveIds( int count )
+{
+	return m_nextId.fetchAndAddRelaxed( count );
+}
+
+
+
+// a request carrying a reserved id keeps it
+int LoopWorker::submit( LOOP_REQUEST request )
+{
+	if( request.id == 0 )
+	{
+		request.id = m_nextId.fetchAndAddRelaxed( 1 );
+	}
+
+	emit requested( request );
+
+	return request.id;
+}
+
+
+
+// the GUI keeps running meanwhile, the caller has to keep whatever could
+// start another transaction disabled until this returns
+LOOP_RESPONSE LoopWorker::execute( LOOP_REQUEST request )
+{
+	request.id = m_nextId.fetchAndAddRelaxed( 1 );
+
+	// connect before queueing so the response can not be missed
+	LoopWaiter waiter( request.id );
+	connect( this, SIGNAL( responded( LOOP_RESPONSE ) ),
+				&waiter, SLOT( onResponse( LOOP_RESPONSE ) ), Qt::QueuedConnection );
+
+	emit requested( request );
+
+	waiter.exec();
+
+	return waiter.response();
+}
+
+
+
+LOOP_REQUEST LoopWorker::readRequest( int slave, int func, int addr, int num, int valueType )
+{
+	LOOP_REQUEST request;
+
+	request.id = 0;
+	request.slave = slave;
+	request.func = func;
+	request.addr = addr;
+	request.num = num;
+	request.valueType = valueType;
+	request.timeout = 0;
+	request.repeated = false;
+
+	return request;
+}
+
+
+
+LOOP_REQUEST LoopWorker::writeRequest( int slave, int func, int addr, const QVector<quint16> & data )
+{
+	LOOP_REQUEST request = readRequest( slave, func, addr, data.size(), RawValue );
+
+	request.data = data;
+
+	return request;
+}
+
+
+
+void LoopWorker::process( const LOOP_REQUEST & request )
+{
+	LOOP_RESPONSE response;
+	uint8_t dest[MODBUS_MAX_READ_BITS];
+	uint8_t adu[MODBUS_MAX_ADU_LENGTH];
+	modbus_reg_view_t view = { NULL, 0 };
+	bool isBit = false;
+	int ret = -1;
+
+	response.id = request.id;
+	response.loop = m_loop;
+	response.slave = request.slave;
+	response.func = request.func;
+	response.addr = request.addr;
+	response.num = request.num;
+	response.error = 0;
+
+	// the transaction reads the line itself, the listener stands aside
+	if( m_notifier )
+	{
+		m_notifier->setEnabled( false );
+	}
+	endFrame();
+
+	{
+		QMutexLocker locker( &m_mutex );
+
+		if( m_modbus == NULL )
+		{
+			errno = EINVAL;
+		}
+		else
+		{
+			uint32_t timeoutSec = 0;
+			uint32_t timeoutUsec = 0;
+
+			modbus_set_slave( m_modbus, request.slave );
+
+			// a shorter wait for this request only, e.g. probing empty addresses
+			if( request.timeout > 0 )
+			{
+				modbus_get_response_timeout( m_modbus, &timeoutSec, &timeoutUsec );
+				modbus_set_response_timeout( m_modbus, request.timeout / 1000, ( request.timeout % 1000 ) * 1000 );
+			}
+
+			switch( request.func )
+			{
+				case MODBUS_FC_READ_COILS:
+					ret = modbus_read_bits( m_modbus, request.addr, request.num, dest );
+					isBit = true;
+					break;
+				case MODBUS_FC_READ_DISCRETE_INPUTS:
+					ret = modbus_read_input_bits( m_modbus, request.addr, request.num, dest );
+					isBit = true;
+					break;
+				case MODBUS_FC_READ_HOLDING_REGISTERS:
+				case MODBUS_FC_READ_INPUT_REGISTERS:
+				{
+					// a one-off read, e.g. of a profile, would only evict the polled blocks
+					modbus_prepared_t * prep = request.repeated ? preparedRead( request ) : NULL;
+					if( prep ) ret = modbus_read_prepared_view( m_modbus, prep, adu, &view );
+					else if( request.func == MODBUS_FC_READ_HOLDING_REGISTERS ) ret = modbus_read_registers_view( m_modbus, request.addr, request.num, adu, &view );
+					else ret = modbus_read_input_registers_view( m_modbus, request.addr, request.num, adu, &view );
+					break;
+				}
+				case MODBUS_FC_WRITE_SINGLE_COIL:
+					ret = modbus_write_bit( m_modbus, request.addr, request.data.value( 0 ) ? 1 : 0 );
+					break;
+				case MODBUS_FC_WRITE_SINGLE_REGISTER:
+					ret = modbus_write_register( m_modbus, request.addr, request.data.value( 0 ) );
+					break;
+				case MODBUS_FC_WRITE_MULTIPLE_COILS:
+				{
+					const int num = qMin( request.data.size(), MODBUS_MAX_WRITE_BITS );
+					for( int i = 0; i < num; ++i ) dest[i] = request.data[i] ? 1 : 0;
+					ret = modbus_write_bits( m_modbus, request.addr, num, dest );
+					break;
+				}
+				case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+					ret = modbus_write_registers( m_modbus, request.addr, request.data.size(), request.data.constData() );
+					break;
+				default:
+					errno = EMBXILFUN;
+					break;
+			}
+
+			// drop whatever is left of a late or broken frame
+			if( ret < 0 )
+			{
+				response.error = errno;
+				modbus_flush( m_modbus );
+			}
+
+			if( request.timeout > 0 )
+			{
+				modbus_set_response_timeout( m_modbus, timeoutSec, timeoutUsec );
+			}
+		}
+
+		if( ret < 0 && response.error == 0 )
+		{
+			response.error = errno;
+		}
+	}
+
+	response.ret = ret;
+
+	if( m_notifier )
+	{
+		m_notifier->setEnabled( true );
+	}
+
+	// a read answers with ret registers (or coils), the registers are
+	// taken straight from the received frame
+	if( ret > 0 && request.func <= MODBUS_FC_READ_INPUT_REGISTERS )
+	{
+		response.regs.resize( ret );
+		for( int i = 0; i < ret; ++i )
+		{
+			response.regs[i] = isBit ? dest[i] : MODBUS_REG_VIEW_GET( &view, i );
+		}
+
+		switch( request.valueType )
+		{
+			case FloatValue:
+			{
+				float floats[MODBUS_MAX_READ_REGISTERS/2];
+				if( isBit ) break;
+				modbus_get_float_array_be( view.data, floats, ret/2, DEVICE_FLOAT_ORDER );
+				for( int i = 0; i < ret/2; ++i ) response.values.append( floats[i] );
+				break;
+			}
+			case IntValue:
+				for( int i = 0; i < ret; ++i ) response.values.append( response.regs[i] );
+				break;
+			case CoilValue:
+				for( int i = 0; i < ret; ++i ) response.values.append( response.regs[i] != 0 );
+				break;
+			default:
+				break;
+		}
+	}
+
+	emit responded( response );
+}
+
+
+
+RestartWaiter::RestartWaiter( LoopWorker * worker, const LOOP_REQUEST & probe, const QVector<int> & slaves ) :
+	QEventLoop(),
+	m_worker( worker ),
+	m_probe( probe ),
+	m_slaves( slaves ),
+	m_timer(),
+	m_elapsed(),
+	m_timeout( 0 ),
+	m_grace( 0 ),
+	m_interval( 0 ),
+	m_firstId( 0 ),
+	m_pending( 0 ),
+	m_answered( 0 ),
+	m_isDown( false ),
+	m_isUp( false )
+{
+	m_timer.setSingleShot( true );
+	connect( &m_timer, SIGNAL( timeout() ), this, SLOT( sendProbes() ) );
+	connect( m_worker, SIGNAL( responded( LOOP_RESPONSE ) ),
+				this, SLOT( onResponse( LOOP_RESPONSE ) ), Qt::QueuedConnection );
+}
+
+
+
+bool RestartWaiter::wait( int timeout, int grace, int interval )
+{
+	if( m_slaves.isEmpty() )
+	{
+		return false;
+	}
+
+	m_timeout = timeout;
+	m_grace = grace;
+	m_interval = interval;
+	m_elapsed.start();
+
+	sendProbes();
+	exec();
+
+	return m_isUp;
+}
+
+
+
+// one probe per slave, the next round starts once all of them are answered
+void RestartWaiter::sendProbes()
+{
+	m_firstId = m_worker->reserveIds( m_slaves.size() );
+	m_pending = m_slaves.size();
+	m_answered = 0;
+
+	for( int i = 0; i < m_slaves.size(); ++i )
+	{
+		LOOP_REQUEST request = m_probe;
+
+		request.id = m_firstId + i;
+		request.slave = m_slaves[i];
+		m_worker->submit( request );
+	}
+}
+
+
+
+void RestartWaiter::onResponse( const LOOP_RESPONSE & response )
+{
+	if( response.id < m_firstId || response.id >= m_firstId + m_slaves.size() )
+	{
+		return;
+	}
+
+	if( response.ret == m_probe.num )
+	{
+		++m_answered;
+	}
+	else
+	{
+		m_isDown = true;
+	}
+
+	if( --m_pending > 0 )
+	{
+		return;
+	}
+
+	if( m_isDown && m_answered == m_slaves.size() )
+	{
+		m_isUp = true;
+		quit();
+	}
+	else if( m_elapsed.elapsed() >= m_timeout || ( !m_isDown && m_elapsed.elapsed() >= m_grace ) )
+	{
+		// never went down, or did not come back in time
+		quit();
+	}
+	else
+	{
+		m_timer.start( m_interval );
+	}
+}
@@ -0,0 +1,215 @@
+/*
+ * LoopWorker.h - header file for LoopWorker class
+ *
+ * A LoopWorker owns the Modbus traffic of one loop (one RTU context).
+ * It lives in its own QThread so a slow or silent bus never blocks the
+ * GUI and the six loops can talk to their slaves at the same time.
+ */
+
+#ifndef _LOOP_WORKER_H
+#define _LOOP_WORKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QVector>
+#include <QVariant>
+#include <QMetaType>
+#include <QEventLoop>
+#include <QAtomicInt>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include "modbus.h"
+
+// the meters send floats high word first
+#define DEVICE_FLOAT_ORDER  MODBUS_FLOAT_ABCD
+
+// Windows serial handles can not be watched, the line is polled there
+#define LOOP_POLL_INTERVAL  20      // ms
+
+// register reads kept ready to send, enough for the blocks polled again
+// and again by the telemetry and the calibrations
+#define LOOP_PREPARED_READS 8
+
+
+typedef struct loop_request
+{
+    int id;                     // tag echoed back in the response
+    int slave;
+    int func;                   // modbus function code
+    int addr;                   // 0-based address on the wire
+    int num;                    // registers (or coils) to read
+    int valueType;              // how the response is decoded
+    int timeout;                // ms for the slave to answer, 0 for the line's own
+    bool repeated;              // polled again and again, worth keeping prepared
+    QVector<quint16> data;      // registers (or coils) to write
+
+} LOOP_REQUEST;
+
+typedef struct loop_response
+{
+    int id;
+    int loop;
+    int slave;
+    int func;
+    int addr;
+    int num;
+    int ret;                    // return value of the libmodbus call
+    int error;                  // errno of a failed call
+    QVector<quint16> regs;      // registers (or coils) read
+    QVariantList values;        // decoded values
+
+} LOOP_RESPONSE;
+
+typedef struct loop_prepared
+{
+    int slave;
+    int func;
+    int addr;
+    int num;
+    modbus_prepared_t * prep;   // ADU and CRC built once
+    quint32 lastUse;
+
+} LOOP_PREPARED;
+
+Q_DECLARE_METATYPE(LOOP_REQUEST)
+Q_DECLARE_METATYPE(LOOP_RESPONSE)
+
+
+class LoopWorker : public QObject
+{
+	Q_OBJECT
+public:
+	enum ValueType
+	{
+		RawValue,
+		FloatValue,             // 2 registers in DEVICE_FLOAT_ORDER
+		IntValue,
+		CoilValue
+	} ;
+
+	LoopWorker( int loop );
+	~LoopWorker();
+
+	int loop() const { return m_loop; }
+
+	void setModbus( modbus_t * modbus );
+	int open( modbus_t * modbus );
+	bool isConfigured();
+
+	int reserveIds( int count );
+	int submit( LOOP_REQUEST request );
+	LOOP_RESPONSE execute( LOOP_REQUEST request );
+
+	static LOOP_REQUEST readRequest( int slave, int func, int addr, int num, int valueType );
+	static LOOP_REQUEST writeRequest( int slave, int func, int addr, const QVector<quint16> & data );
+
+
+signals:
+	void requested( const LOOP_REQUEST & request );
+	void responded( const LOOP_RESPONSE & response );
+	void opened( int loop, int id, bool ok, int error );
+	void lost( int loop, void * modbus, int error );
+
+
+private slots:
+	void process( const LOOP_REQUEST & request );
+	void attach( void * modbus );
+	void connectModbus( void * modbus, int id );
+	void onReadable();
+	void endFrame();
+	void onPollTimeout();
+
+
+private:
+	void startListening();
+	void stopListening();
+	modbus_prepared_t * preparedRead( const LOOP_REQUEST & request );
+	void clearPrepared();
+
+	int m_loop;
+	modbus_t * m_modbus;
+	QMutex m_mutex;
+	QAtomicInt m_nextId;
+	modbus_t * m_opening;        // handed to open(), GUI thread only
+
+	// passive listener, lives in the loop thread
+	QSocketNotifier * m_notifier;
+	QTimer * m_silenceTimer;
+	QTimer * m_pollTimer;
+	QElapsedTimer m_lastRead;
+	QByteArray m_frame;
+	int m_t35;                  // us of silence that end a frame
+
+	// lives in the loop thread, bound to m_modbus
+	QVector<LOOP_PREPARED> m_prepared;
+	quint32 m_preparedClock;    // the least recently used one is replaced
+
+} ;
+
+
+/// waits in a local event loop for the response to one request
+class LoopWaiter : public QEventLoop
+{
+	Q_OBJECT
+public:
+	LoopWaiter( int id ) : m_id( id ) { }
+
+	const LOOP_RESPONSE & response() const { return m_response; }
+
+
+public slots:
+	void onResponse( const LOOP_RESPONSE & response )
+	{
+		if( response.id == m_id )
+		{
+			m_response = response;
+			quit();
+		}
+	}
+
+
+private:
+	int m_id;
+	LOOP_RESPONSE m_response;
+
+} ;
+
+
+/// waits in a local event loop until the slaves restarted, i.e. stopped
+/// answering the probe and answer it again; a timer paces the rounds
+class RestartWaiter : public QEventLoop
+{
+	Q_OBJECT
+public:
+	RestartWaiter( LoopWorker * worker, const LOOP_REQUEST & probe, const QVector<int> & slaves );
+
+	// false on timeout, or when they still answer after the grace period
+	bool wait( int timeout, int grace, int interval );
+
+
+private slots:
+	void sendProbes();
+	void onResponse( const LOOP_RESPONSE & response );
+
+
+private:
+	LoopWorker * m_worker;
+	LOOP_REQUEST m_probe;
+	QVector<int> m_slaves;
+	QTimer m_timer;
+	QElapsedTimer m_elapsed;
+	int m_timeout;              // ms
+	int m_grace;                // ms
+	int m_interval;             // ms between the rounds
+	int m_firstId;              // ids of the round in flight
+	int m_pending;
+	int m_answered;
+	bool m_isDown;
+	bool m_isUp;
+
+} ;
+
+
+#endif // _LOOP_WORKER_H
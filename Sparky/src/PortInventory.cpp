@@ -0,0 +1,320 @@
+/*
+ * PortInventory.cpp - implementation of PortInventory class
+ *
+ * The kernel announces each tty it adds or removes on the uevent netlink
+ * socket, so one datagram updates the list in place. The entries are named
+ * the way QextSerialEnumerator does on Linux, the combo boxes and the saved
+ * "serialinterface" keep matching them, and ordered by the prefixes it scans
+ * whether they were enumerated or plugged in later.
+ */
+
+#include <algorithm>
+
+#include "PortInventory.h"
+
+#ifdef Q_OS_LINUX
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+
+
+#ifdef Q_OS_LINUX
+// the same names and prefixes QextSerialEnumerator::getPorts() looks for
+static bool ttyPortInfo( QString name, QextPortInfo * info )
+{
+	bool ok = false;
+
+	if( name.startsWith( "ttyS" ) )
+	{
+		name.mid( 4 ).toInt( &ok, 10 );
+	}
+	else
+	{
+		ok = name.startsWith( "ttyACM" ) || name.startsWith( "ttyUSB" ) || name.startsWith( "rfcomm" );
+	}
+
+	if( !ok )
+	{
+		return false;
+	}
+
+	info->physName = "/dev/" + name;
+	info->portName = name;
+	info->friendName = QString();
+	if( name.startsWith( "ttyS" ) )
+	{
+		info->friendName = "Serial port " + name.mid( 4 );
+	}
+	else if( name.startsWith( "ttyUSB" ) )
+	{
+		info->friendName = "USB-serial adapter " + name.mid( 6 );
+	}
+	else if( name.startsWith( "rfcomm" ) )
+	{
+		info->friendName = "Bluetooth-serial adapter " + name.mid( 6 );
+	}
+	info->enumName = "/dev";
+
+	return true;
+}
+
+
+
+// in the order getPorts() scans the prefixes
+static int portRank( const QString & portName )
+{
+	static const char * const prefixes[] = { "ttyS", "ttyACM", "ttyUSB", "rfcomm" };
+	const int count = sizeof( prefixes ) / sizeof( prefixes[0] );
+
+	for( int i = 0; i < count; ++i )
+	{
+		if( portName.startsWith( prefixes[i] ) )
+		{
+			return i;
+		}
+	}
+
+	return count;
+}
+
+
+
+// each prefix in turn, then by name
+static bool portLessThan( const QextPortInfo & a, const QextPortInfo & b )
+{
+	const int aRank = portRank( a.portName );
+	const int bRank = portRank( b.portName );
+
+	if( aRank != bRank )
+	{
+		return aRank < bRank;
+	}
+
+	return a.portName < b.portName;
+}
+#endif
+
+
+
+// getPorts() sorts the names after the ttyS ones all together
+static QList<QextPortInfo> enumeratePorts()
+{
+	QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
+
+#ifdef Q_OS_LINUX
+	std::stable_sort( ports.begin(), ports.end(), portLessThan );
+#endif
+
+	return ports;
+}
+
+
+
+PortInventory::PortInventory( QObject * parent ) :
+	QObject( parent ),
+	m_ports(),
+	m_uevent( -1 ),
+	m_ueventNotifier( NULL )
+{
+	// listening first, a port plugged in meanwhile is in either or both
+	startWatching();
+	m_ports = enumeratePorts();
+}
+
+
+
+PortInventory::~PortInventory()
+{
+#ifdef Q_OS_LINUX
+	if( m_uevent != -1 )
+	{
+		::close( m_uevent );
+	}
+#endif
+}
+
+
+
+int PortInventory::indexOf( const QString & portName ) const
+{
+	for( int i = 0; i < m_ports.size(); ++i )
+	{
+		if( m_ports[i].portName == portName )
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+
+void PortInventory::refresh()
+{
+	if( isWatching() )
+	{
+		return;
+	}
+
+	const QList<QextPortInfo> ports = enumeratePorts();
+
+	bool same = ports.size() == m_ports.size();
+	for( int i = 0; same && i < ports.size(); ++i )
+	{
+		same = ports[i].portName == m_ports[i].portName;
+	}
+
+	if( !same )
+	{
+		m_ports = ports;
+		emit changed();
+	}
+}
+
+
+
+// the enumerator's own notifications on Windows come through
+// QWidget::winEvent(), which Qt 5 no longer calls, so there and on other
+// systems the list is enumerated again on refresh()
+void PortInventory::startWatching()
+{
+#ifdef Q_OS_LINUX
+	struct sockaddr_nl addr;
+
+	m_uevent = ::socket( AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT );
+	if( m_uevent == -1 )
+	{
+		qWarning( "PortInventory: no uevent socket (%s), serial ports are not watched", strerror( errno ) );
+		return;
+	}
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;         // the kernel's own events, not udev's
+	if( ::bind( m_uevent, (struct sockaddr *) &addr, sizeof( addr ) ) == -1 )
+	{
+		qWarning( "PortInventory: can't bind the uevent socket (%s), serial ports are not watched", strerror( errno ) );
+		::close( m_uevent );
+		m_uevent = -1;
+		return;
+	}
+
+	m_ueventNotifier = new QSocketNotifier( m_uevent, QSocketNotifier::Read, this );
+	connect( m_ueventNotifier, SIGNAL( activated( int ) ), this, SLOT( onUevent() ) );
+#endif
+}
+
+
+
+void PortInventory::onUevent()
+{
+#ifdef Q_OS_LINUX
+	bool updated = false;
+	char buf[4096];
+
+	for( ;; )
+	{
+		struct sockaddr_nl sender;
+		socklen_t senderLength = sizeof( sender );
+		const ssize_t length = ::recvfrom( m_uevent, buf, sizeof( buf ) - 1, 0,
+											(struct sockaddr *) &sender, &senderLength );
+		if( length <= 0 )
+		{
+			break;
+		}
+
+		// only the kernel speaks for the devices
+		if( sender.nl_pid != 0 )
+		{
+			continue;
+		}
+		buf[length] = '\0';
+
+		// "action@devpath" then KEY=value fields, each ended by a NUL
+		QString action;
+		QString subsystem;
+		QString devName;
+		for( ssize_t i = strlen( buf ) + 1; i < length; i += strlen( buf + i ) + 1 )
+		{
+			const char * field = buf + i;
+
+			if( !strncmp( field, "ACTION=", 7 ) )
+			{
+				action = QString::fromLatin1( field + 7 );
+			}
+			else if( !strncmp( field, "SUBSYSTEM=", 10 ) )
+			{
+				subsystem = QString::fromLatin1( field + 10 );
+			}
+			else if( !strncmp( field, "DEVNAME=", 8 ) )
+			{
+				devName = QString::fromLatin1( field + 8 );
+			}
+		}
+
+		if( subsystem != "tty" || devName.isEmpty() )
+		{
+			continue;
+		}
+
+		QextPortInfo info;
+		if( action == "add" && ttyPortInfo( devName, &info ) )
+		{
+			updated |= addPort( info );
+		}
+		else if( action == "remove" )
+		{
+			updated |= removePort( devName );
+		}
+	}
+
+	if( updated )
+	{
+		emit changed();
+	}
+#endif
+}
+
+
+
+bool PortInventory::addPort( const QextPortInfo & info )
+{
+	if( indexOf( info.portName ) != -1 )
+	{
+		return false;
+	}
+
+	int i = m_ports.size();
+#ifdef Q_OS_LINUX
+	i = 0;
+	while( i < m_ports.size() && portLessThan( m_ports[i], info ) )
+	{
+		++i;
+	}
+#endif
+
+	m_ports.insert( i, info );
+
+	return true;
+}
+
+
+
+bool PortInventory::removePort( const QString & portName )
+{
+	const int i = indexOf( portName );
+
+	if( i == -1 )
+	{
+		return false;
+	}
+
+	m_ports.removeAt( i );
+
+	return true;
+}
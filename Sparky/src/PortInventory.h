@@ -0,0 +1,59 @@
+/*
+ * PortInventory.h - header file for PortInventory class
+ *
+ * The serial ports of the machine, enumerated once and shared by the six
+ * loops. On Linux the list follows the adapters plugged in and out through
+ * the kernel uevents, elsewhere it is enumerated again on demand, instead
+ * of scanning for every combo box and every port change.
+ */
+
+#ifndef _PORT_INVENTORY_H
+#define _PORT_INVENTORY_H
+
+#include <QObject>
+#include <QList>
+#include <QSocketNotifier>
+
+#include "qextserialenumerator.h"
+
+
+class PortInventory : public QObject
+{
+	Q_OBJECT
+public:
+	PortInventory( QObject * parent = 0 );
+	~PortInventory();
+
+	const QList<QextPortInfo> & ports() const { return m_ports; }
+	int indexOf( const QString & portName ) const;
+
+	// whether the list follows hotplug by itself
+	bool isWatching() const { return m_ueventNotifier != NULL; }
+
+	// enumerates again, unless the list is already kept up to date
+	void refresh();
+
+
+signals:
+	void changed();
+
+
+private slots:
+	void onUevent();
+
+
+private:
+	void startWatching();
+	bool addPort( const QextPortInfo & info );
+	bool removePort( const QString & portName );
+
+	QList<QextPortInfo> m_ports;
+
+	// kernel uevent socket, Linux only
+	int m_uevent;
+	QSocketNotifier * m_ueventNotifier;
+
+} ;
+
+
+#endif // _PORT_INVENTORY_H
@@ -0,0 +1,547 @@
+/*
+ * ProfileModel.cpp - implementation of ProfileModel class
+ *
+ * Lines are cut straight out of the mapped file, numbers are converted
+ * once while loading and text is only built again for painting, editing
+ * and saving.
+ */
+
+#include <QFile>
+#include <QTextStream>
+
+#include <string.h>
+
+#include "ProfileModel.h"
+
+
+// a corrupt qty column must not allocate the world
+static const int PROFILE_MAX_COUNT = 65536;
+
+
+
+// splits one line at the commas, a quoted field may hold commas and ""
+static void splitLine( const char * p, const char * end, QVector<QByteArray> & fields )
+{
+	fields.clear();
+
+	while( true )
+	{
+		if( p < end && *p == '"' )
+		{
+			QByteArray field;
+
+			for( ++p; p < end; ++p )
+			{
+				if( *p == '"' )
+				{
+					if( p + 1 < end && p[1] == '"' )
+					{
+						++p;
+					}
+					else
+					{
+						++p;
+						break;
+					}
+				}
+				field.append( *p );
+			}
+			fields.append( field );
+
+			p = static_cast<const char *>( memchr( p, ',', end - p ) );
+		}
+		else
+		{
+			const char * comma = static_cast<const char *>( memchr( p, ',', end - p ) );
+			const char * last = comma ? comma : end;
+
+			// no copy, the bytes stay in the mapping while the line is parsed
+			fields.append( QByteArray::fromRawData( p, last - p ) );
+			p = comma;
+		}
+
+		if( p == NULL )
+		{
+			break;
+		}
+		++p;
+	}
+}
+
+
+
+// the fewest digits that read back as the same float
+static QString floatText( float value )
+{
+	QString text;
+
+	for( int precision = 6; precision < 9; ++precision )
+	{
+		text = QString::number( value, 'g', precision );
+		if( text.toFloat() == value )
+		{
+			return text;
+		}
+	}
+
+	return QString::number( value, 'g', 9 );
+}
+
+
+
+// ints may be written with a fraction or in hex, like the editor allowed
+static bool parseInt( const QByteArray & text, qint32 & value )
+{
+	const int dot = text.indexOf( '.' );
+	bool ok;
+
+	value = ( dot < 0 ? text : text.left( dot ) ).trimmed().toLong( &ok, 0 );
+
+	return ok;
+}
+
+
+
+
+ProfileModel::ProfileModel( QObject * parent ) :
+	QAbstractTableModel( parent ),
+	m_valueStart( 1, 0 ),
+	m_valueColumns( 0 )
+{
+}
+
+
+
+bool ProfileModel::load( const QString & fileName )
+{
+	QFile file( fileName );
+
+	if( !file.open( QIODevice::ReadOnly ) )
+	{
+		return false;
+	}
+
+	beginResetModel();
+	clearRows();
+
+	const qint64 size = file.size();
+	uchar * data = size > 0 ? file.map( 0, size ) : NULL;
+
+	if( data )
+	{
+		parse( reinterpret_cast<const char *>( data ), size );
+		file.unmap( data );
+	}
+	else
+	{
+		// not mappable (pipe, some network shares), read it the slow way
+		const QByteArray all = file.readAll();
+		parse( all.constData(), all.size() );
+	}
+
+	endResetModel();
+
+	return true;
+}
+
+
+
+bool ProfileModel::save( const QString & fileName, QString & error ) const
+{
+	QFile file( fileName );
+
+	if( !file.open( QIODevice::WriteOnly ) )
+	{
+		error = file.errorString();
+		return false;
+	}
+
+	QTextStream out( &file );
+
+	for( int r = 0; r < rows(); ++r )
+	{
+		for( int c = 0; c < ValueColumn; ++c )
+		{
+			out << data( index( r, c ) ).toString() << ',';
+		}
+
+		if( type( r ) == ProfileChar )
+		{
+			QString text = m_texts[r];
+			out << '"' << text.replace( '"', "\"\"" ) << "\",";
+		}
+		else
+		{
+			for( int i = 0; i < valueCount( r ); ++i )
+			{
+				out << valueText( r, i ) << ',';
+			}
+		}
+
+		out << endl;
+	}
+
+	return true;
+}
+
+
+
+void ProfileModel::clear()
+{
+	beginResetModel();
+	clearRows();
+	endResetModel();
+}
+
+
+
+void ProfileModel::clearRows()
+{
+	m_names.clear();
+	m_slaves.clear();
+	m_addrs.clear();
+	m_types.clear();
+	m_typeNames.clear();
+	m_scales.clear();
+	m_access.clear();
+	m_rwNames.clear();
+	m_counts.clear();
+	m_texts.clear();
+	m_valueStart.fill( 0, 1 );
+	m_values.clear();
+	m_valueColumns = 0;
+}
+
+
+
+void ProfileModel::setFloatValue( int row, int i, float value )
+{
+	m_values[m_valueStart[row] + i].f = value;
+
+	const QModelIndex changed = index( row, ValueColumn + i );
+	emit dataChanged( changed, changed );
+}
+
+
+
+void ProfileModel::setIntValue( int row, int i, qint32 value )
+{
+	m_values[m_valueStart[row] + i].i = value;
+
+	const QModelIndex changed = index( row, ValueColumn + i );
+	emit dataChanged( changed, changed );
+}
+
+
+
+void ProfileModel::parse( const char * data, qint64 size )
+{
+	const char * p = data;
+	const char * end = data + size;
+	QVector<QByteArray> fields;
+
+	while( p < end )
+	{
+		const char * eol = static_cast<const char *>( memchr( p, '\n', end - p ) );
+		const char * next = eol ? eol + 1 : end;
+
+		if( eol == NULL )
+		{
+			eol = end;
+		}
+		if( eol > p && eol[-1] == '\r' )
+		{
+			--eol;
+		}
+
+		// an empty line ends the profile
+		if( eol == p )
+		{
+			break;
+		}
+
+		splitLine( p, eol, fields );
+
+		// '*' marks comment and header lines
+		if( !fields[0].contains( '*' ) )
+		{
+			appendRow( fields );
+		}
+
+		p = next;
+	}
+}
+
+
+
+void ProfileModel::appendRow( const QVector<QByteArray> & fields )
+{
+	bool empty = true;
+	for( int i = 0; i < fields.size() && empty; ++i )
+	{
+		empty = fields[i].trimmed().isEmpty();
+	}
+
+	// spacer lines of the spreadsheet
+	if( empty )
+	{
+		return;
+	}
+
+	const QByteArray typeName = fields.value( TypeColumn ).trimmed();
+	const QByteArray rw = fields.value( RwColumn ).trimmed();
+	bool ok;
+	ProfileType type = ProfileOther;
+
+	if( typeName.contains( "float" ) )      type = ProfileFloat;
+	else if( typeName.contains( "long" ) )  type = ProfileLong;
+	else if( typeName.contains( "int" ) )   type = ProfileInt;
+	else if( typeName.contains( "bit" ) )   type = ProfileBit;
+	else if( typeName.contains( "char" ) )  type = ProfileChar;
+
+	m_names.append( QString::fromLocal8Bit( fields.value( NameColumn ) ) );
+
+	const int slave = fields.value( SlaveColumn ).trimmed().toInt( &ok );
+	m_slaves.append( ok ? slave : -1 );
+
+	m_addrs.append( fields.value( AddrColumn ).trimmed().toInt() );
+	m_types.append( type );
+	m_typeNames.append( QString::fromLatin1( typeName ) );
+
+	const float scale = fields.value( ScaleColumn ).trimmed().toFloat( &ok );
+	m_scales.append( ok ? scale : 1.0f );
+
+	m_access.append( ( rw.contains( 'R' ) ? ReadAccess : 0 ) | ( rw.contains( 'W' ) ? WriteAccess : 0 ) );
+	m_rwNames.append( QString::fromLatin1( rw ) );
+
+	const int count = qBound( 0, fields.value( CountColumn ).trimmed().toInt(), PROFILE_MAX_COUNT );
+	m_counts.append( count );
+
+	if( type == ProfileChar )
+	{
+		m_texts.append( QString::fromLocal8Bit( fields.value( ValueColumn ) ) );
+		m_valueStart.append( m_values.size() );
+		m_valueColumns = qMax( m_valueColumns, 1 );
+		return;
+	}
+
+	m_texts.append( QString() );
+
+	for( int i = 0; i < count; ++i )
+	{
+		const QByteArray text = fields.value( ValueColumn + i );
+		PROFILE_VALUE value;
+
+		if( type == ProfileFloat )
+		{
+			value.f = text.trimmed().toFloat();
+		}
+		else if( !parseInt( text, value.i ) )
+		{
+			value.i = 0;
+		}
+		m_values.append( value );
+	}
+
+	m_valueStart.append( m_values.size() );
+	m_valueColumns = qMax( m_valueColumns, count );
+}
+
+
+
+QString ProfileModel::valueText( int row, int i ) const
+{
+	return type( row ) == ProfileFloat ? floatText( floatValue( row, i ) ) : QString::number( intValue( row, i ) );
+}
+
+
+
+bool ProfileModel::setValueText( int row, int i, const QString & text )
+{
+	bool ok;
+
+	if( type( row ) == ProfileFloat )
+	{
+		const float value = text.trimmed().toFloat( &ok );
+		if( ok )
+		{
+			setFloatValue( row, i, value );
+		}
+	}
+	else
+	{
+		qint32 value;
+		ok = parseInt( text.toLatin1(), value );
+		if( ok )
+		{
+			setIntValue( row, i, value );
+		}
+	}
+
+	return ok;
+}
+
+
+
+int ProfileModel::rowCount( const QModelIndex & parent ) const
+{
+	return parent.isValid() ? 0 : rows();
+}
+
+
+
+int ProfileModel::columnCount( const QModelIndex & parent ) const
+{
+	return parent.isValid() ? 0 : ValueColumn + qMax( 1, m_valueColumns );
+}
+
+
+
+QVariant ProfileModel::data( const QModelIndex & index, int role ) const
+{
+	if( !index.isValid() || index.row() >= rows() ||
+		( role != Qt::DisplayRole && role != Qt::EditRole ) )
+	{
+		return QVariant();
+	}
+
+	const int r = index.row();
+
+	switch( index.column() )
+	{
+		case NameColumn:	return m_names[r];
+		case SlaveColumn:	return m_slaves[r] < 0 ? QString() : QString::number( m_slaves[r] );
+		case AddrColumn:	return QString::number( m_addrs[r] );
+		case TypeColumn:	return m_typeNames[r];
+		case ScaleColumn:	return floatText( m_scales[r] );
+		case RwColumn:		return m_rwNames[r];
+		case CountColumn:	return QString::number( m_counts[r] );
+		default:			break;
+	}
+
+	const int i = index.column() - ValueColumn;
+
+	if( type( r ) == ProfileChar )
+	{
+		return i == 0 ? m_texts[r] : QVariant();
+	}
+
+	return i < valueCount( r ) ? valueText( r, i ) : QVariant();
+}
+
+
+
+bool ProfileModel::setData( const QModelIndex & index, const QVariant & value, int role )
+{
+	if( !index.isValid() || index.row() >= rows() || role != Qt::EditRole )
+	{
+		return false;
+	}
+
+	const int r = index.row();
+	const QString text = value.toString();
+	bool ok = true;
+
+	switch( index.column() )
+	{
+		case NameColumn:
+			m_names[r] = text;
+			break;
+		case SlaveColumn:
+		{
+			const int slave = text.trimmed().toInt( &ok );
+			if( ok ) m_slaves[r] = slave;
+			else if( text.trimmed().isEmpty() ) { m_slaves[r] = -1; ok = true; }
+			break;
+		}
+		case AddrColumn:
+		{
+			const int addr = text.trimmed().toInt( &ok );
+			if( ok ) m_addrs[r] = addr;
+			break;
+		}
+		case ScaleColumn:
+		{
+			const float scale = text.trimmed().toFloat( &ok );
+			if( ok ) m_scales[r] = scale;
+			break;
+		}
+		case RwColumn:
+			m_rwNames[r] = text.trimmed();
+			m_access[r] = ( text.contains( 'R' ) ? ReadAccess : 0 ) | ( text.contains( 'W' ) ? WriteAccess : 0 );
+			break;
+		case TypeColumn:
+		case CountColumn:
+			return false;
+		default:
+		{
+			const int i = index.column() - ValueColumn;
+			if( type( r ) == ProfileChar )
+			{
+				if( i != 0 ) return false;
+				m_texts[r] = text;
+				break;
+			}
+			// emits dataChanged itself
+			return i < valueCount( r ) && setValueText( r, i, text );
+		}
+	}
+
+	if( ok )
+	{
+		emit dataChanged( index, index );
+	}
+
+	return ok;
+}
+
+
+
+// type and qty shape the value columns, they can only change by loading
+Qt::ItemFlags ProfileModel::flags( const QModelIndex & index ) const
+{
+	Qt::ItemFlags f = QAbstractTableModel::flags( index );
+
+	if( !index.isValid() || index.column() == TypeColumn || index.column() == CountColumn )
+	{
+		return f;
+	}
+
+	if( index.column() >= ValueColumn )
+	{
+		const int i = index.column() - ValueColumn;
+		const bool hasValue = type( index.row() ) == ProfileChar ? i == 0 : i < valueCount( index.row() );
+
+		if( !hasValue )
+		{
+			return f;
+		}
+	}
+
+	return f | Qt::ItemIsEditable;
+}
+
+
+
+QVariant ProfileModel::headerData( int section, Qt::Orientation orientation, int role ) const
+{
+	if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+	{
+		return QAbstractTableModel::headerData( section, orientation, role );
+	}
+
+	switch( section )
+	{
+		case NameColumn:	return tr( "Name" );
+		case SlaveColumn:	return tr( "Slave" );
+		case AddrColumn:	return tr( "Address" );
+		case TypeColumn:	return tr( "Type" );
+		case ScaleColumn:	return tr( "Scale" );
+		case RwColumn:		return tr( "R/W" );
+		case CountColumn:	return tr( "Qty" );
+		case ValueColumn:	return tr( "Value" );
+		default:			break;
+	}
+
+	return QString::number( section + 1 );
+}
@@ -0,0 +1,116 @@
+/*
+ * ProfileModel.h - header file for ProfileModel class
+ *
+ * An equation profile kept as typed columns, one vector per field, so that
+ * upload, download and save work on native numbers. The CSV file is mapped
+ * and parsed in place and the table view only formats the cells it paints.
+ */
+
+#ifndef _PROFILE_MODEL_H
+#define _PROFILE_MODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QString>
+
+
+enum ProfileType
+{
+	ProfileFloat,               // two registers
+	ProfileInt,                 // one register
+	ProfileLong,
+	ProfileBit,                 // one coil
+	ProfileChar,                // text, kept as written in the file
+	ProfileOther
+} ;
+
+typedef union profile_value
+{
+    float f;
+    qint32 i;
+
+} PROFILE_VALUE;
+
+
+class ProfileModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	enum Columns
+	{
+		NameColumn,
+		SlaveColumn,
+		AddrColumn,
+		TypeColumn,
+		ScaleColumn,
+		RwColumn,
+		CountColumn,
+		ValueColumn
+	} ;
+
+	ProfileModel( QObject * parent = 0 );
+
+	bool load( const QString & fileName );
+	bool save( const QString & fileName, QString & error ) const;
+	void clear();
+
+	int rows() const { return m_names.size(); }
+	const QString & name( int row ) const { return m_names[row]; }
+	int slave( int row ) const { return m_slaves[row]; }
+	int addr( int row ) const { return m_addrs[row]; }
+	ProfileType type( int row ) const { return static_cast<ProfileType>( m_types[row] ); }
+	float scale( int row ) const { return m_scales[row]; }
+	bool isReadable( int row ) const { return m_access[row] & ReadAccess; }
+	bool isWritable( int row ) const { return m_access[row] & WriteAccess; }
+	int count( int row ) const { return m_counts[row]; }
+
+	int valueCount( int row ) const { return m_valueStart[row+1] - m_valueStart[row]; }
+	float floatValue( int row, int i ) const { return m_values[m_valueStart[row] + i].f; }
+	qint32 intValue( int row, int i ) const { return m_values[m_valueStart[row] + i].i; }
+	void setFloatValue( int row, int i, float value );
+	void setIntValue( int row, int i, qint32 value );
+
+	int rowCount( const QModelIndex & parent = QModelIndex() ) const;
+	int columnCount( const QModelIndex & parent = QModelIndex() ) const;
+	QVariant data( const QModelIndex & index, int role = Qt::DisplayRole ) const;
+	bool setData( const QModelIndex & index, const QVariant & value, int role = Qt::EditRole );
+	Qt::ItemFlags flags( const QModelIndex & index ) const;
+	QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const;
+
+
+private:
+	enum Access
+	{
+		ReadAccess = 1,
+		WriteAccess = 2
+	} ;
+
+	void clearRows();
+	void parse( const char * data, qint64 size );
+	void appendRow( const QVector<QByteArray> & fields );
+	QString valueText( int row, int i ) const;
+	bool setValueText( int row, int i, const QString & text );
+
+	// one entry per row
+	QVector<QString> m_names;
+	QVector<int> m_slaves;
+	QVector<int> m_addrs;
+	QVector<quint8> m_types;
+	QVector<QString> m_typeNames;   // as written, for saving
+	QVector<float> m_scales;
+	QVector<quint8> m_access;
+	QVector<QString> m_rwNames;
+	QVector<int> m_counts;
+	QVector<QString> m_texts;       // ProfileChar rows only
+
+	// values of all rows back to back, row r owns
+	// m_valueStart[r] .. m_valueStart[r+1]-1
+	QVector<int> m_valueStart;
+	QVector<PROFILE_VALUE> m_values;
+
+	int m_valueColumns;
+
+} ;
+
+
+#endif // _PROFILE_MODEL_H
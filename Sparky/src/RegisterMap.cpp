@@ -0,0 +1,183 @@
+/*
+ * RegisterMap.cpp - implementation of RegisterMap class
+ *
+ * The tables are compiled in, a table that misses a RegisterId does not
+ * build and one out of order trips def() on the first lookup.
+ */
+
+#include <QtGlobal>
+
+#include <algorithm>
+
+#include "RegisterMap.h"
+
+
+
+// the firmware sends every value as a float, two registers apart
+static const REGISTER_DEF eeaRegisters[] =
+{
+	{ RegisterSnPipe,           "SN_PIPE",                   1, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterWatercut,         "WATERCUT",                  3, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterTemperature,      "TEMPERATURE",               5, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterEmulstionPhase,   "EMULSTION_PHASE",           7, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterSalinity,         "SALINITY",                  9, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterHardwareVersion,  "HARDWARE_VERSION",         11, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterFirmwareVersion,  "FIRMWARE_VERSION",         13, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterOilAdjust,        "OIL_ADJUST",               15, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterWaterAdjust,      "WATER_ADJUST",             17, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterFreq,             "FREQ",                     19, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterFreqAvg,          "FREQ_AVG",                 21, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterWatercutAvg,      "WATERCUT_AVG",             23, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterWatercutRaw,      "WATERCUT_RAW",             25, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterAnalyzerMode,     "ANALYZER_MODE",            27, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterTempAvg,          "TEMP_AVG",                 29, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterTempAdjust,       "TEMP_ADJUST",              31, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterTempUser,         "TEMP_USER",                33, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterProcAvging,       "PROC_AVGING",              35, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilIndex,         "OIL_INDEX",                37, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilP0,            "OIL_P0",                   39, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilP1,            "OIL_P1",                   41, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilFreqLow,       "OIL_FREQ_LOW",             43, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilFreqHigh,      "OIL_FREQ_HIGH",            45, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterSamplePeriod,     "SAMPLE_PERIOD",            47, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoLrv,            "AO_LRV",                   49, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoUrv,            "AO_URV",                   51, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoDampen,         "AO_DAMPEN",                53, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterBaudRate,         "BAUD_RATE",                55, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterSlaveAddress,     "SLAVE_ADDRESS",            57, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterStopBits,         "STOP_BITS",                59, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilRp,            "OIL_RP",                   61, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterWaterRp,          "WATER_RP",                 63, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterDensityMode,      "DENSITY_MODE",             65, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilCalcMax,       "OIL_CALC_MAX",             67, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilPhaseCutoff,   "OIL_PHASE_CUTOFF",         69, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterTempOilNumCurves, "TEMP_OIL_NUM_CURVES",      71, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterStream,           "STREAM",                   73, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilRpAvg,         "OIL_RP_AVG",               75, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterPlaceHolder,      "PLACE_HOLDER",             77, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilSample,        "OIL_SAMPLE",               79, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcSec,           "RTC_SEC",                  81, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcMin,           "RTC_MIN",                  83, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcHr,            "RTC_HR",                   85, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcDay,           "RTC_DAY",                  87, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcMon,           "RTC_MON",                  89, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcYr,            "RTC_YR",                   91, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcSecIn,         "RTC_SEC_IN",               93, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcMinIn,         "RTC_MIN_IN",               95, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcHrIn,          "RTC_HR_IN",                97, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcDayIn,         "RTC_DAY_IN",               99, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcMonIn,         "RTC_MON_IN",              101, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRtcYrIn,          "RTC_YR_IN",               103, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoManualVal,      "AO_MANUAL_VAL",           105, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoTrimlo,         "AO_TRIMLO",               107, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoTrimhi,         "AO_TRIMHI",               109, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityAdj,       "DENSITY_ADJ",             111, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityUnit,      "DENSITY_UNIT",            113, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterWcAdjDens,        "WC_ADJ_DENS",             115, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityD3,        "DENSITY_D3",              117, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityD2,        "DENSITY_D2",              119, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityD1,        "DENSITY_D1",              121, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityD0,        "DENSITY_D0",              123, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterDensityCalVal,    "DENSITY_CAL_VAL",         125, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterModelCode0,       "MODEL_CODE_0",            127, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterModelCode1,       "MODEL_CODE_1",            129, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterModelCode2,       "MODEL_CODE_2",            131, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterModelCode3,       "MODEL_CODE_3",            133, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterLoggingPeriod,    "LOGGING_PERIOD",          135, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterPassword,         "PASSWORD",                137, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterStatistics,       "STATISTICS",              139, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterActiveError,      "ACTIVE_ERROR",            141, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterAoAlarmMode,      "AO_ALARM_MODE",           143, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoOutput,         "AO_OUTPUT",               145, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterPhaseHoldCycles,  "PHASE_HOLD_CYCLES",       147, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRelayDelay,       "RELAY_DELAY",             149, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterRelaySetpoint,    "RELAY_SETPOINT",          151, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAoMode,           "AO_MODE",                 153, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensity,       "OIL_DENSITY",             155, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensityModbus, "OIL_DENSITY_MODBUS",      157, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensityAi,     "OIL_DENSITY_AI",          159, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensityManual, "OIL_DENSITY_MANUAL",      161, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensityAiLrv,  "OIL_DENSITY_AI_LRV",      163, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensityAiUrv,  "OIL_DENSITY_AI_URV",      165, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterOilDensCorrMode,  "OIL_DENS_CORR_MODE",      167, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAiTrimlo,         "AI_TRIMLO",               169, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAiTrimhi,         "AI_TRIMHI",               171, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterReadWrite },
+	{ RegisterAiMeasure,        "AI_MEASURE",              173, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+	{ RegisterAiTrimmed,        "AI_TRIMMED",              175, ProfileFloat, MODBUS_FLOAT_ABCD, 1.0f, RegisterRead },
+} ;
+
+Q_STATIC_ASSERT( sizeof( eeaRegisters ) / sizeof( eeaRegisters[0] ) == Registers );
+
+// the Razor keeps the layout of the EEA, it gets its own table the day
+// the two differ
+static const REGISTER_DEF * const productRegisters[RegisterProducts] =
+{
+	eeaRegisters,
+	eeaRegisters
+} ;
+
+
+
+const REGISTER_DEF & RegisterMap::def( RegisterProduct product, RegisterId id )
+{
+	Q_ASSERT( product >= 0 && product < RegisterProducts && id >= 0 && id < Registers );
+	Q_ASSERT( productRegisters[product][id].id == id );
+
+	return productRegisters[product][id];
+}
+
+
+
+int RegisterMap::width( const REGISTER_DEF & reg )
+{
+	switch( reg.type )
+	{
+		case ProfileFloat:
+		case ProfileLong:
+			return 2;
+		default:
+			return 1;
+	}
+}
+
+
+
+static bool spanLessThan( const REGISTER_SPAN & a, const REGISTER_SPAN & b )
+{
+	return a.addr < b.addr;
+}
+
+
+
+// merges neighbours for as long as the span fits in one request, the
+// registers in between come along
+QVector<REGISTER_SPAN> RegisterMap::planReads( const REGISTER_DEF * const regs[], int count, int maxCount )
+{
+	QVector<REGISTER_SPAN> values;
+	QVector<REGISTER_SPAN> spans;
+
+	for( int i = 0; i < count; ++i )
+	{
+		Q_ASSERT( regs[i]->access & RegisterRead );
+
+		const REGISTER_SPAN value = { regs[i]->addr, width( *regs[i] ) };
+		values.append( value );
+	}
+	std::sort( values.begin(), values.end(), spanLessThan );
+
+	for( int i = 0; i < values.size(); ++i )
+	{
+		const int end = values[i].addr + values[i].num;
+
+		if( !spans.isEmpty() && end - spans.last().addr <= maxCount )
+		{
+			spans.last().num = qMax( spans.last().num, end - spans.last().addr );
+		}
+		else
+		{
+			spans.append( values[i] );
+		}
+	}
+
+	return spans;
+}
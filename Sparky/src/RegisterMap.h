@@ -0,0 +1,159 @@
+/*
+ * RegisterMap.h - header file for RegisterMap class
+ *
+ * The registers of the analyzers, described once per product and shared
+ * by all pipes. Code names a register by its RegisterId, which indexes the
+ * descriptor table directly. The reads of a set of registers are planned
+ * from their descriptors.
+ */
+
+#ifndef _REGISTER_MAP_H
+#define _REGISTER_MAP_H
+
+#include <QVector>
+
+#include "modbus.h"
+#include "ProfileModel.h"
+
+
+enum RegisterProduct
+{
+	RegisterEEA,
+	RegisterRazor,
+	RegisterProducts
+} ;
+
+enum RegisterAccess
+{
+	RegisterRead = 1,
+	RegisterWrite = 2,
+	RegisterReadWrite = 3
+} ;
+
+enum RegisterId
+{
+	RegisterNone = -1,
+	RegisterSnPipe,
+	RegisterWatercut,
+	RegisterTemperature,
+	RegisterEmulstionPhase,
+	RegisterSalinity,
+	RegisterHardwareVersion,
+	RegisterFirmwareVersion,
+	RegisterOilAdjust,
+	RegisterWaterAdjust,
+	RegisterFreq,
+	RegisterFreqAvg,
+	RegisterWatercutAvg,
+	RegisterWatercutRaw,
+	RegisterAnalyzerMode,
+	RegisterTempAvg,
+	RegisterTempAdjust,
+	RegisterTempUser,
+	RegisterProcAvging,
+	RegisterOilIndex,
+	RegisterOilP0,
+	RegisterOilP1,
+	RegisterOilFreqLow,
+	RegisterOilFreqHigh,
+	RegisterSamplePeriod,
+	RegisterAoLrv,
+	RegisterAoUrv,
+	RegisterAoDampen,
+	RegisterBaudRate,
+	RegisterSlaveAddress,
+	RegisterStopBits,
+	RegisterOilRp,
+	RegisterWaterRp,
+	RegisterDensityMode,
+	RegisterOilCalcMax,
+	RegisterOilPhaseCutoff,
+	RegisterTempOilNumCurves,
+	RegisterStream,
+	RegisterOilRpAvg,
+	RegisterPlaceHolder,
+	RegisterOilSample,
+	RegisterRtcSec,
+	RegisterRtcMin,
+	RegisterRtcHr,
+	RegisterRtcDay,
+	RegisterRtcMon,
+	RegisterRtcYr,
+	RegisterRtcSecIn,
+	RegisterRtcMinIn,
+	RegisterRtcHrIn,
+	RegisterRtcDayIn,
+	RegisterRtcMonIn,
+	RegisterRtcYrIn,
+	RegisterAoManualVal,
+	RegisterAoTrimlo,
+	RegisterAoTrimhi,
+	RegisterDensityAdj,
+	RegisterDensityUnit,
+	RegisterWcAdjDens,
+	RegisterDensityD3,
+	RegisterDensityD2,
+	RegisterDensityD1,
+	RegisterDensityD0,
+	RegisterDensityCalVal,
+	RegisterModelCode0,
+	RegisterModelCode1,
+	RegisterModelCode2,
+	RegisterModelCode3,
+	RegisterLoggingPeriod,
+	RegisterPassword,
+	RegisterStatistics,
+	RegisterActiveError,
+	RegisterAoAlarmMode,
+	RegisterAoOutput,
+	RegisterPhaseHoldCycles,
+	RegisterRelayDelay,
+	RegisterRelaySetpoint,
+	RegisterAoMode,
+	RegisterOilDensity,
+	RegisterOilDensityModbus,
+	RegisterOilDensityAi,
+	RegisterOilDensityManual,
+	RegisterOilDensityAiLrv,
+	RegisterOilDensityAiUrv,
+	RegisterOilDensCorrMode,
+	RegisterAiTrimlo,
+	RegisterAiTrimhi,
+	RegisterAiMeasure,
+	RegisterAiTrimmed,
+	Registers
+} ;
+
+typedef struct register_def
+{
+    RegisterId id;
+    const char * name;
+    int addr;                   // 1-based modbus address
+    ProfileType type;           // ProfileFloat, ProfileInt or ProfileLong
+    modbus_float_order_t order; // word order of the floats
+    float scale;                // engineering value = raw * scale
+    int access;                 // RegisterRead | RegisterWrite
+
+} REGISTER_DEF;
+
+typedef struct register_span
+{
+    int addr;                   // 1-based address of the first register
+    int num;                    // registers read, the gaps included
+
+} REGISTER_SPAN;
+
+
+class RegisterMap
+{
+public:
+	static const REGISTER_DEF & def( RegisterProduct product, RegisterId id );
+	static int width( const REGISTER_DEF & reg );
+
+	static QVector<REGISTER_SPAN> planReads( const REGISTER_DEF * const regs[], int count,
+												int maxCount = MODBUS_MAX_READ_REGISTERS );
+
+} ;
+
+
+#endif // _REGISTER_MAP_H
@@ -0,0 +1,176 @@
+/*
+ * TelemetryPoller.cpp - implementation of TelemetryPoller class
+ *
+ * The wanted registers are read in as few block reads as a request can
+ * hold. The responses are decoded right in the loop thread (direct
+ * connection) and only the finished sample is handed over, through the
+ * lock-free slot.
+ */
+
+#include <QDateTime>
+
+#include "TelemetryPoller.h"
+
+
+
+TelemetryPoller::TelemetryPoller( QObject * parent ) :
+	QObject( parent ),
+	m_timer(),
+	m_worker(),
+	m_slave( 0 ),
+	m_pipe( -1 ),
+	m_firstId( 0 ),
+	m_lastId( 0 )
+{
+	for( int i = 0; i < TELEMETRY_LOOPS; ++i )
+	{
+		m_partialOk[i] = false;
+	}
+
+	m_timer.setInterval( TELEMETRY_POLL_INTERVAL );
+	connect( &m_timer, SIGNAL( timeout() ), this, SLOT( poll() ) );
+}
+
+
+
+
+TelemetryPoller::~TelemetryPoller()
+{
+	if( m_worker )
+	{
+		disconnect( m_worker, 0, this, 0 );
+	}
+}
+
+
+
+// regs are the float registers, in TelemetryValue order
+void TelemetryPoller::setTarget( LoopWorker * worker, int pipe, int slave, const REGISTER_DEF * const regs[TelemetryValues] )
+{
+	if( m_worker )
+	{
+		disconnect( m_worker, SIGNAL( responded( LOOP_RESPONSE ) ), this, SLOT( onResponse( LOOP_RESPONSE ) ) );
+	}
+
+	m_lastId.storeRelease( 0 );
+	m_worker = worker;
+	m_slave = slave;
+	m_pipe.storeRelease( pipe );
+	m_blocks.clear();
+
+	for( int i = 0; i < TelemetryValues; ++i )
+	{
+		m_regs[i].storeRelease( regs[i] );
+	}
+
+	foreach( const REGISTER_SPAN & span, RegisterMap::planReads( regs, TelemetryValues ) )
+	{
+		LOOP_REQUEST request = LoopWorker::readRequest( slave, MODBUS_FC_READ_INPUT_REGISTERS,
+												span.addr - 1, span.num, LoopWorker::RawValue );
+		request.repeated = true;
+		m_blocks.append( request );
+	}
+
+	if( m_worker == NULL )
+	{
+		m_timer.stop();
+		return;
+	}
+
+	// runs in the loop thread, straight after the transaction
+	connect( m_worker, SIGNAL( responded( LOOP_RESPONSE ) ),
+				this, SLOT( onResponse( LOOP_RESPONSE ) ), Qt::DirectConnection );
+
+	m_timer.start();
+}
+
+
+
+void TelemetryPoller::setPollInterval( int msec )
+{
+	m_timer.setInterval( msec );
+}
+
+
+
+void TelemetryPoller::poll()
+{
+	// the previous poll is still on the bus, skip this one
+	if( m_worker == NULL || m_blocks.isEmpty() || m_lastId.loadAcquire() != 0 || !m_worker->isConfigured() )
+	{
+		return;
+	}
+
+	const int loop = m_worker->loop();
+	if( loop < 0 || loop >= TELEMETRY_LOOPS )
+	{
+		return;
+	}
+
+	// publish the ids before the first response can come back
+	const int first = m_worker->reserveIds( m_blocks.size() );
+	m_firstId.storeRelease( first );
+	m_lastId.storeRelease( first + m_blocks.size() - 1 );
+
+	for( int i = 0; i < m_blocks.size(); ++i )
+	{
+		LOOP_REQUEST request = m_blocks[i];
+		request.id = first + i;
+		m_worker->submit( request );
+	}
+}
+
+
+
+void TelemetryPoller::onResponse( const LOOP_RESPONSE & response )
+{
+	const int lastId = m_lastId.loadAcquire();
+	const int firstId = m_firstId.loadAcquire();
+
+	if( lastId == 0 || response.id < firstId || response.id > lastId ||
+		response.loop < 0 || response.loop >= TELEMETRY_LOOPS )
+	{
+		return;
+	}
+
+	TELEMETRY_SAMPLE & sample = m_partial[response.loop];
+
+	// first block of the poll
+	if( response.id == firstId )
+	{
+		m_partialOk[response.loop] = true;
+	}
+
+	if( response.ret != response.num )
+	{
+		m_partialOk[response.loop] = false;
+	}
+	else
+	{
+		for( int i = 0; i < TelemetryValues; ++i )
+		{
+			const REGISTER_DEF * reg = m_regs[i].loadAcquire();
+			const int offset = reg->addr - 1 - response.addr;
+
+			if( offset >= 0 && offset + 1 < response.regs.size() )
+			{
+				sample.values[i] = reg->scale *
+						modbus_get_float_ordered( response.regs.constData() + offset, reg->order );
+			}
+		}
+	}
+
+	if( response.id != lastId )
+	{
+		return;
+	}
+
+	if( m_partialOk[response.loop] )
+	{
+		sample.pipe = m_pipe.loadAcquire();
+		sample.msecs = QDateTime::currentMSecsSinceEpoch();
+		m_latest.publish( sample );
+	}
+
+	m_lastId.testAndSetOrdered( lastId, 0 );
+}
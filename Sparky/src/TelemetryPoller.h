@@ -0,0 +1,126 @@
+/*
+ * TelemetryPoller.h - header file for TelemetryPoller class
+ *
+ * Reads the live values of the selected pipe in the background and keeps
+ * the latest complete sample in a lock-free slot. The gauges pick it up at
+ * their own refresh rate, so a slow bus never holds up painting and fast
+ * polling never floods the GUI with events.
+ */
+
+#ifndef _TELEMETRY_POLLER_H
+#define _TELEMETRY_POLLER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QPointer>
+
+#include "LoopWorker.h"
+#include "RegisterMap.h"
+
+#define TELEMETRY_LOOPS         6
+#define TELEMETRY_POLL_INTERVAL 250     // ms between two reads of the pipe
+
+
+enum TelemetryValue
+{
+	TelemetryFrequency,
+	TelemetryTemperature,
+	TelemetryDensity,
+	TelemetryRP,
+	TelemetryValues
+} ;
+
+typedef struct telemetry_sample
+{
+    int pipe;
+    float values[TelemetryValues];
+    qint64 msecs;               // when the last block of the sample arrived
+
+} TELEMETRY_SAMPLE;
+
+
+/// single producer, single consumer slot holding the newest value
+///
+/// Three buffers rotate: the producer fills its own, then swaps it with
+/// the middle one and flags it fresh; the consumer swaps the middle one
+/// with its own only when it is fresh. Neither side ever waits.
+template <typename T>
+class LatestValue
+{
+public:
+	LatestValue() : m_back( 0 ), m_middle( 1 ), m_front( 2 ) { }
+
+	void publish( const T & value )
+	{
+		m_slots[m_back] = value;
+		m_back = m_middle.fetchAndStoreOrdered( m_back | Fresh ) & ~Fresh;
+	}
+
+	bool consume( T & value )
+	{
+		if( !( m_middle.loadAcquire() & Fresh ) )
+		{
+			return false;
+		}
+
+		m_front = m_middle.fetchAndStoreOrdered( m_front ) & ~Fresh;
+		value = m_slots[m_front];
+
+		return true;
+	}
+
+
+private:
+	enum { Fresh = 4 };
+
+	T m_slots[3];
+	int m_back;                 // producer side only
+	QAtomicInt m_middle;
+	int m_front;                // consumer side only
+
+} ;
+
+
+class TelemetryPoller : public QObject
+{
+	Q_OBJECT
+public:
+	TelemetryPoller( QObject * parent = 0 );
+	~TelemetryPoller();
+
+	void setTarget( LoopWorker * worker, int pipe, int slave, const REGISTER_DEF * const regs[TelemetryValues] );
+	void setPollInterval( int msec );
+
+	bool latest( TELEMETRY_SAMPLE & sample ) { return m_latest.consume( sample ); }
+
+
+private slots:
+	void poll();
+	void onResponse( const LOOP_RESPONSE & response );
+
+
+private:
+	QTimer m_timer;
+	QPointer<LoopWorker> m_worker;
+	int m_slave;
+	QVector<LOOP_REQUEST> m_blocks;
+
+	// shared with the loop thread that runs onResponse()
+	QAtomicInt m_pipe;
+	QAtomicPointer<const REGISTER_DEF> m_regs[TelemetryValues];
+	QAtomicInt m_firstId;       // ids of the blocks of the poll in flight
+	QAtomicInt m_lastId;        // 0 when idle
+
+	// the sample being gathered, only touched by the thread of its loop
+	TELEMETRY_SAMPLE m_partial[TELEMETRY_LOOPS];
+	bool m_partialOk[TELEMETRY_LOOPS];
+
+	LatestValue<TELEMETRY_SAMPLE> m_latest;
+
+} ;
+
+
+#endif // _TELEMETRY_POLLER_H
@@ -32,18 +32,18 @@
 #include <QWidget>
 #include <QMainWindow>
 #include <QTimer>
-#include <QThread>
-
-class I : public QThread
-{
-public:
-        static void sleep(unsigned long secs) {
-                QThread::sleep(secs);
-        }
-};
+#include <QElapsedTimer>
 
 MainWindow * globalMainWin = NULL;
 
+static QElapsedTimer startupTimer;
+
+/// milestones of the start in ms, a slower start shows up here first
+void startupTrace( const QString & step )
+{
+    qDebug( "startup: %6lld ms  %s", startupTimer.elapsed(), qPrintable( step ) );
+}
+
 int main(int argc, char *argv[])
 {
     static int const RESTART_CODE = 1000;
@@ -53,6 +53,8 @@ int main(int argc, char *argv[])
    QWidget * top = 0;
  
     do {
+           startupTimer.start();
+
            QApplication a(argc, argv);
 
            QPixmap pixmap(":/splash.png"); //Insert your splash page image here
@@ -60,7 +62,8 @@ int main(int argc, char *argv[])
            splash.show();
 
            splash.showMessage(QObject::tr("Loading... please wait...\n\n\n\n\n\n"),Qt::AlignCenter | Qt::AlignBottom, Qt::black);  //This line represents the alignment of text, color and position
-           I::sleep(1);
+           a.processEvents();  // paint it, the window follows right away
+           startupTrace("splash shown");
            MainWindow w;
     
         //   QScrollArea* scroller = new QScrollArea;
@@ -68,6 +71,7 @@ int main(int argc, char *argv[])
         //   top = scroller;
 
            w.show();
+           startupTrace("window shown");
            //top->show();
            globalMainWin = &w;
            
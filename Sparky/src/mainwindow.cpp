@@ -9,6 +9,9 @@
 #include <errno.h>
 #include <QListWidget>
 #include <QProgressDialog>
+#include <QCloseEvent>
+#include <QTabBar>
+#include <algorithm>
 #include "mainwindow.h"
 #include "BatchProcessor.h"
 #include "modbus.h"
@@ -33,6 +36,9 @@
 #define INT_W               3
 #define COIL_R              4
 #define COIL_W              5
+#define RESTART_PROBE_COIL  999
+#define RESTART_POLL_MS     100
+#define RESTART_GRACE_MS    3000
 
 
 QT_CHARTS_USE_NAMESPACE
@@ -42,6 +48,7 @@ const int AddrColumn = 1;
 const int DataColumn = 2;
 
 extern MainWindow * globalMainWin;
+extern void startupTrace( const QString & step );
 
 MainWindow::MainWindow( QWidget * _parent ) :
 	QMainWindow( _parent ),
@@ -52,7 +59,6 @@ MainWindow::MainWindow( QWidget * _parent ) :
     m_modbus_4( NULL ),
     m_modbus_5( NULL ),
     m_modbus_6( NULL ),
-    m_modbus_snipping( NULL ),
     m_serialModbus( NULL ),
     m_serialModbus_2( NULL ),
     m_serialModbus_3( NULL ),
@@ -60,23 +66,91 @@ MainWindow::MainWindow( QWidget * _parent ) :
     m_serialModbus_5( NULL ),
     m_serialModbus_6( NULL ),
 	m_poll(false),
+	m_busy(0),
 	isModbusTransmissionFailed(false)
 {
 	ui->setupUi(this);
+    startupTrace("form built");
+
+    /// the chart is built when its tab is first shown
+    chart = NULL;
+
+    /// one worker thread per loop, created before any port gets opened
+    for (int i = 0; i < MAX_LOOP; i++)
+    {
+        m_loopThread[i] = new QThread(this);
+        m_loopWorker[i] = new LoopWorker(i);
+        m_loopWorker[i]->moveToThread(m_loopThread[i]);
+        connect(m_loopThread[i], SIGNAL(finished()), m_loopWorker[i], SLOT(deleteLater()));
+        connect(m_loopWorker[i], SIGNAL(opened(int,int,bool,int)), this, SLOT(onPortOpened(int,int,bool,int)));
+        connect(m_loopWorker[i], SIGNAL(lost(int,void*,int)), this, SLOT(onPortLost(int,void*,int)));
+        m_loopThread[i]->start();
+        m_openId[i] = 0;
+    }
+
+    /// samples the running calibrations of all loops
+    m_calibration = new CalibrationOrchestrator(m_loopWorker, this);
+    connect(m_calibration, SIGNAL(failed(int,int,int)), this, SLOT(onCalibrationFailed(int,int,int)));
+
+    /// finds the analyzers of all loops at once
+    m_discovery = new DiscoveryEngine(m_loopWorker, this);
+    m_discoveredDevices = 0;
+    connect(m_discovery, SIGNAL(found(DISCOVERY_DEVICE)), this, SLOT(onDeviceDiscovered(DISCOVERY_DEVICE)));
+    connect(m_discovery, SIGNAL(progress(int,int)), this, SLOT(onDiscoveryProgress(int,int)));
+    connect(m_discovery, SIGNAL(finished(int,int,int)), this, SLOT(onDiscoveryFinished(int,int,int)));
+
+    /// serial ports enumerated once for the six loops, kept up to date
+    m_portInventory = new PortInventory(this);
+    connect(m_portInventory, SIGNAL(changed()), this, SLOT(onPortsChanged()));
+
+    /// live values of the selected pipe, polled and painted at their own pace
+    memset(&m_gaugeSample, 0, sizeof(m_gaugeSample));
+    m_gaugeSample.pipe = -1;
+    m_telemetry = new TelemetryPoller(this);
+    /// updateTelemetryTarget() may pick any pipe, each needs its registers
+    for (int i = 0; i < MAX_PIPE; i++) updateRegisters(EEA,i); // EEA until a pipe is started
+    m_gaugeTimer = new QTimer(this);
+    connect(m_gaugeTimer, SIGNAL(timeout()), this, SLOT(refreshGauges()));
+    m_gaugeTimer->start(GAUGE_REFRESH_INTERVAL);
+    for (int i = 0; i < MAX_PIPE; i++)
+    {
+        connect(pipeSerialNumber(i), SIGNAL(editingFinished()), this, SLOT(updateTelemetryTarget()));
+    }
+
+    /// bounded monitors, the views only render the rows on screen
+    m_busMonitor = new BusMonitorModel(this);
+    ui->busMonTable->setModel(m_busMonitor);
+    connect(m_busMonitor, SIGNAL(rowsInserted(QModelIndex,int,int)), ui->busMonTable, SLOT(scrollToBottom()));
+
+    m_rawMonitor = new RawDataModel(this);
+    ui->rawData->setModel(m_rawMonitor);
+    connect(m_rawMonitor, SIGNAL(rowsInserted(QModelIndex,int,int)), ui->rawData, SLOT(scrollToBottom()));
+
+    m_profile = new ProfileModel(this);
+    ui->tableWidget->setModel(m_profile);
 
     /// versioning
     setWindowTitle(SPARKY);
 
-    updateRegisters(EEA,0); // L1-P1-EEA
     initializeToolbarIcons();
     initializeGauges();
+    startupTrace("gauges built");
     initializeTabIcons();
     updateRegisterView();
     updateRequestPreview();
     enableHexView();
+
+    /// the six ports open side by side in their loop threads
     setupModbusPorts();
+    m_startupOpens = 0;
+    for (int i = 0; i < MAX_LOOP; i++)
+    {
+        m_startupOpenId[i] = m_openId[i];
+        if (m_openId[i]) m_startupOpens++;
+    }
+    startupTrace("ports opening");
+
     onLoopTabChanged(0);
-    updateGraph();
     initializeModbusMonitor();
 
     ui->regTable->setColumnWidth( 0, 150 );
@@ -112,16 +186,68 @@ MainWindow::~MainWindow()
     releaseSerialModbus_5();
     releaseSerialModbus_6();
 
+    for (int i = 0; i < MAX_LOOP; i++)
+    {
+        m_loopThread[i]->quit();
+        m_loopThread[i]->wait();
+    }
+
 	delete ui;
 }
 
+bool
+MainWindow::
+waitForDeviceRestart(LoopWorker * worker, const QVector<int> & slaves, const int timeoutSec)
+{
+    BusyGuard busy(this);
+
+    if (!worker->isConfigured()) return false;
+
+    m_statusText->setText( tr( "Device restarting..." ) );
+    m_statusInd->setStyleSheet( "background: #fb0;" );
+
+    /// the devices acknowledge the restart first, wait until they drop off
+    /// the bus and all answer again instead of sleeping a fixed time
+    RestartWaiter waiter(worker, LoopWorker::readRequest(0, MODBUS_FC_READ_COILS,
+            RESTART_PROBE_COIL-1, 1, LoopWorker::CoilValue), slaves);
+    const bool isUp = waiter.wait(timeoutSec*1000, RESTART_GRACE_MS, RESTART_POLL_MS);
+
+    resetStatus();
+
+    return isUp;
+}
+
+
+/// The sequential flows wait for their answers in a local event loop, so
+/// the GUI keeps running under them. Meanwhile nothing may start another
+/// flow, switch the loop they talk to or close the window.
+void
+MainWindow::
+setBusy(const bool isBusy)
+{
+    m_busy += isBusy ? 1 : -1;
+    if (m_busy > (isBusy ? 1 : 0)) return;
+
+    /// the containers, their buttons keep their own enabled state
+    ui->groupBox_2->setEnabled(!isBusy);            // send request
+    ui->tab_29->setEnabled(!isBusy);                // profile and factory defaults
+    ui->tabWidget_2->tabBar()->setEnabled(!isBusy); // loop tabs
+    ui->toolBar->setEnabled(!isBusy);
+}
+
+
 void
 MainWindow::
-delay(int sec = 2)
+closeEvent(QCloseEvent * event)
 {
-    QTime dieTime= QTime::currentTime().addSecs(sec);
-    while (QTime::currentTime() < dieTime)
-    QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    if (m_busy > 0)
+    {
+        setStatusError( tr("Wait for the transfer to finish.") );
+        event->ignore();
+        return;
+    }
+
+    QMainWindow::closeEvent(event);
 }
 
 
@@ -144,6 +270,7 @@ initializeToolbarIcons() {
     //ui->toolBar->addAction(ui->actionDisconnect);
     ui->toolBar->addAction(ui->actionOpen);
     ui->toolBar->addAction(ui->actionSave);
+    ui->toolBar->addAction(ui->actionDiscover);
     ui->actionDisconnect->setDisabled(TRUE);
     ui->actionConnect->setEnabled(TRUE);
 }
@@ -200,84 +327,47 @@ void MainWindow::busMonitorAddItem( bool isRequest,
 					uint16_t expectedCRC,
 					uint16_t actualCRC )
 {
-	QTableWidget * bm = ui->busMonTable;
-	const int rowCount = bm->rowCount();
-	bm->setRowCount( rowCount+1 );
+	Q_UNUSED( nb );
 
-    QTableWidgetItem * numItem;
-	QTableWidgetItem * ioItem = new QTableWidgetItem( isRequest ? tr( "Req >>" ) : tr( "<< Resp" ) );
-	QTableWidgetItem * slaveItem = new QTableWidgetItem( QString::number( slave ) );
-	QTableWidgetItem * funcItem = new QTableWidgetItem( QString::number( func ) );
-	QTableWidgetItem * addrItem = new QTableWidgetItem( QString::number( addr ) );
-    (ui->radioButton_181->isChecked()) ?numItem  = new QTableWidgetItem( QString::number( 2 ) ) : numItem = new QTableWidgetItem( QString::number( 1 ) );
-	QTableWidgetItem * crcItem = new QTableWidgetItem;
+	BUS_MONITOR_FRAME frame;
+	frame.isRequest = isRequest;
+	frame.slave = slave;
+	frame.func = func;
+	frame.addr = addr;
+	frame.num = ui->radioButton_181->isChecked() ? 2 : 1;
+	frame.expectedCRC = expectedCRC;
+	frame.actualCRC = actualCRC;
 
-	if( func > 127 )
-	{
-		addrItem->setText( QString() );
-		numItem->setText( QString() );
-		funcItem->setText( tr( "Exception (%1)" ).arg( func-128 ) );
-		funcItem->setForeground( Qt::red );
-	}
-	else
-	{
-		if( expectedCRC == actualCRC )
-		{
-			crcItem->setText( QString().sprintf( "%.4x", actualCRC ) );
-		}
-		else
-		{
-			crcItem->setText( QString().sprintf( "%.4x (%.4x)", actualCRC, expectedCRC ) );
-			crcItem->setForeground( Qt::red );
-		}
-	}
-	ioItem->setFlags( ioItem->flags() & ~Qt::ItemIsEditable );
-	slaveItem->setFlags( slaveItem->flags() & ~Qt::ItemIsEditable );
-	funcItem->setFlags( funcItem->flags() & ~Qt::ItemIsEditable );
-	addrItem->setFlags( addrItem->flags() & ~Qt::ItemIsEditable );
-	numItem->setFlags( numItem->flags() & ~Qt::ItemIsEditable );
-	crcItem->setFlags( crcItem->flags() & ~Qt::ItemIsEditable );
-	bm->setItem( rowCount, 0, ioItem );
-	bm->setItem( rowCount, 1, slaveItem );
-    bm->setItem( rowCount, 2, funcItem );
-	bm->setItem( rowCount, 3, addrItem );
-	bm->setItem( rowCount, 4, numItem );
-	bm->setItem( rowCount, 5, crcItem );
-	bm->verticalScrollBar()->setValue( bm->verticalScrollBar()->maximum() );
+	m_busMonitor->addFrame( frame );
 }
 
 
-void MainWindow::busMonitorRawData( uint8_t * data, uint8_t dataLen, bool addNewline )
-{
-	if( dataLen > 0 )
-	{
-		QString dump = ui->rawData->toPlainText();
-		for( int i = 0; i < dataLen; ++i )
-		{
-			dump += QString().sprintf( "%.2x ", data[i] );
-		}
-		if( addNewline )
-		{
-			dump += "\n";
-		}
-		ui->rawData->setPlainText( dump );
-		ui->rawData->verticalScrollBar()->setValue( 100000 );
-		ui->rawData->setLineWrapMode( QPlainTextEdit::NoWrap );
-	}
-}
-
 // static
+// called from the loop threads, the monitor widgets are updated on the GUI thread
 void MainWindow::stBusMonitorAddItem( modbus_t * modbus, uint8_t isRequest, uint16_t slave, uint8_t func, uint16_t addr, uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC )
 {
     Q_UNUSED(modbus);
-    globalMainWin->busMonitorAddItem( isRequest, slave, func, addr+1, nb, expectedCRC, actualCRC );
+    QMetaObject::invokeMethod( globalMainWin, "onBusMonitorItem", Qt::AutoConnection,
+                               Q_ARG( bool, isRequest != 0 ), Q_ARG( int, slave ), Q_ARG( int, func ), Q_ARG( int, addr+1 ),
+                               Q_ARG( int, nb ), Q_ARG( int, expectedCRC ), Q_ARG( int, actualCRC ) );
 }
 
 // static
 void MainWindow::stBusMonitorRawData( modbus_t * modbus, uint8_t * data, uint8_t dataLen, uint8_t addNewline )
 {
     Q_UNUSED(modbus);
-    globalMainWin->busMonitorRawData( data, dataLen, addNewline != 0 );
+    QMetaObject::invokeMethod( globalMainWin, "onBusMonitorRawData", Qt::AutoConnection,
+                               Q_ARG( QByteArray, QByteArray( (const char *) data, dataLen ) ), Q_ARG( bool, addNewline != 0 ) );
+}
+
+void MainWindow::onBusMonitorItem( bool isRequest, int slave, int func, int addr, int nb, int expectedCRC, int actualCRC )
+{
+    busMonitorAddItem( isRequest, slave, func, addr, nb, expectedCRC, actualCRC );
+}
+
+void MainWindow::onBusMonitorRawData( const QByteArray & data, bool addNewline )
+{
+    m_rawMonitor->addData( data, addNewline );
 }
 
 static QString descriptiveDataTypeName( int funcCode )
@@ -401,15 +491,16 @@ void MainWindow::enableHexView( void )
 
 void MainWindow::sendModbusRequest( void )
 {
-    // UPDATE m_modbus_snipping WITH THE CURRENT
-    if (ui->tabWidget_2->currentIndex() == 0)      m_modbus_snipping = m_modbus;
-    else if (ui->tabWidget_2->currentIndex() == 1) m_modbus_snipping = m_modbus_2;
-    else if (ui->tabWidget_2->currentIndex() == 2) m_modbus_snipping = m_modbus_3;
-    else if (ui->tabWidget_2->currentIndex() == 3) m_modbus_snipping = m_modbus_4;
-    else if (ui->tabWidget_2->currentIndex() == 4) m_modbus_snipping = m_modbus_5;
-    else                                           m_modbus_snipping = m_modbus_6;
+	// a poll tick while a flow waits for its answer would run inside it
+	if( m_busy > 0 && sender() == m_pollTimer )
+	{
+		return;
+	}
+
+	BusyGuard busy( this );
+    LoopWorker * worker = currentLoopWorker();
 
-	if( m_modbus_snipping == NULL )
+	if( !worker->isConfigured() )
 	{
 		setStatusError( tr("Not configured!") );
 		return;
@@ -419,52 +510,37 @@ void MainWindow::sendModbusRequest( void )
 	const int func = stringToHex(embracedString(ui->functionCode->currentText()));
 	const int addr = ui->startAddr->value()-1;
 	int num = ui->numCoils->value();
-	uint8_t dest[1024];
-	uint16_t * dest16 = (uint16_t *) dest;
 
-	memset( dest, 0, 1024 );
-
-	int ret = -1;
 	bool is16Bit = false;
 	bool writeAccess = false;
 	const QString funcType = descriptiveDataTypeName( func );
 
-	modbus_set_slave( m_modbus_snipping, slave );
+	LOOP_REQUEST request = LoopWorker::readRequest( slave, func, addr, num, LoopWorker::RawValue );
 
 	switch( func )
 	{
 		case MODBUS_FC_READ_COILS:
-			ret = modbus_read_bits( m_modbus_snipping, addr, num, dest );
-			break;
 		case MODBUS_FC_READ_DISCRETE_INPUTS:
-			ret = modbus_read_input_bits( m_modbus_snipping, addr, num, dest );
 			break;
 		case MODBUS_FC_READ_HOLDING_REGISTERS:
-			ret = modbus_read_registers( m_modbus_snipping, addr, num, dest16 );
-			is16Bit = true;
-			break;
 		case MODBUS_FC_READ_INPUT_REGISTERS:
-			ret = modbus_read_input_registers(m_modbus_snipping, addr, num, dest16 );
 			is16Bit = true;
 			break;
 		case MODBUS_FC_WRITE_SINGLE_COIL:
-            //ret = modbus_write_bit( m_modbus_snipping, addr,ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) ? 1 : 0 );
-            ret = modbus_write_bit( m_modbus_snipping, addr,ui->radioButton_184->isChecked() ? 1 : 0 );
+            //request.data.append( ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) ? 1 : 0 );
+            request.data.append( ui->radioButton_184->isChecked() ? 1 : 0 );
 			writeAccess = true;
 			num = 1;
 			break;
 		case MODBUS_FC_WRITE_SINGLE_REGISTER:
-            //ret = modbus_write_register( m_modbus_snipping, addr,ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) );
-            ret = modbus_write_register( m_modbus_snipping, addr,ui->lineEdit_111->text().toInt(0, 0) );
+            //request.data.append( ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) );
+            request.data.append( ui->lineEdit_111->text().toInt(0, 0) );
 			writeAccess = true;
 			num = 1;
 			break;
 		case MODBUS_FC_WRITE_MULTIPLE_COILS:
 		{
-			uint8_t * data = new uint8_t[num];
-			for( int i = 0; i < num; ++i ) data[i] = ui->regTable->item( i, DataColumn )->text().toInt(0, 0);
-			ret = modbus_write_bits( m_modbus_snipping, addr, num, data );
-			delete[] data;
+			for( int i = 0; i < num; ++i ) request.data.append( ui->regTable->item( i, DataColumn )->text().toInt(0, 0) );
 			writeAccess = true;
 			break;
 		}
@@ -474,12 +550,10 @@ void MainWindow::sendModbusRequest( void )
             QString qvalue = ui->lineEdit_109->text();
             QTextStream floatTextStream(&qvalue);
             floatTextStream >> value;
-            quint16 (*reg)[2] = reinterpret_cast<quint16(*)[2]>(&value);
-            uint16_t * data = new uint16_t[2];            
-            data[0] = (*reg)[1];
-            data[1] = (*reg)[0];
-            ret = modbus_write_registers( m_modbus_snipping, addr, 2, data );
-			delete[] data;
+            uint16_t reg[2];
+            modbus_set_float_ordered( value, reg, DEVICE_FLOAT_ORDER );
+            request.data.append( reg[0] );
+            request.data.append( reg[1] );
 			writeAccess = true;
 			break;
 		}
@@ -487,6 +561,10 @@ void MainWindow::sendModbusRequest( void )
 			break;
 	}
 
+	/// the transaction runs on the loop thread, the GUI keeps going meanwhile
+	const LOOP_RESPONSE response = worker->execute( request );
+	const int ret = response.ret;
+
 	if( ret == num  )
 	{
 		isModbusTransmissionFailed = false;
@@ -500,21 +578,15 @@ void MainWindow::sendModbusRequest( void )
         else
 		{
 			bool b_hex = is16Bit && ui->checkBoxHexData->checkState() == Qt::Checked;
-			QString qs_num;
-            QString qs_output = "0x";
-            bool ok = false;
 
 			ui->regTable->setRowCount( num );
 			for( int i = 0; i < num; ++i )
 			{
-				int data = is16Bit ? dest16[i] : dest[i];
-                QString qs_tmp;
+				int data = response.regs.value( i );
+				const QString qs_num = b_hex ? QString( "0x%1" ).arg( data, 4, 16, QChar( '0' ) ) : QString::number( data );
 
 				QTableWidgetItem * dtItem = new QTableWidgetItem( funcType );
 				QTableWidgetItem * addrItem = new QTableWidgetItem(QString::number( ui->startAddr->value()+i ) );
-				qs_num.sprintf( b_hex ? "0x%04x" : "%d", data);
-				qs_tmp.sprintf("%04x", data);
-                qs_output.append(qs_tmp);
 				QTableWidgetItem * dataItem = new QTableWidgetItem( qs_num );
 				dtItem->setFlags( dtItem->flags() & ~Qt::ItemIsEditable );
 				addrItem->setFlags( addrItem->flags() & ~Qt::ItemIsEditable );
@@ -529,51 +601,25 @@ void MainWindow::sendModbusRequest( void )
                 }
             }
 
-            QByteArray array = QByteArray::fromHex(qs_output.toLatin1());
-            const float d = toFloat(array);
-
-            if (ui->radioButton_181->isChecked())
+            if (ui->radioButton_181->isChecked() && response.regs.size() >= 2)
             {
-                (b_hex) ? ui->lineEdit_109->setText(qs_output) : ui->lineEdit_109->setText(QString::number(d,'f',10)) ;
+                if (b_hex)
+                {
+                    QString qs_output = "0x";
+                    for (int i = 0; i < response.regs.size(); ++i) qs_output += QString::number(response.regs[i], 16).rightJustified(4, '0');
+                    ui->lineEdit_109->setText(qs_output);
+                }
+                else
+                {
+                    const float d = modbus_get_float_ordered(response.regs.constData(), DEVICE_FLOAT_ORDER);
+                    ui->lineEdit_109->setText(QString::number(d,'f',10));
+                }
             }
 		}
 	}
 	else
 	{
-		QString err;
-
-		if( ret < 0 )
-		{
-			if(
-#ifdef WIN32
-					errno == WSAETIMEDOUT ||
-#endif
-					errno == EIO
-																	)
-			{
-				err += tr( "I/O error" );
-				err += ": ";
-				err += tr( "did not receive any data from slave." );
-			}
-			else
-			{
-				err += tr( "Protocol error" );
-				err += ": ";
-				err += tr( "Slave threw exception '" );
-				err += modbus_strerror( errno );
-				err += tr( "' or function not implemented." );
-			}
-		}
-		else
-		{
-			err += tr( "Protocol error" );
-			err += ": ";
-			err += tr( "Number of registers returned does not "
-					"match number of registers requested!" );
-		}
-
-		if( err.size() > 0 )
-			setStatusError( err );
+		setStatusError( modbusErrorText( ret, response.error ) );
 
 		isModbusTransmissionFailed = true;
 	}
@@ -586,18 +632,9 @@ void MainWindow::resetStatus( void )
 	m_statusInd->setStyleSheet( "background: #aaa;" );
 }
 
-void MainWindow::pollForDataOnBus( void )
-{
-	if( m_modbus )
-	{
-		modbus_poll( m_modbus );
-	}
-}
-
-
 void MainWindow::openBatchProcessor()
 {
-	BatchProcessor( this, m_modbus ).exec();
+	BatchProcessor( this, m_loopWorker[0] ).exec();
 }
 
 
@@ -614,9 +651,11 @@ void MainWindow::onRtuPortActive(bool active)
 			modbus_register_monitor_add_item_fnc(m_modbus, MainWindow::stBusMonitorAddItem);
 			modbus_register_monitor_raw_data_fnc(m_modbus, MainWindow::stBusMonitorRawData);
 		}
+        m_loopWorker[0]->setModbus( m_modbus );
 	}
 	else {
 		m_modbus = NULL;
+		m_loopWorker[0]->setModbus( m_modbus );
 	}
 }
 
@@ -628,9 +667,11 @@ void MainWindow::onRtuPortActive_2(bool active)
             modbus_register_monitor_add_item_fnc(m_modbus_2, MainWindow::stBusMonitorAddItem);
             modbus_register_monitor_raw_data_fnc(m_modbus_2, MainWindow::stBusMonitorRawData);
         }
+        m_loopWorker[1]->setModbus( m_modbus_2 );
     }
     else {
         m_modbus_2 = NULL;
+        m_loopWorker[1]->setModbus( m_modbus_2 );
     }
 }
 
@@ -642,9 +683,11 @@ void MainWindow::onRtuPortActive_3(bool active)
             modbus_register_monitor_add_item_fnc(m_modbus_3, MainWindow::stBusMonitorAddItem);
             modbus_register_monitor_raw_data_fnc(m_modbus_3, MainWindow::stBusMonitorRawData);
         }
+        m_loopWorker[2]->setModbus( m_modbus_3 );
     }
     else {
         m_modbus_3 = NULL;
+        m_loopWorker[2]->setModbus( m_modbus_3 );
     }
 }
 
@@ -656,9 +699,11 @@ void MainWindow::onRtuPortActive_4(bool active)
             modbus_register_monitor_add_item_fnc(m_modbus_4, MainWindow::stBusMonitorAddItem);
             modbus_register_monitor_raw_data_fnc(m_modbus_4, MainWindow::stBusMonitorRawData);
         }
+        m_loopWorker[3]->setModbus( m_modbus_4 );
     }
     else {
         m_modbus_4 = NULL;
+        m_loopWorker[3]->setModbus( m_modbus_4 );
     }
 }
 
@@ -670,9 +715,11 @@ void MainWindow::onRtuPortActive_5(bool active)
             modbus_register_monitor_add_item_fnc(m_modbus_5, MainWindow::stBusMonitorAddItem);
             modbus_register_monitor_raw_data_fnc(m_modbus_5, MainWindow::stBusMonitorRawData);
         }
+        m_loopWorker[4]->setModbus( m_modbus_5 );
     }
     else {
         m_modbus_5 = NULL;
+        m_loopWorker[4]->setModbus( m_modbus_5 );
     }
 }
 
@@ -684,9 +731,11 @@ void MainWindow::onRtuPortActive_6(bool active)
             modbus_register_monitor_add_item_fnc(m_modbus_6, MainWindow::stBusMonitorAddItem);
             modbus_register_monitor_raw_data_fnc(m_modbus_6, MainWindow::stBusMonitorRawData);
         }
+        m_loopWorker[5]->setModbus( m_modbus_6 );
     }
     else {
         m_modbus_6 = NULL;
+        m_loopWorker[5]->setModbus( m_modbus_6 );
     }
 }
 
@@ -704,6 +753,17 @@ void
 MainWindow::
 updateGraph()
 {
+    if (chart != NULL)
+    {
+        updateChartTitle();
+        return;
+    }
+
+    if (ui->tabWidget->currentWidget() != ui->tab_2)
+    {
+        return;
+    }
+
     chart = new QChart();
     chart->legend()->hide();
 
@@ -790,7 +850,9 @@ initializeFrequencyGauge()
 void
 MainWindow::
 updateFrequencyGauge()
-{}
+{
+    m_frequencyNeedle->setCurrentValue(m_gaugeSample.values[TelemetryFrequency]);
+}
 
 
 void
@@ -828,7 +890,9 @@ initializeTemperatureGauge()
 void
 MainWindow::
 updateTemperatureGauge()
-{}
+{
+    m_temperatureNeedle->setCurrentValue(m_gaugeSample.values[TelemetryTemperature]);
+}
 
 void
 MainWindow::
@@ -865,7 +929,9 @@ initializeDensityGauge()
 void
 MainWindow::
 updateDensityGauge()
-{}
+{
+    m_densityNeedle->setCurrentValue(m_gaugeSample.values[TelemetryDensity]);
+}
 
 void
 MainWindow::
@@ -902,7 +968,9 @@ initializeRPGauge()
 void
 MainWindow::
 updateRPGauge()
-{}
+{
+    m_RPNeedle->setCurrentValue(m_gaugeSample.values[TelemetryRP]);
+}
 
 /// L1P1
 void
@@ -2445,10 +2513,6 @@ void
 MainWindow::
 connectTimers()
 {
-    QTimer * t = new QTimer( this );
-    connect( t, SIGNAL(timeout()), this, SLOT(pollForDataOnBus()));
-    t->start( 5 );
-
     m_pollTimer = new QTimer( this );
     connect( m_pollTimer, SIGNAL(timeout()), this, SLOT(sendModbusRequest()));
 
@@ -2469,6 +2533,7 @@ connectLoopDependentData()
     connect(ui->tabWidget_6, SIGNAL(currentChanged(int)), this, SLOT(onLoopTabChanged(int)));
     connect(ui->tabWidget_7, SIGNAL(currentChanged(int)), this, SLOT(onLoopTabChanged(int)));
     connect(ui->tabWidget_8, SIGNAL(currentChanged(int)), this, SLOT(onLoopTabChanged(int)));
+    connect(ui->tabWidget, SIGNAL(currentChanged(int)), this, SLOT(updateGraph()));
 }
 
 
@@ -2801,6 +2866,7 @@ connectToolbar()
 {
     connect(ui->actionSave, SIGNAL(triggered()),this,SLOT(saveCsvFile()));
     connect(ui->actionOpen, SIGNAL(triggered()),this,SLOT(loadCsvFile()));
+    connect(ui->actionDiscover, SIGNAL(toggled(bool)),this,SLOT(onDiscoverChecked(bool)));
 }
 
 
@@ -2808,48 +2874,38 @@ void
 MainWindow::
 onEquationTableChecked(bool isTable)
 {
-    if (!isTable) ui->tableWidget->setRowCount(0);
+    if (!isTable) m_profile->clear();
 }
 
 
 QString
 MainWindow::
-sendCalibrationRequest(int dataType, modbus_t * serialModbus, int func, int addr, int num, int ret, uint8_t * dest, uint16_t * dest16, bool is16Bit, bool writeAccess, QString funcType)
+sendCalibrationRequest(int dataType, LoopWorker * worker, int slave, int func, int addr, int num, int ret, uint8_t * dest, uint16_t * dest16, bool is16Bit, bool writeAccess, QString funcType)
 {
+    LOOP_REQUEST request = LoopWorker::readRequest( slave, func, addr, num, LoopWorker::RawValue );
+
     switch( func )
     {
         case MODBUS_FC_READ_COILS:
-            ret = modbus_read_bits( serialModbus, addr, num, dest );
-            break;
         case MODBUS_FC_READ_DISCRETE_INPUTS:
-            ret = modbus_read_input_bits( serialModbus, addr, num, dest );
             break;
         case MODBUS_FC_READ_HOLDING_REGISTERS:
-            ret = modbus_read_registers( serialModbus, addr, num, dest16 );
-            is16Bit = true;
-            break;
         case MODBUS_FC_READ_INPUT_REGISTERS:
-            ret = modbus_read_input_registers(serialModbus, addr, num, dest16 );
             is16Bit = true;
             break;
         case MODBUS_FC_WRITE_SINGLE_COIL:
-            //ret = modbus_write_bit( m_modbus_snipping, addr,ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) ? 1 : 0 );
-            ret = modbus_write_bit( serialModbus, addr,ui->radioButton_184->isChecked() ? 1 : 0 );
+            request.data.append( ui->radioButton_184->isChecked() ? 1 : 0 );
             writeAccess = true;
             num = 1;
             break;
         case MODBUS_FC_WRITE_SINGLE_REGISTER:
-            //ret = modbus_write_register( m_modbus_snipping, addr,ui->regTable->item( 0, DataColumn )->text().toInt(0, 0) );
-            ret = modbus_write_register( serialModbus, addr,ui->lineEdit_111->text().toInt(0, 0) );
+            request.data.append( ui->lineEdit_111->text().toInt(0, 0) );
             writeAccess = true;
             num = 1;
             break;
         case MODBUS_FC_WRITE_MULTIPLE_COILS:
         {
-            uint8_t * data = new uint8_t[num];
-            for( int i = 0; i < num; ++i ) data[i] = ui->regTable->item( i, DataColumn )->text().toInt(0, 0);
-            ret = modbus_write_bits( serialModbus, addr, num, data );
-            delete[] data;
+            for( int i = 0; i < num; ++i ) request.data.append( ui->regTable->item( i, DataColumn )->text().toInt(0, 0) );
             writeAccess = true;
             break;
         }
@@ -2859,12 +2915,10 @@ sendCalibrationRequest(int dataType, modbus_t * serialModbus, int func, int addr
             QString qvalue = ui->lineEdit_109->text();
             QTextStream floatTextStream(&qvalue);
             floatTextStream >> value;
-            quint16 (*reg)[2] = reinterpret_cast<quint16(*)[2]>(&value);
-            uint16_t * data = new uint16_t[2];
-            data[0] = (*reg)[1];
-            data[1] = (*reg)[0];
-            ret = modbus_write_registers( serialModbus, addr, 2, data );
-            delete[] data;
+            uint16_t reg[2];
+            modbus_set_float_ordered( value, reg, DEVICE_FLOAT_ORDER );
+            request.data.append( reg[0] );
+            request.data.append( reg[1] );
             writeAccess = true;
             break;
         }
@@ -2872,6 +2926,14 @@ sendCalibrationRequest(int dataType, modbus_t * serialModbus, int func, int addr
             break;
     }
 
+    const LOOP_RESPONSE response = worker->execute( request );
+    ret = response.ret;
+    for( int i = 0; i < response.regs.size(); ++i )
+    {
+        if( is16Bit ) dest16[i] = response.regs[i];
+        else dest[i] = response.regs[i];
+    }
+
     if( ret == num  )
     {
         if( writeAccess )
@@ -2884,21 +2946,17 @@ sendCalibrationRequest(int dataType, modbus_t * serialModbus, int func, int addr
         {
             //bool b_hex = is16Bit && ui->checkBoxHexData->checkState() == Qt::Checked;
             QString qs_num;
-            QString qs_output = "0x";
             bool ok = false;
 
             ui->regTable->setRowCount( num );
             for( int i = 0; i < num; ++i )
             {
                 int data = is16Bit ? dest16[i] : dest[i];
-                QString qs_tmp;
 
                 //QTableWidgetItem * dtItem = new QTableWidgetItem( funcType );
                 //QTableWidgetItem * addrItem = new QTableWidgetItem(QString::number( ui->startAddr->value()+i ) );
                 //qs_num.sprintf( b_hex ? "0x%04x" : "%d", data);
-                qs_num.sprintf("%d", data);
-                qs_tmp.sprintf("%04x", data);
-                qs_output.append(qs_tmp);
+                qs_num = QString::number(data);
 
                 //QTableWidgetItem * dataItem = new QTableWidgetItem( qs_num );
                 //dtItem->setFlags( dtItem->flags() & ~Qt::ItemIsEditable );
@@ -2913,10 +2971,9 @@ sendCalibrationRequest(int dataType, modbus_t * serialModbus, int func, int addr
                 {
                     (data) ? ui->radioButton_184->setChecked(true) : ui->radioButton_185->setChecked(true);
                 }
-                if (dataType == FLOAT_R) // FLOAT_READ
+                if (dataType == FLOAT_R && num >= 2) // FLOAT_READ
                 {
-                    QByteArray array = QByteArray::fromHex(qs_output.toLatin1());
-                    const float d = toFloat(array);
+                    const float d = modbus_get_float_ordered(dest16, DEVICE_FLOAT_ORDER);
                     return QString::number(d,'f',6);
                 }
                 else if (dataType == INT_R)  // INT_READ
@@ -2932,279 +2989,331 @@ sendCalibrationRequest(int dataType, modbus_t * serialModbus, int func, int addr
     }
     else
     {
-        QString err;
-
-        if( ret < 0 )
-        {
-            if(
-#ifdef WIN32
-                    errno == WSAETIMEDOUT ||
-#endif
-                    errno == EIO
-                                                                    )
-            {
-                err += tr( "I/O error" );
-                err += ": ";
-                err += tr( "did not receive any data from slave." );
-            }
-            else
-            {
-                err += tr( "Protocol error" );
-                err += ": ";
-                err += tr( "Slave threw exception '" );
-                err += modbus_strerror( errno );
-                err += tr( "' or function not implemented." );
-            }
-        }
-        else
-        {
-            err += tr( "Protocol error" );
-            err += ": ";
-            err += tr( "Number of registers returned does not "
-                    "match number of registers requested!" );
-        }
-
-        if( err.size() > 0 )
-            setStatusError( err );
+        setStatusError( modbusErrorText( ret, response.error ) );
     }
+
+    return QString();
 }
 
 
-void
+LoopWorker *
 MainWindow::
-saveCsvFile()
+currentLoopWorker()
 {
-    QString fileName = QFileDialog::getSaveFileName(this,tr("Save Equation"), "",tr("CSV file (*.csv);;All Files (*)"));
+    return m_loopWorker[qBound(0, ui->tabWidget_2->currentIndex(), MAX_LOOP-1)];
+}
 
-    if (fileName.isEmpty()) return;
-    QFile file(fileName);
-    QTextStream out(&file);
 
-    if (!file.open(QIODevice::WriteOnly))
+static bool
+profileItemLessThan(const PROFILE_ITEM & a, const PROFILE_ITEM & b)
+{
+    return a.addr < b.addr;
+}
+
+
+QVector<REGISTER_BLOCK>
+MainWindow::
+planProfileBlocks(const bool isCoil, const bool isWrite, const int maxCount)
+{
+    QVector<PROFILE_ITEM> items;
+    QVector<REGISTER_BLOCK> blocks;
+
+    /// collect every value of the profile with its width on the wire
+    for (int i = 0; i < m_profile->rows(); i++)
     {
-        QMessageBox::information(this, tr("Unable to open file"),file.errorString());
-        return;
+        const ProfileType type = m_profile->type(i);
+        const int regAddr = m_profile->addr(i);
+        int width = 0;
+
+        if (isCoil)
+        {
+            if (type == ProfileBit) width = 1;
+        }
+        else if (type == ProfileFloat) width = 2;
+        else if (type == ProfileInt) width = 1;
+
+        if (width == 0 || regAddr <= 0) continue;
+        if (!(isWrite ? m_profile->isWritable(i) : m_profile->isReadable(i))) continue;
+
+        for (int x = 0; x < m_profile->valueCount(i); x++)
+        {
+            PROFILE_ITEM item;
+            item.row = i;
+            item.value = x;
+            item.addr = regAddr + x*width;
+            item.width = width;
+            item.readable = m_profile->isReadable(i);
+            items.append(item);
+        }
     }
 
-    for ( int i = 0; i < ui->tableWidget->rowCount(); i++ )
+    std::stable_sort(items.begin(), items.end(), profileItemLessThan);
+
+    /// merge back-to-back addresses, a block never exceeds maxCount
+    /// and never mixes write-only values with ones that can be verified
+    for (int i = 0; i < items.size(); i++)
     {
-        QString dataStream;
+        const PROFILE_ITEM & item = items[i];
 
-        for (int j=0; j < ui->tableWidget->item(i,6)->text().toInt()+7; j++)
+        if (blocks.isEmpty() ||
+            item.addr != blocks.last().addr + blocks.last().count ||
+            blocks.last().count + item.width > maxCount ||
+            blocks.last().items.last().readable != item.readable)
         {
-             dataStream.append(ui->tableWidget->item(i,j)->text()+",");
+            REGISTER_BLOCK block;
+            block.addr = item.addr;
+            block.count = 0;
+            blocks.append(block);
         }
 
-        out << dataStream << endl;
+        blocks.last().count += item.width;
+        blocks.last().items.append(item);
     }
 
-    file.close();
+    return blocks;
 }
 
 
-void
+QVector<quint16>
 MainWindow::
-loadCsvTemplate()
+packRegisterBlock(const REGISTER_BLOCK & block)
 {
-    int line = 0;
-    QFile file;
-    QString razorTemplatePath = QCoreApplication::applicationDirPath()+"/razor.csv";
-    QString eeaTemplatePath = QCoreApplication::applicationDirPath()+"/eea.csv";
-
-    if (ui->radioButton_190->isChecked()) // eea
-        file.setFileName(eeaTemplatePath);
-    else
-        file.setFileName(razorTemplatePath);
-
-    if (!file.open(QIODevice::ReadOnly)) return;
+    QVector<quint16> data(block.count);
 
-    QTextStream str(&file);
-
-    ui->tableWidget->clearContents();
-    ui->tableWidget->setRowCount(0);
-
-    while (!str.atEnd()) {
+    /// pack the values of the block, float is sent high word first (ABCD)
+    for (int x = 0; x < block.items.size(); x++)
+    {
+        const PROFILE_ITEM & item = block.items[x];
+        const int offset = item.addr - block.addr;
 
-        QString s = str.readLine();
-        if (s.size() == 0)
+        if (item.width == 2)
         {
-            file.close();
-            break;
+            modbus_set_float_ordered(m_profile->floatValue(item.row, item.value), data.data() + offset, DEVICE_FLOAT_ORDER);
         }
-        else {
-            line++;
-        }
-
-        // split data
-        QStringList valueList = s.split(',');
-
-        if (!valueList[0].contains("*"))
+        else
         {
-            // insert a new row
-            ui->tableWidget->insertRow( ui->tableWidget->rowCount() );
-
-            // insert columns
-            while (ui->tableWidget->columnCount() < valueList[6].toInt()+7)
-            {
-                ui->tableWidget->insertColumn(ui->tableWidget->columnCount());
-            }
-
-            // fill the data in the talbe cell
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 0, new QTableWidgetItem(valueList[0])); // Name
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 1, new QTableWidgetItem(valueList[1])); // Slave
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 2, new QTableWidgetItem(valueList[2])); // Address
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 3, new QTableWidgetItem(valueList[3])); // Type
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 4, new QTableWidgetItem(valueList[4])); // Scale
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 5, new QTableWidgetItem(valueList[5])); // RW
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 6, new QTableWidgetItem(valueList[6])); // Qty
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 7, new QTableWidgetItem(valueList[7])); // Value
-
-            // enable uploadEquationButton
-            ui->startEquationBtn->setEnabled(1);
+            data[offset] = m_profile->intValue(item.row, item.value);
         }
     }
 
-    // set column width
-    ui->tableWidget->setColumnWidth(0,120); // Name
-    ui->tableWidget->setColumnWidth(1,30);  // Slave
-    ui->tableWidget->setColumnWidth(2,50);  // Address
-    ui->tableWidget->setColumnWidth(3,40);  // Type
-    ui->tableWidget->setColumnWidth(4,30);  // Scale
-    ui->tableWidget->setColumnWidth(5,30);  // RW
-    ui->tableWidget->setColumnWidth(6,30);  // Qty
-
-    // close file
-    file.close();
+    return data;
 }
 
-void
+
+/// one coil of the profile upload, to the slave given, the broadcast
+/// address included, whatever the request form shows
+bool
 MainWindow::
-loadCsvFile()
+writeCoil(LoopWorker * worker, const int slave, const int addr, const bool value)
 {
-    int line = 0;
-
-    QString fileName = QFileDialog::getOpenFileName( this, tr("Open CSV file"), QDir::currentPath(), tr("CSV files (*.csv)") );
-    QFile file(fileName);
-
-    if (!file.open(QIODevice::ReadOnly)) return;
+    const LOOP_RESPONSE response = worker->execute(LoopWorker::writeRequest(slave, MODBUS_FC_WRITE_SINGLE_COIL, addr-1, QVector<quint16>(1, value ? 1 : 0)));
+    if (response.ret != 1)
+    {
+        setStatusError( modbusErrorText(response.ret, response.error) );
+        return false;
+    }
 
-    QTextStream str(&file);
+    return true;
+}
 
-    ui->tableWidget->clearContents();
-    ui->tableWidget->setRowCount(0);
 
-    while (!str.atEnd()) {
+bool
+MainWindow::
+writeRegisterBlock(LoopWorker * worker, const int slave, const REGISTER_BLOCK & block, QString & err)
+{
+    const LOOP_RESPONSE response = worker->execute(LoopWorker::writeRequest(slave, MODBUS_FC_WRITE_MULTIPLE_REGISTERS, block.addr-1, packRegisterBlock(block)));
+    if (response.ret != block.count)
+    {
+        err = modbusErrorText(response.ret, response.error);
+        return false;
+    }
 
-        QString s = str.readLine();
-        if (s.size() == 0)
-        {
-            file.close();
-            break;
-        }
-        else {
-            line++;
-        }
+    /// write-only registers can not be verified, nobody answers a broadcast
+    if (!block.items.first().readable || slave == MODBUS_BROADCAST_ADDRESS) return true;
 
-        QStringList valueList = s.split(',');
-        if (!valueList[0].contains("*"))
-        {
-            // insert a new row
-            ui->tableWidget->insertRow( ui->tableWidget->rowCount() );
+    return verifyRegisterBlock(worker, slave, block, err);
+}
 
-            // insert columns
-            while (ui->tableWidget->columnCount() < valueList[6].toInt()+7)
-            {
-                ui->tableWidget->insertColumn(ui->tableWidget->columnCount());
-            }
 
-            // fill the data in the talbe cell
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 0, new QTableWidgetItem(valueList[0])); // Name
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 1, new QTableWidgetItem(valueList[1])); // Slave
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 2, new QTableWidgetItem(valueList[2])); // Address
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 3, new QTableWidgetItem(valueList[3])); // Type
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 4, new QTableWidgetItem(valueList[4])); // Scale
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 5, new QTableWidgetItem(valueList[5])); // RW
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 6, new QTableWidgetItem(valueList[6])); // Qty
-            ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, 7, new QTableWidgetItem(valueList[7])); // Value
-
-            // fill the value list
-            for (int j = 0; j < valueList[6].toInt(); j++)
-            {
-                QString cellData = valueList[7+j];
-                if (valueList[3].contains("int")) cellData = cellData.mid(0, cellData.indexOf("."));
+bool
+MainWindow::
+verifyRegisterBlock(LoopWorker * worker, const int slave, const REGISTER_BLOCK & block, QString & err)
+{
+    const QVector<quint16> data = packRegisterBlock(block);
 
-                ui->tableWidget->setItem( ui->tableWidget->rowCount()-1, j+7, new QTableWidgetItem(cellData));
-            }
+    const LOOP_RESPONSE response = worker->execute(LoopWorker::readRequest(slave, MODBUS_FC_READ_INPUT_REGISTERS, block.addr-1, block.count, LoopWorker::RawValue));
+    if (response.ret != block.count)
+    {
+        err = modbusErrorText(response.ret, response.error);
+        return false;
+    }
 
-            // enable uploadEquationButton
-            ui->startEquationBtn->setEnabled(1);
+    for (int x = 0; x < block.count; x++)
+    {
+        if (response.regs[x] != data[x])
+        {
+            err = tr( "Verify error" );
+            err += ": ";
+            err += tr( "register %1 reads back 0x%2 instead of 0x%3." )
+                    .arg( block.addr + x )
+                    .arg( response.regs[x], 4, 16, QChar('0') )
+                    .arg( data[x], 4, 16, QChar('0') );
+            return false;
         }
     }
 
-    // set column width
-    ui->tableWidget->setColumnWidth(0,120); // Name
-    ui->tableWidget->setColumnWidth(1,30);  // Slave
-    ui->tableWidget->setColumnWidth(2,50);  // Address
-    ui->tableWidget->setColumnWidth(3,40);  // Type
-    ui->tableWidget->setColumnWidth(4,30);  // Scale
-    ui->tableWidget->setColumnWidth(5,30);  // RW
-    ui->tableWidget->setColumnWidth(6,30);  // Qty
-
-    // close file
-    file.close();
+    return true;
 }
 
-void
+
+QString
 MainWindow::
-onEquationButtonPressed()
+modbusErrorText(const int ret, const int errnum)
 {
-    ui->startEquationBtn->setEnabled(false);
-    ui->startEquationBtn->setText( tr("Loading") );
+    QString err;
 
-    if (ui->radioButton_188->isChecked())
+    if( ret < 0 )
     {
-        if( m_pollTimer->isActive() )
+        if(
+#ifdef WIN32
+                errnum == WSAETIMEDOUT ||
+#endif
+                errnum == EIO
+                                                                )
         {
-            m_pollTimer->stop();
-            ui->startEquationBtn->setText( tr("Loading") );
+            err += tr( "I/O error" );
+            err += ": ";
+            err += tr( "did not receive any data from slave." );
         }
         else
         {
-            // if polling requested then enable timer
-            if( m_poll )
-            {
-                m_pollTimer->start( 1000 );
-                ui->sendBtn->setText( tr("Loading") );
-            }
-
-            onUploadEquation();
+            err += tr( "Protocol error" );
+            err += ": ";
+            err += tr( "Slave threw exception '" );
+            err += modbus_strerror( errnum );
+            err += tr( "' or function not implemented." );
         }
     }
     else
     {
-        if( m_pollTimer->isActive() )
-        {
-            m_pollTimer->stop();
-            ui->startEquationBtn->setText( tr("Loading") );
-        }
-        else
-        {
-            // if polling requested then enable timer
-            if( m_poll )
-            {
-                m_pollTimer->start( 1000 );
-                ui->sendBtn->setText( tr("Loading") );
-            }
-        
-            ui->tableWidget->clearContents();
-            ui->tableWidget->setRowCount(0);
-
-            onDownloadEquation();
-        }
+        err += tr( "Protocol error" );
+        err += ": ";
+        err += tr( "Number of registers returned does not "
+                "match number of registers requested!" );
     }
 
-    ui->startEquationBtn->setText(tr("Start"));
-    ui->startEquationBtn->setEnabled(true);
+    return err;
+}
+
+
+void
+MainWindow::
+saveCsvFile()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,tr("Save Equation"), "",tr("CSV file (*.csv);;All Files (*)"));
+
+    if (fileName.isEmpty()) return;
+
+    QString err;
+    if (!m_profile->save(fileName, err))
+    {
+        QMessageBox::information(this, tr("Unable to open file"), err);
+    }
+}
+
+
+void
+MainWindow::
+loadCsvTemplate()
+{
+    QString razorTemplatePath = QCoreApplication::applicationDirPath()+"/razor.csv";
+    QString eeaTemplatePath = QCoreApplication::applicationDirPath()+"/eea.csv";
+
+    if (!m_profile->load(ui->radioButton_190->isChecked() ? eeaTemplatePath : razorTemplatePath)) return;
+
+    showProfile();
+}
+
+void
+MainWindow::
+loadCsvFile()
+{
+    QString fileName = QFileDialog::getOpenFileName( this, tr("Open CSV file"), QDir::currentPath(), tr("CSV files (*.csv)") );
+
+    if (!m_profile->load(fileName)) return;
+
+    showProfile();
+}
+
+void
+MainWindow::
+showProfile()
+{
+    // enable uploadEquationButton
+    if (m_profile->rows() > 0) ui->startEquationBtn->setEnabled(1);
+
+    // set column width
+    ui->tableWidget->setColumnWidth(ProfileModel::NameColumn,120);
+    ui->tableWidget->setColumnWidth(ProfileModel::SlaveColumn,30);
+    ui->tableWidget->setColumnWidth(ProfileModel::AddrColumn,50);
+    ui->tableWidget->setColumnWidth(ProfileModel::TypeColumn,40);
+    ui->tableWidget->setColumnWidth(ProfileModel::ScaleColumn,30);
+    ui->tableWidget->setColumnWidth(ProfileModel::RwColumn,30);
+    ui->tableWidget->setColumnWidth(ProfileModel::CountColumn,30);
+}
+
+void
+MainWindow::
+onEquationButtonPressed()
+{
+    BusyGuard busy(this);
+
+    ui->startEquationBtn->setEnabled(false);
+    ui->startEquationBtn->setText( tr("Loading") );
+
+    if (ui->radioButton_188->isChecked())
+    {
+        if( m_pollTimer->isActive() )
+        {
+            m_pollTimer->stop();
+            ui->startEquationBtn->setText( tr("Loading") );
+        }
+        else
+        {
+            // if polling requested then enable timer
+            if( m_poll )
+            {
+                m_pollTimer->start( 1000 );
+                ui->sendBtn->setText( tr("Loading") );
+            }
+
+            onUploadEquation();
+        }
+    }
+    else
+    {
+        if( m_pollTimer->isActive() )
+        {
+            m_pollTimer->stop();
+            ui->startEquationBtn->setText( tr("Loading") );
+        }
+        else
+        {
+            // if polling requested then enable timer
+            if( m_poll )
+            {
+                m_pollTimer->start( 1000 );
+                ui->sendBtn->setText( tr("Loading") );
+            }
+        
+            m_profile->clear();
+
+            onDownloadEquation();
+        }
+    }
+
+    ui->startEquationBtn->setText(tr("Start"));
+    ui->startEquationBtn->setEnabled(true);
 }
 
 
@@ -3228,6 +3337,7 @@ onDownloadEquation()
 {
     int value = 0;
     int rangeMax = 0;
+    LoopWorker * worker = currentLoopWorker();
 
     ui->slaveID->setValue(1);                           // set slave ID
     ui->radioButton_187->setChecked(true);              // read mode
@@ -3236,65 +3346,69 @@ onDownloadEquation()
     // load empty equation file
     loadCsvTemplate();
 
+    if (!worker->isConfigured())
+    {
+        setStatusError( tr("Not configured!") );
+        return;
+    }
+
+    /// group the profile into contiguous register and coil runs
+    const QVector<REGISTER_BLOCK> regBlocks = planProfileBlocks(FALSE, FALSE, MODBUS_MAX_READ_REGISTERS);
+    const QVector<REGISTER_BLOCK> coilBlocks = planProfileBlocks(TRUE, FALSE, MODBUS_MAX_READ_BITS);
+
     /// get rangeMax of progressDialog
-    for (int i = 0; i < ui->tableWidget->rowCount(); i++) rangeMax+=ui->tableWidget->item(i,6)->text().toInt();
+    rangeMax = regBlocks.size() + coilBlocks.size();
 
     QProgressDialog progress("Downloading...", "Abort", 0, rangeMax, this);
     progress.setWindowModality(Qt::WindowModal);
     progress.setAutoClose(true);
     progress.setAutoReset(true);
 
-    for (int i = 0; i < ui->tableWidget->rowCount(); i++)
-    {
-         int regAddr = ui->tableWidget->item(i,2)->text().toInt();
-
-         if (ui->tableWidget->item(i,3)->text().contains("float"))
-         {
-             ui->numCoils->setValue(2);                  // 2 bytes
-             ui->radioButton_181->setChecked(TRUE);      // float type
-             ui->functionCode->setCurrentIndex(3);       // function code
-             for (int x=0; x < ui->tableWidget->item(i,6)->text().toInt(); x++)
-             {
-                if (progress.wasCanceled()) return;
-                if (ui->tableWidget->item(i,6)->text().toInt() > 1) progress.setLabelText("Downloading \""+ui->tableWidget->item(i,0)->text()+"\" "+QString::number(x+1));
-                else progress.setLabelText("Downloading \""+ui->tableWidget->item(i,0)->text()+"\"");
-                progress.setValue(value++);
-
-                 ui->startAddr->setValue(regAddr);       // set address
-                 onSendButtonPress();                    // send
-                 delay();
-                 regAddr = regAddr+2;                    // update reg address
-                 ui->tableWidget->setItem( i, x+7, new QTableWidgetItem(ui->lineEdit_109->text()));
-             }
-         }
-         else if (ui->tableWidget->item(i,3)->text().contains("int"))
-         {
-            if (progress.wasCanceled()) return;
-            progress.setLabelText("Downloading \""+ui->tableWidget->item(i,0)->text()+"\"");
-            progress.setValue(value++);
+    for (int i = 0; i < regBlocks.size() + coilBlocks.size(); i++)
+    {
+        const bool isCoil = (i >= regBlocks.size());
+        const REGISTER_BLOCK & block = isCoil ? coilBlocks[i - regBlocks.size()] : regBlocks[i];
+        const QString firstName = m_profile->name(block.items.first().row);
+        const QString lastName = m_profile->name(block.items.last().row);
 
-             ui->numCoils->setValue(1);                  // 1 byte
-             ui->radioButton_182->setChecked(TRUE);      // int type
-             ui->functionCode->setCurrentIndex(3);       // function code
-             ui->startAddr->setValue(regAddr);           // address
-             onSendButtonPress();                        // send
-             delay();
-             ui->tableWidget->setItem( i, 7, new QTableWidgetItem(ui->lineEdit_111->text()));
-         }
-         else
-         {
-            if (progress.wasCanceled()) return;
-            progress.setLabelText("Downloading \""+ui->tableWidget->item(i,0)->text()+"\"");
-            progress.setValue(value++);
+        if (progress.wasCanceled()) return;
+        if (firstName != lastName) progress.setLabelText("Downloading \""+firstName+"\" .. \""+lastName+"\"");
+        else progress.setLabelText("Downloading \""+firstName+"\"");
+        progress.setValue(value++);
+
+        // one request for the whole run, on the wire the address is 0-based
+        const LOOP_RESPONSE response = worker->execute(LoopWorker::readRequest(ui->slaveID->value(),
+                isCoil ? MODBUS_FC_READ_COILS : MODBUS_FC_READ_INPUT_REGISTERS, block.addr-1, block.count, LoopWorker::RawValue));
+        const QVector<quint16> & regs = response.regs;
+
+        if (response.ret != block.count)
+        {
+            setStatusError( modbusErrorText(response.ret, response.error) );
+            continue;
+        }
+
+        // scatter the run back into the profile
+        for (int x = 0; x < block.items.size(); x++)
+        {
+            const PROFILE_ITEM & item = block.items[x];
+            const int offset = item.addr - block.addr;
+
+            if (isCoil)
+            {
+                m_profile->setIntValue(item.row, item.value, regs[offset] ? 1 : 0);
+            }
+            else if (item.width == 2)
+            {
+                m_profile->setFloatValue(item.row, item.value, modbus_get_float_ordered(regs.constData() + offset, DEVICE_FLOAT_ORDER));
+            }
+            else
+            {
+                m_profile->setIntValue(item.row, item.value, regs[offset]);
+            }
+        }
+    }
 
-             ui->numCoils->setValue(1);                  // 1 byte
-             ui->radioButton_183->setChecked(TRUE);      // coil type
-             ui->functionCode->setCurrentIndex(0);       // function code
-             ui->startAddr->setValue(regAddr);           // address
-             onSendButtonPress();                        // send
-             delay();
-         }
-     }
+    progress.setValue(rangeMax);
 }
 
 
@@ -3307,10 +3421,24 @@ onUploadEquation()
     int rangeMax = 0;
     bool isReinit = false;
     QMessageBox msgBox;
+    LoopWorker * worker = currentLoopWorker();
 	isModbusTransmissionFailed = false;
 
+    if (!worker->isConfigured())
+    {
+        setStatusError( tr("Not configured!") );
+        return;
+    }
+
+    /// writable floats and ints are coalesced into FC16 blocks
+    const QVector<REGISTER_BLOCK> regBlocks = planProfileBlocks(FALSE, TRUE, MODBUS_MAX_WRITE_REGISTERS);
+
     /// get rangeMax of progressDialog
-    for (int i = 0; i < ui->tableWidget->rowCount(); i++) rangeMax+=ui->tableWidget->item(i,6)->text().toInt();
+    rangeMax = regBlocks.size();
+    for (int i = 0; i < m_profile->rows(); i++)
+    {
+        if (m_profile->type(i) == ProfileBit) rangeMax++;
+    }
     
     msgBox.setText("You can reinitialize existing registers and coils.");
     msgBox.setInformativeText("Do you want to reinitialize registers and coils?");
@@ -3327,8 +3455,32 @@ onUploadEquation()
         case QMessageBox::Cancel:
         default: return;
     }
-        
-    ui->slaveID->setValue(1);                           // set slave ID
+
+    /// the meters of a loop share the factory profile, one broadcast
+    /// programs them all and each one is read back by its serial number
+    const QVector<int> serials = loopSerialNumbers(qBound(0, ui->tabWidget_2->currentIndex(), MAX_LOOP-1));
+    bool isGroup = false;
+    if (serials.size() > 1)
+    {
+        msgBox.setText(QString("%1 meters with a serial number are on this loop.").arg(serials.size()));
+        msgBox.setInformativeText("Do you want to upload to all of them at once?");
+        msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+        msgBox.setDefaultButton(QMessageBox::Cancel);
+        switch (msgBox.exec()) {
+            case QMessageBox::Yes:
+                isGroup = true;
+                break;
+            case QMessageBox::No:
+                isGroup = false;
+                break;
+            case QMessageBox::Cancel:
+            default: return;
+        }
+    }
+    const int target = isGroup ? MODBUS_BROADCAST_ADDRESS : 1;
+    const QVector<int> restartProbes = isGroup ? serials : QVector<int>(1, target);
+    if (isGroup) rangeMax += serials.size();
+
     ui->radioButton_186->setChecked(true);              // write mode    
 
     QProgressDialog progress("Uploading...", "Abort", 0, rangeMax, this);
@@ -3337,16 +3489,10 @@ onUploadEquation()
     progress.setAutoReset(true);
 
     /// unlock fct default regs & coils (999)
-    ui->numCoils->setValue(1);                      // 1 byte
-    ui->radioButton_183->setChecked(TRUE);          // coil type
-    ui->functionCode->setCurrentIndex(4);           // function type
-    ui->startAddr->setValue(999);                   // address
-    ui->radioButton_184->setChecked(true);          // set value
     if (progress.wasCanceled()) return;
     progress.setValue(0);
     progress.setLabelText("Unlocking factory registers....");
-    onSendButtonPress();
-    delay();
+    isModbusTransmissionFailed = !writeCoil(worker, target, 999, true);
 	if (isModbusTransmissionFailed) 
 	{
 		isModbusTransmissionFailed = false;
@@ -3366,17 +3512,11 @@ onUploadEquation()
 
     if (isReinit)
     {
-        ui->numCoils->setValue(1);                      // set byte count 1
-        ui->radioButton_183->setChecked(TRUE);          // set type coil 
-        ui->functionCode->setCurrentIndex(4);           // set function type
-        ui->radioButton_185->setChecked(true);          // set coils unlocked 
-
-        ui->startAddr->setValue(25);                    // set address 25
+        /// clear coils 25 and 26, the second one restarts the device
         if (progress.wasCanceled()) return;
         progress.setLabelText("Reinitializing registers....");
         progress.setValue(0);
-        onSendButtonPress();
-        delay();
+        isModbusTransmissionFailed = !writeCoil(worker, target, 25, false);
 		if (isModbusTransmissionFailed) 
 		{
 			isModbusTransmissionFailed = false;
@@ -3392,11 +3532,11 @@ onUploadEquation()
     		}
 
 		}
-        ui->startAddr->setValue(26);                    // set address 26
         if (progress.wasCanceled()) return;
         progress.setValue(0);
-        onSendButtonPress();
-        delay(8);                                       // need extra time to restart
+        isModbusTransmissionFailed = !writeCoil(worker, target, 26, false);
+        progress.setLabelText("Waiting for device restart....");
+        if (!isModbusTransmissionFailed && !waitForDeviceRestart(worker, restartProbes, 8)) isModbusTransmissionFailed = true;
 		if (isModbusTransmissionFailed) 
 		{
 			isModbusTransmissionFailed = false;
@@ -3413,16 +3553,10 @@ onUploadEquation()
 
 		}	
         /// unlock fct default regs & coils (999)
-        ui->numCoils->setValue(1);                      // 1 byte
-        ui->radioButton_183->setChecked(TRUE);          // coil type
-        ui->functionCode->setCurrentIndex(4);           // function type
-        ui->startAddr->setValue(999);                   // address
-        ui->radioButton_184->setChecked(true);          // set value
         if (progress.wasCanceled()) return;
         progress.setValue(0);
         progress.setLabelText("Unlocking factory registers....");
-        onSendButtonPress();
-        delay();
+        isModbusTransmissionFailed = !writeCoil(worker, target, 999, true);
 		if (isModbusTransmissionFailed) 
 		{
 			isModbusTransmissionFailed = false;
@@ -3439,60 +3573,54 @@ onUploadEquation()
 		}
    }
 
-   for (int i = 0; i < ui->tableWidget->rowCount(); i++)
-   {
-        int regAddr = ui->tableWidget->item(i,2)->text().toInt();
-        if (ui->tableWidget->item(i,3)->text().contains("float"))
+    for (int b = 0; b < regBlocks.size(); b++)
+    {
+        const REGISTER_BLOCK & block = regBlocks[b];
+        const QString firstName = m_profile->name(block.items.first().row);
+        const QString lastName = m_profile->name(block.items.last().row);
+        QString err;
+
+        if (progress.wasCanceled()) return;
+        if (firstName != lastName) progress.setLabelText("Uploading \""+firstName+"\" .. \""+lastName+"\"");
+        else progress.setLabelText("Uploading \""+firstName+"\"");
+        progress.setValue(value++);
+
+        if (!writeRegisterBlock(worker, target, block, err))
         {
-            ui->numCoils->setValue(2);                  // 2 bytes
-            ui->radioButton_181->setChecked(TRUE);      // float type
-            ui->functionCode->setCurrentIndex(7);       // function code
-            for (int x=0; x < ui->tableWidget->item(i,6)->text().toInt(); x++)
-            {
-                QString val = ui->tableWidget->item(i,7+x)->text();
-                ui->startAddr->setValue(regAddr);       // set address
-                ui->lineEdit_109->setText(val);         // set value
-                if (progress.wasCanceled()) return;
-                if (ui->tableWidget->item(i,6)->text().toInt() > 1) progress.setLabelText("Uploading \""+ui->tableWidget->item(i,0)->text()+"["+QString::number(x+1)+"]"+"\""+","+" \""+val+"\"");
-                else progress.setLabelText("Uploading \""+ui->tableWidget->item(i,0)->text()+"\""+","+" \""+val+"\"");
-                progress.setValue(value++);
-                onSendButtonPress();                    // send
-                regAddr += 2;                           // update reg address
-                delay();
-				if (isModbusTransmissionFailed) 
-				{
-					isModbusTransmissionFailed = false;
-					if (ui->tableWidget->item(i,6)->text().toInt() > 1) msgBox.setText("Modbus Transmission Failed: "+ui->tableWidget->item(i,0)->text()+"["+QString::number(x+1)+"]");
-					else msgBox.setText("Modbus Transmission Failed: "+ui->tableWidget->item(i,0)->text());
-    				msgBox.setInformativeText("Do you want to continue with next item?");
-    				msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
-    				msgBox.setDefaultButton(QMessageBox::No);
-    				int ret = msgBox.exec();
-    				switch (ret) {
-        				case QMessageBox::Yes: break;
-        				case QMessageBox::No:
-        				default: return;
-    				}
-				}
+            setStatusError( err );
+            if (firstName != lastName) msgBox.setText("Modbus Transmission Failed: "+firstName+" .. "+lastName);
+            else msgBox.setText("Modbus Transmission Failed: "+firstName);
+            msgBox.setInformativeText(err+"\nDo you want to continue with next item?");
+            msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+            msgBox.setDefaultButton(QMessageBox::No);
+            int ret = msgBox.exec();
+            switch (ret) {
+                case QMessageBox::Yes: break;
+                case QMessageBox::No:
+                default: return;
             }
         }
-        else if (ui->tableWidget->item(i,3)->text().contains("int"))
+    }
+
+    /// coils go one by one
+    for (int i = 0; i < m_profile->rows(); i++)
+    {
+        int regAddr = m_profile->addr(i);
+        if (m_profile->type(i) != ProfileBit || m_profile->valueCount(i) == 0)
+        {
+            continue;
+        }
+        else
         {
-            QString val = ui->tableWidget->item(i,7)->text();
-            ui->numCoils->setValue(1);                  // 1 byte
-            ui->radioButton_182->setChecked(TRUE);      // int type
-            ui->functionCode->setCurrentIndex(5);       // function code
-            ui->lineEdit_111->setText(val);             // set value
-            ui->startAddr->setValue(regAddr);           // address
+            const bool isSet = (m_profile->intValue(i,0) == 1);
+            progress.setLabelText("Uploading \""+m_profile->name(i)+"\""+","+(isSet ? " \"1\"" : " \"0\""));
             if (progress.wasCanceled()) return;
-            progress.setLabelText("Uploading \""+ui->tableWidget->item(i,0)->text()+"\""+","+" \""+val+"\"");
             progress.setValue(value++);
-            onSendButtonPress();                        // send
-            delay();
+            isModbusTransmissionFailed = !writeCoil(worker, target, regAddr, isSet);
 			if (isModbusTransmissionFailed) 
 			{
 				isModbusTransmissionFailed = false;
-				msgBox.setText("Modbus Transmission Failed: "+ui->tableWidget->item(i,0)->text());
+				msgBox.setText("Modbus Transmission Failed: "+m_profile->name(i));
     			msgBox.setInformativeText("Do you want to continue with next item?");
     			msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
     			msgBox.setDefaultButton(QMessageBox::No);
@@ -3504,58 +3632,53 @@ onUploadEquation()
     			}
 			}
         }
-        else
+    }
+
+    /// nobody confirms a broadcast, read the profile back from every meter
+    /// before it becomes their factory default
+    if (isGroup)
+    {
+        QStringList failed;
+
+        for (int s = 0; s < serials.size(); s++)
         {
-            ui->numCoils->setValue(1);                  // 1 byte
-            ui->radioButton_183->setChecked(TRUE);      // coil type
-            ui->functionCode->setCurrentIndex(4);       // function code
-            ui->startAddr->setValue(regAddr);           // address
-            if (ui->tableWidget->item(i,7)->text().toInt() == 1)
+            if (progress.wasCanceled()) return;
+            progress.setLabelText("Verifying SN"+QString::number(serials[s]));
+            progress.setValue(value++);
+
+            for (int b = 0; b < regBlocks.size(); b++)
             {
-                ui->radioButton_184->setChecked(true);  // TRUE
-                progress.setLabelText("Uploading \""+ui->tableWidget->item(i,0)->text()+"\""+","+" \"1\"");
+                QString err;
+
+                if (!regBlocks[b].items.first().readable) continue;
+                if (!verifyRegisterBlock(worker, serials[s], regBlocks[b], err))
+                {
+                    failed.append("SN"+QString::number(serials[s])+": "+err);
+                    break;
+                }
             }
-            else 
-            {
-                ui->radioButton_185->setChecked(true);  // FALSE
-                progress.setLabelText("Uploading \""+ui->tableWidget->item(i,0)->text()+"\""+","+" \"0\"");
+        }
+
+        if (!failed.isEmpty())
+        {
+            setStatusError( failed.first() );
+            msgBox.setText(QString("%1 of %2 meters did not take the profile.").arg(failed.size()).arg(serials.size()));
+            msgBox.setInformativeText(failed.join("\n")+"\nDo you want to update the factory defaults anyway?");
+            msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+            msgBox.setDefaultButton(QMessageBox::No);
+            switch (msgBox.exec()) {
+                case QMessageBox::Yes: break;
+                case QMessageBox::No:
+                default: return;
             }
-            if (progress.wasCanceled()) return;
-            progress.setValue(value++);
-            onSendButtonPress();                        // send
-            delay();
-			if (isModbusTransmissionFailed) 
-			{
-				isModbusTransmissionFailed = false;
-				msgBox.setText("Modbus Transmission Failed: "+ui->tableWidget->item(i,0)->text());
-    			msgBox.setInformativeText("Do you want to continue with next item?");
-    			msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
-    			msgBox.setDefaultButton(QMessageBox::No);
-    			int ret = msgBox.exec();
-    			switch (ret) {
-        			case QMessageBox::Yes: break;
-        			case QMessageBox::No:
-        			default: return;
-    			}
-			}
         }
     }
 
-    /// update factory default values
-    ui->numCoils->setValue(1);                      // 1 byte
-    ui->radioButton_183->setChecked(TRUE);          // coil type
-    ui->functionCode->setCurrentIndex(4);           // function code
-    ui->radioButton_184->setChecked(true);          // set value
-
     /// unlock factory default registers
-    ui->startAddr->setValue(999);                   // address 999
-    onSendButtonPress();
-    delay();
+    writeCoil(worker, target, 999, true);
 
     /// update factory default registers
-    ui->startAddr->setValue(9999);                  // address 99999
-    onSendButtonPress();
-    delay();
+    writeCoil(worker, target, 9999, true);
 }
 
 void
@@ -3570,7 +3693,6 @@ onUnlockFactoryDefaultBtnPressed()
     /// unlock factory default registers
     ui->startAddr->setValue(999);                   // address 999
     onSendButtonPress();
-    delay();
 }
 
 void
@@ -3585,7 +3707,6 @@ onLockFactoryDefaultBtnPressed()
     /// unlock factory default registers
     ui->startAddr->setValue(999);                   // address 999
     onSendButtonPress();
-    delay();
 }
 
 void
@@ -3615,7 +3736,6 @@ onUpdateFactoryDefaultPressed()
     /// update factory default registers
     ui->startAddr->setValue(9999);                  // address 99999
     onSendButtonPress();
-    delay();
 }
 
 
@@ -3670,9 +3790,9 @@ setupModbusPort()
     int i = 0;
     ui->comboBox->disconnect();
     ui->comboBox->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( const QextPortInfo & port, m_portInventory->ports() )
     {
-        ui->comboBox->addItem( port.friendName );
+        ui->comboBox->addItem( port.friendName, port.portName );
 
         if( port.friendName == s.value( "serialinterface" ) )
         {
@@ -3706,12 +3826,12 @@ setupModbusPort_2()
     int i = 0;
     ui->comboBox_6->disconnect();
     ui->comboBox_6->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( const QextPortInfo & port, m_portInventory->ports() )
     {
 #ifdef Q_OS_WIN
-        ui->comboBox_6->addItem( port.friendName );
+        ui->comboBox_6->addItem( port.friendName, port.portName );
 #else
-        ui->comboBox_6->addItem( port.physName );
+        ui->comboBox_6->addItem( port.physName, port.portName );
 #endif
         if( port.friendName == s.value( "serialinterface" ) )
         {
@@ -3745,12 +3865,12 @@ setupModbusPort_3()
     int i = 0;
     ui->comboBox_11->disconnect();
     ui->comboBox_11->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( const QextPortInfo & port, m_portInventory->ports() )
     {
 #ifdef Q_OS_WIN
-        ui->comboBox_11->addItem( port.friendName );
+        ui->comboBox_11->addItem( port.friendName, port.portName );
 #else
-        ui->comboBox_11->addItem( port.physName );
+        ui->comboBox_11->addItem( port.physName, port.portName );
 #endif
         if( port.friendName == s.value( "serialinterface" ) )
         {
@@ -3784,12 +3904,12 @@ setupModbusPort_4()
     int i = 0;
     ui->comboBox_16->disconnect();
     ui->comboBox_16->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( const QextPortInfo & port, m_portInventory->ports() )
     {
 #ifdef Q_OS_WIN
-        ui->comboBox_16->addItem( port.friendName );
+        ui->comboBox_16->addItem( port.friendName, port.portName );
 #else
-        ui->comboBox_16->addItem( port.physName );
+        ui->comboBox_16->addItem( port.physName, port.portName );
 #endif
         if( port.friendName == s.value( "serialinterface" ) )
         {
@@ -3824,12 +3944,12 @@ setupModbusPort_5()
     int i = 0;
     ui->comboBox_21->disconnect();
     ui->comboBox_21->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( const QextPortInfo & port, m_portInventory->ports() )
     {
 #ifdef Q_OS_WIN
-        ui->comboBox_21->addItem( port.friendName );
+        ui->comboBox_21->addItem( port.friendName, port.portName );
 #else
-        ui->comboBox_21->addItem( port.physName );
+        ui->comboBox_21->addItem( port.physName, port.portName );
 #endif
         if( port.friendName == s.value( "serialinterface" ) )
         {
@@ -3863,12 +3983,12 @@ setupModbusPort_6()
     int i = 0;
     ui->comboBox_26->disconnect();
     ui->comboBox_26->clear();
-    foreach( QextPortInfo port, QextSerialEnumerator::getPorts() )
+    foreach( const QextPortInfo & port, m_portInventory->ports() )
     {
 #ifdef Q_OS_WIN
-        ui->comboBox_26->addItem( port.friendName );
+        ui->comboBox_26->addItem( port.friendName, port.portName );
 #else
-        ui->comboBox_26->addItem( port.physName );
+        ui->comboBox_26->addItem( port.physName, port.portName );
 #endif
         if( port.friendName == s.value( "serialinterface" ) )
         {
@@ -3905,9 +4025,11 @@ releaseSerialModbus()
 {
     if( m_serialModbus )
     {
+        m_loopWorker[0]->setModbus( NULL );     // waits for a running transaction
         modbus_close( m_serialModbus );
         modbus_free( m_serialModbus );
         m_serialModbus = NULL;
+        m_openId[0] = 0;
         updateTabIcon(0, false);
     }
 }
@@ -3918,9 +4040,11 @@ releaseSerialModbus_2()
 {
     if( m_serialModbus_2 )
     {
+        m_loopWorker[1]->setModbus( NULL );     // waits for a running transaction
         modbus_close( m_serialModbus_2 );
         modbus_free( m_serialModbus_2 );
         m_serialModbus_2 = NULL;
+        m_openId[1] = 0;
         updateTabIcon(1, false);
     }
 }
@@ -3931,9 +4055,11 @@ releaseSerialModbus_3()
 {
     if( m_serialModbus_3 )
     {
+        m_loopWorker[2]->setModbus( NULL );     // waits for a running transaction
         modbus_close( m_serialModbus_3 );
         modbus_free( m_serialModbus_3 );
         m_serialModbus_3 = NULL;
+        m_openId[2] = 0;
         updateTabIcon(2, false);
     }
 }
@@ -3944,9 +4070,11 @@ releaseSerialModbus_4()
 {
     if( m_serialModbus_4 )
     {
+        m_loopWorker[3]->setModbus( NULL );     // waits for a running transaction
         modbus_close( m_serialModbus_4);
         modbus_free( m_serialModbus_4 );
         m_serialModbus_4 = NULL;
+        m_openId[3] = 0;
         updateTabIcon(3, false);
     }
 }
@@ -3958,9 +4086,11 @@ releaseSerialModbus_5()
 {
     if( m_serialModbus_5 )
     {
+        m_loopWorker[4]->setModbus( NULL );     // waits for a running transaction
         modbus_close( m_serialModbus_5 );
         modbus_free( m_serialModbus_5 );
         m_serialModbus_5 = NULL;
+        m_openId[4] = 0;
         updateTabIcon(4, false);
     }
 }
@@ -3972,9 +4102,11 @@ releaseSerialModbus_6()
 {
     if( m_serialModbus_6 )
     {
+        m_loopWorker[5]->setModbus( NULL );     // waits for a running transaction
         modbus_close( m_serialModbus_6 );
         modbus_free( m_serialModbus_6 );
         m_serialModbus_6 = NULL;
+        m_openId[5] = 0;
         updateTabIcon(5, false);
     }
 }
@@ -3985,8 +4117,8 @@ changeSerialPort( int )
 {
     const int iface = ui->comboBox->currentIndex();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    const QList<QextPortInfo> & ports = m_portInventory->ports();
+    if( iface >= 0 && iface < ports.size() )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -4025,8 +4157,8 @@ changeSerialPort_2( int )
 {
     const int iface = ui->comboBox_6->currentIndex();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    const QList<QextPortInfo> & ports = m_portInventory->ports();
+    if( iface >= 0 && iface < ports.size() )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -4065,8 +4197,8 @@ changeSerialPort_3( int )
 {
     const int iface = ui->comboBox_11->currentIndex();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    const QList<QextPortInfo> & ports = m_portInventory->ports();
+    if( iface >= 0 && iface < ports.size() )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -4105,8 +4237,8 @@ changeSerialPort_4( int )
 {
     const int iface = ui->comboBox_16->currentIndex();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    const QList<QextPortInfo> & ports = m_portInventory->ports();
+    if( iface >= 0 && iface < ports.size() )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -4146,8 +4278,8 @@ changeSerialPort_5( int )
 {
     const int iface = ui->comboBox_21->currentIndex();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    const QList<QextPortInfo> & ports = m_portInventory->ports();
+    if( iface >= 0 && iface < ports.size() )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -4187,8 +4319,8 @@ changeSerialPort_6( int )
 {
     const int iface = ui->comboBox_26->currentIndex();
 
-    QList<QextPortInfo> ports = QextSerialEnumerator::getPorts();
-    if( !ports.isEmpty() )
+    const QList<QextPortInfo> & ports = m_portInventory->ports();
+    if( iface >= 0 && iface < ports.size() )
     {
         QSettings settings;
         settings.setValue( "serialinterface", ports[iface].friendName );
@@ -4222,6 +4354,107 @@ changeSerialPort_6( int )
 }
 
 
+/// a port was plugged in or out, the lists of all loops follow it
+/// without reconnecting the loops whose port is still there; a loop whose
+/// port was unplugged is released and left without a selection
+void
+MainWindow::
+onPortsChanged()
+{
+    QComboBox * boxes[MAX_LOOP] = { ui->comboBox, ui->comboBox_6, ui->comboBox_11,
+                                    ui->comboBox_16, ui->comboBox_21, ui->comboBox_26 };
+    const modbus_t * modbus[MAX_LOOP] = { m_serialModbus, m_serialModbus_2, m_serialModbus_3,
+                                          m_serialModbus_4, m_serialModbus_5, m_serialModbus_6 };
+
+    for (int i = 0; i < MAX_LOOP; i++)
+    {
+        const QString current = boxes[i]->currentData().toString();
+
+        boxes[i]->blockSignals(true);
+        boxes[i]->clear();
+        foreach( const QextPortInfo & port, m_portInventory->ports() )
+        {
+#ifdef Q_OS_WIN
+            boxes[i]->addItem( port.friendName, port.portName );
+#else
+            boxes[i]->addItem( i == 0 ? port.friendName : port.physName, port.portName );
+#endif
+        }
+        const int index = current.isEmpty() ? 0 : boxes[i]->findData( current );
+        boxes[i]->setCurrentIndex( index );
+        boxes[i]->blockSignals(false);
+
+        /// picking another port reconnects the loop
+        if (index == -1 && modbus[i] != NULL)
+        {
+            emit connectionError( tr( "Serial port %1 of Loop_%2 was removed" ).arg( current ).arg( i + 1 ) );
+            releaseLoop(i);
+        }
+    }
+}
+
+
+/// a loop thread is done opening its port
+void
+MainWindow::
+onPortOpened(int loop, int id, bool ok, int error)
+{
+    if (id == m_startupOpenId[loop])
+    {
+        m_startupOpenId[loop] = 0;
+        startupTrace(QString("loop %1 port %2").arg(loop + 1).arg(ok ? "up" : "failed"));
+        if (--m_startupOpens == 0) startupTrace("all ports settled");
+    }
+
+    /// the port was changed or released meanwhile
+    if (id != m_openId[loop]) return;
+    m_openId[loop] = 0;
+
+    if (ok)
+    {
+        updateTabIcon(loop, true);
+        return;
+    }
+
+    emit connectionError( tr( "Could not connect serial port at Loop_%1: %2" ).arg( loop + 1 ).arg( modbus_strerror( error ) ) );
+
+    releaseLoop(loop);
+}
+
+
+/// the port of a loop went away under its listener, e.g. an unplugged adapter
+void
+MainWindow::
+onPortLost(int loop, void * modbus, int error)
+{
+    const modbus_t * current[MAX_LOOP] = { m_serialModbus, m_serialModbus_2, m_serialModbus_3,
+                                           m_serialModbus_4, m_serialModbus_5, m_serialModbus_6 };
+
+    /// the port was changed or released meanwhile
+    if (modbus != current[loop]) return;
+
+    emit connectionError( tr( "Lost serial port at Loop_%1: %2" ).arg( loop + 1 ).arg( modbus_strerror( error ) ) );
+
+    releaseLoop(loop);
+}
+
+
+void
+MainWindow::
+releaseLoop(int loop)
+{
+    switch (loop)
+    {
+        case 0: releaseSerialModbus(); onRtuPortActive(false); break;
+        case 1: releaseSerialModbus_2(); onRtuPortActive_2(false); break;
+        case 2: releaseSerialModbus_3(); onRtuPortActive_3(false); break;
+        case 3: releaseSerialModbus_4(); onRtuPortActive_4(false); break;
+        case 4: releaseSerialModbus_5(); onRtuPortActive_5(false); break;
+        default: releaseSerialModbus_6(); onRtuPortActive_6(false); break;
+    }
+}
+
+
 void
 MainWindow::
 changeModbusInterface(const QString& port, char parity)
@@ -4234,14 +4467,8 @@ changeModbusInterface(const QString& port, char parity)
             ui->comboBox_3->currentText().toInt(),
             ui->comboBox_4->currentText().toInt() );
 
-    if( modbus_connect( m_serialModbus ) == -1 )
-    {
-        emit connectionError( tr( "Could not connect serial port at Loop_1!" ) );
-
-        releaseSerialModbus();
-    }
-    else
-        updateTabIcon(0, true);
+    /// opened in the loop thread, onPortOpened() tells how it went
+    m_openId[0] = m_loopWorker[0]->open( m_serialModbus );
 }
 
 void
@@ -4256,14 +4483,8 @@ changeModbusInterface_2(const QString& port, char parity)
             ui->comboBox_8->currentText().toInt(),
             ui->comboBox_9->currentText().toInt() );
 
-    if( modbus_connect( m_serialModbus_2 ) == -1 )
-    {
-        emit connectionError( tr( "Could not connect serial port at Loop_2!" ) );
-
-        releaseSerialModbus_2();
-    }
-    else 
-        updateTabIcon(1, true);
+    /// opened in the loop thread, onPortOpened() tells how it went
+    m_openId[1] = m_loopWorker[1]->open( m_serialModbus_2 );
 }
 
 void
@@ -4278,14 +4499,8 @@ changeModbusInterface_3(const QString& port, char parity)
             ui->comboBox_13->currentText().toInt(),
             ui->comboBox_14->currentText().toInt() );
 
-    if( modbus_connect( m_serialModbus_3 ) == -1 )
-    {
-        emit connectionError( tr( "Could not connect serial port at Loop_3!" ) );
-
-        releaseSerialModbus_3();
-    }
-    else
-        updateTabIcon(2, true);
+    /// opened in the loop thread, onPortOpened() tells how it went
+    m_openId[2] = m_loopWorker[2]->open( m_serialModbus_3 );
 }
 
 void
@@ -4300,14 +4515,8 @@ changeModbusInterface_4(const QString& port, char parity)
             ui->comboBox_18->currentText().toInt(),
             ui->comboBox_19->currentText().toInt() );
 
-    if( modbus_connect( m_serialModbus_4 ) == -1 )
-    {
-        emit connectionError( tr( "Could not connect serial port at Loop_4!" ) );
-
-        releaseSerialModbus_4();
-    }
-    else
-        updateTabIcon(3, true);
+    /// opened in the loop thread, onPortOpened() tells how it went
+    m_openId[3] = m_loopWorker[3]->open( m_serialModbus_4 );
 }
 
 
@@ -4323,14 +4532,8 @@ changeModbusInterface_5(const QString& port, char parity)
             ui->comboBox_23->currentText().toInt(),
             ui->comboBox_24->currentText().toInt() );
 
-    if( modbus_connect( m_serialModbus_5 ) == -1 )
-    {
-        emit connectionError( tr( "Could not connect serial port at Loop_5!" ) );
-
-        releaseSerialModbus_5();
-    }
-    else
-        updateTabIcon(4, true);
+    /// opened in the loop thread, onPortOpened() tells how it went
+    m_openId[4] = m_loopWorker[4]->open( m_serialModbus_5 );
 }
 
 void
@@ -4345,14 +4548,8 @@ changeModbusInterface_6(const QString& port, char parity)
             ui->comboBox_28->currentText().toInt(),
             ui->comboBox_29->currentText().toInt() );
 
-    if( modbus_connect( m_serialModbus_6 ) == -1 )
-    {
-        emit connectionError( tr( "Could not connect serial port at Loop_6" ) );
-
-        releaseSerialModbus_6();
-    }
-    else
-        updateTabIcon(5, true);
+    /// opened in the loop thread, onPortOpened() tells how it went
+    m_openId[5] = m_loopWorker[5]->open( m_serialModbus_6 );
 }
 
 void
@@ -4361,6 +4558,9 @@ onCheckBoxChecked(bool checked)
 {
     clearMonitors();
 
+    /// picks up the adapters plugged in since, where nobody tells
+    if (checked) m_portInventory->refresh();
+
     if (ui->tabWidget_2->currentIndex() == 0)
     {
         if (checked) setupModbusPort();
@@ -4416,9 +4616,9 @@ void
 MainWindow::
 clearMonitors()
 {
-    ui->rawData->clear();
+    m_rawMonitor->clear();
     ui->regTable->setRowCount(0);
-    ui->busMonTable->setRowCount(0);
+    m_busMonitor->clear();
 }
 
 /*
@@ -4472,6 +4672,9 @@ onLoopTabChanged(int index)
 {
     clearMonitors();    
 
+    /// the pipe tabs are connected here too and pass their own index
+    index = ui->tabWidget_2->currentIndex();
+
     if (index == 0)
     {
         if (ui->tabWidget_3->currentIndex() == 0)
@@ -4552,21 +4755,95 @@ onLoopTabChanged(int index)
     else
     {
 
-        if (ui->tabWidget_8->currentIndex() == 0)
-        {
-            (ui->radioButton_239->isChecked()) ? updateRegisters(RAZ,15) : updateRegisters(EEA,15);
-        }
-        else if (ui->tabWidget_8->currentIndex() == 1)
-        {
-            (ui->radioButton_251->isChecked()) ? updateRegisters(RAZ,16) : updateRegisters(EEA,16);
-        }
-        else
-        {
-            (ui->radioButton_263->isChecked()) ? updateRegisters(RAZ,17) : updateRegisters(EEA,17);
-        }
+        if (ui->tabWidget_8->currentIndex() == 0)
+        {
+            (ui->radioButton_239->isChecked()) ? updateRegisters(RAZ,15) : updateRegisters(EEA,15);
+        }
+        else if (ui->tabWidget_8->currentIndex() == 1)
+        {
+            (ui->radioButton_251->isChecked()) ? updateRegisters(RAZ,16) : updateRegisters(EEA,16);
+        }
+        else
+        {
+            (ui->radioButton_263->isChecked()) ? updateRegisters(RAZ,17) : updateRegisters(EEA,17);
+        }
+    }
+
+    updateGraph();
+    updateTelemetryTarget();
+}
+
+
+int
+MainWindow::
+currentPipe()
+{
+    QTabWidget * pipeTabs[MAX_LOOP] = { ui->tabWidget_3, ui->tabWidget_4, ui->tabWidget_5, ui->tabWidget_6, ui->tabWidget_7, ui->tabWidget_8 };
+    const int loop = qBound(0, ui->tabWidget_2->currentIndex(), MAX_LOOP-1);
+
+    return loop*3 + qBound(0, pipeTabs[loop]->currentIndex(), 2);
+}
+
+
+QLineEdit *
+MainWindow::
+pipeSerialNumber(const int pipe)
+{
+    QLineEdit * serials[MAX_PIPE] = {
+        ui->lineEdit_2, ui->lineEdit_7, ui->lineEdit_13,
+        ui->lineEdit_15, ui->lineEdit_17, ui->lineEdit_19,
+        ui->lineEdit_21, ui->lineEdit_23, ui->lineEdit_25,
+        ui->lineEdit_27, ui->lineEdit_29, ui->lineEdit_31,
+        ui->lineEdit_33, ui->lineEdit_35, ui->lineEdit_110,
+        ui->lineEdit_121, ui->lineEdit_123, ui->lineEdit_129 };
+
+    return serials[qBound(0, pipe, MAX_PIPE-1)];
+}
+
+
+QVector<int>
+MainWindow::
+loopSerialNumbers(const int loop)
+{
+    QVector<int> serials;
+
+    /// only serial numbers can be told apart on the wire (extended address)
+    for (int pipe = loop*3; pipe < loop*3 + 3; pipe++)
+    {
+        const int serial = pipeSerialNumber(pipe)->text().toInt();
+
+        if (serial > 99 && !serials.contains(serial)) serials.append(serial);
     }
 
-    updateGraph();
+    return serials;
+}
+
+
+void
+MainWindow::
+updateTelemetryTarget()
+{
+    const int pipe = currentPipe();
+    const QString serial = pipeSerialNumber(pipe)->text();
+    const int slave = serial.isEmpty() ? ui->slaveID->value() : serial.toInt();
+    const REGISTER_DEF * const regs[TelemetryValues] = { pipeRegister(pipe, RegisterFreq), pipeRegister(pipe, RegisterTemperature),
+            pipeRegister(pipe, RegisterOilDensity), pipeRegister(pipe, RegisterOilRp) };
+
+    m_telemetry->setTarget(m_loopWorker[pipe/3], pipe, slave, regs);
+}
+
+
+void
+MainWindow::
+refreshGauges()
+{
+    /// nothing new since the last refresh, leave the needles alone
+    if (!m_telemetry->latest(m_gaugeSample)) return;
+
+    updateFrequencyGauge();
+    updateTemperatureGauge();
+    updateDensityGauge();
+    updateRPGauge();
 }
 
 
@@ -4764,6 +5041,15 @@ createLoopFiles(const int sn, const QString path, const BOOL iseea, const QStrin
     stream6 << header0 << '\n' << header1 << '\n' << header2 << '\n' << header3 << '\n' << header4 << '\n' << header5 << '\n';
     stream7 << header0 << '\n' << header1 << '\n' << header2 << '\n' << header3 << '\n' << header4 << '\n' << header5 << '\n';
                     
+    /// the streams buffer, flush them before the files get closed
+    stream1.flush();
+    stream2.flush();
+    stream3.flush();
+    stream4.flush();
+    stream5.flush();
+    stream6.flush();
+    stream7.flush();
+
     /// close files
     file1.close();
     file2.close();
@@ -4775,6 +5061,118 @@ createLoopFiles(const int sn, const QString path, const BOOL iseea, const QStrin
 }
 
 
+bool
+MainWindow::
+startCalibration(const int pipe, const int slave, QFile & ambTwenty, QFile & twentyFiftyFive, QFile & fiftyFiveThirtyEight)
+{
+    /// the files of a stage are appended to as the meter temperature moves through it
+    QStringList stageFiles;
+    stageFiles << ambTwenty.fileName() << twentyFiftyFive.fileName() << fiftyFiveThirtyEight.fileName();
+
+    return m_calibration->start(pipe, slave, stageFiles, pipeRegister(pipe, RegisterWatercut)->addr, pipeRegister(pipe, RegisterTemperature)->addr,
+                                pipeRegister(pipe, RegisterFreq)->addr, pipeRegister(pipe, RegisterOilRp)->addr);
+}
+
+
+void
+MainWindow::
+onCalibrationFailed(int pipe, int ret, int error)
+{
+    setStatusError( tr("Loop_%1_Pipe_%2: ").arg(pipe/3+1).arg(pipe%3+1) + modbusErrorText(ret, error) );
+}
+
+
+void
+MainWindow::
+onDiscoverChecked(bool isChecked)
+{
+    /// unchecking stops the scan, what was found so far stays
+    if (!isChecked)
+    {
+        if (!m_discovery->isRunning()) return;
+
+        for (int loop = 0; loop < MAX_LOOP; loop++) m_discovery->stop(loop);
+        resetStatus();
+        return;
+    }
+
+    int started = 0;
+    m_discoveredDevices = 0;
+
+    for (int loop = 0; loop < MAX_LOOP; loop++)
+    {
+        /// the identity registers are the same for both products
+        const int pipe = loop*3;
+        const REGISTER_DEF * const regs[DiscoveryValues] = { pipeRegister(pipe, RegisterSnPipe), pipeRegister(pipe, RegisterFirmwareVersion),
+                pipeRegister(pipe, RegisterHardwareVersion), pipeRegister(pipe, RegisterModelCode0), pipeRegister(pipe, RegisterModelCode1),
+                pipeRegister(pipe, RegisterModelCode2), pipeRegister(pipe, RegisterModelCode3) };
+
+        m_discoveredPipes[loop] = 0;
+        if (m_discovery->start(loop, regs)) started++;
+    }
+
+    if (started == 0)
+    {
+        ui->actionDiscover->setChecked(false);
+        setStatusError( tr("No loop configured!") );
+        return;
+    }
+
+    m_statusTimer->stop();
+    m_statusText->setText( tr("Discovering analyzers on %1 loops...").arg(started) );
+    m_statusInd->setStyleSheet( "background: #fb0;" );
+}
+
+
+void
+MainWindow::
+onDeviceDiscovered(const DISCOVERY_DEVICE & device)
+{
+    const QString identity = tr("Address %1, firmware %2, hardware %3, model %4-%5-%6-%7")
+            .arg(device.slave)
+            .arg(device.values[DiscoveryFirmware])
+            .arg(device.values[DiscoveryHardware])
+            .arg(device.values[DiscoveryModel0])
+            .arg(device.values[DiscoveryModel1])
+            .arg(device.values[DiscoveryModel2])
+            .arg(device.values[DiscoveryModel3]);
+
+    m_discoveredDevices++;
+
+    /// the pipe tabs of the loop are filled in address order, a loop holds three
+    if (m_discoveredPipes[device.loop] >= 3) return;
+
+    QLineEdit * serial = pipeSerialNumber(device.loop*3 + m_discoveredPipes[device.loop]);
+    m_discoveredPipes[device.loop]++;
+
+    /// serial numbers are the extended addresses, the plain one when it has none
+    serial->setText(QString::number(device.serial > 99 ? device.serial : device.slave));
+    serial->setToolTip(identity);
+    updateTelemetryTarget();
+}
+
+
+void
+MainWindow::
+onDiscoveryProgress(int loop, int slave)
+{
+    m_statusText->setText( tr("Discovering analyzers, Loop_%1 address %2, %3 found").arg(loop+1).arg(slave).arg(m_discoveredDevices) );
+}
+
+
+void
+MainWindow::
+onDiscoveryFinished(int, int, int msecs)
+{
+    if (m_discovery->isRunning()) return;
+
+    ui->actionDiscover->setChecked(false);
+    m_statusText->setText( tr("%1 analyzers found in %2 s").arg(m_discoveredDevices).arg(msecs/1000.0, 0, 'f', 1) );
+    m_statusInd->setStyleSheet( m_discoveredDevices ? "background: #0b0;" : "background: red;" );
+    m_statusTimer->start( 5000 );
+}
+
+
 void
 MainWindow::
 calibration_L1P1()
@@ -4782,6 +5180,14 @@ calibration_L1P1()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(0))
+    {
+        m_calibration->stop(0);
+        ui->pushButton_4->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_2->text().toInt();
     QString startSalt = ui->comboBox_31->currentText();
@@ -4827,6 +5233,14 @@ calibration_L1P1()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L1P1, file2_L1P1, file3_L1P1, file4_L1P1, file5_L1P1, file6_L1P1, file7_L1P1);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 0);
+    if (!startCalibration(0, slave, file2_L1P1, file3_L1P1, file4_L1P1))
+    {
+        setStatusError( tr("Loop_1_Pipe_1 calibration could not be started!") );
+        return;
+    }
+
     /// control group box
     
 
@@ -4846,6 +5260,14 @@ calibration_L1P2()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(1))
+    {
+        m_calibration->stop(1);
+        ui->pushButton_5->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_7->text().toInt();
     QString startSalt = ui->comboBox_42->currentText();
@@ -4891,6 +5313,14 @@ calibration_L1P2()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L1P2, file2_L1P2, file3_L1P2, file4_L1P2, file5_L1P2, file6_L1P2, file7_L1P2);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 1);
+    if (!startCalibration(1, slave, file2_L1P2, file3_L1P2, file4_L1P2))
+    {
+        setStatusError( tr("Loop_1_Pipe_2 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_5->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -4906,6 +5336,14 @@ calibration_L1P3()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(2))
+    {
+        m_calibration->stop(2);
+        ui->pushButton_8->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_13->text().toInt();
     QString startSalt = ui->comboBox_51->currentText();
@@ -4951,6 +5389,14 @@ calibration_L1P3()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L1P3, file2_L1P3, file3_L1P3, file4_L1P3, file5_L1P3, file6_L1P3, file7_L1P3);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 2);
+    if (!startCalibration(2, slave, file2_L1P3, file3_L1P3, file4_L1P3))
+    {
+        setStatusError( tr("Loop_1_Pipe_3 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_8->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -4966,6 +5412,14 @@ calibration_L2P1()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(3))
+    {
+        m_calibration->stop(3);
+        ui->pushButton_9->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_15->text().toInt();
     QString startSalt = ui->comboBox_53->currentText();
@@ -5011,6 +5465,14 @@ calibration_L2P1()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L2P1, file2_L2P1, file3_L2P1, file4_L2P1, file5_L2P1, file6_L2P1, file7_L2P1);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 3);
+    if (!startCalibration(3, slave, file2_L2P1, file3_L2P1, file4_L2P1))
+    {
+        setStatusError( tr("Loop_2_Pipe_1 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_9->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5026,6 +5488,14 @@ calibration_L2P2()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(4))
+    {
+        m_calibration->stop(4);
+        ui->pushButton_10->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_17->text().toInt();
     QString startSalt = ui->comboBox_57->currentText();
@@ -5071,6 +5541,14 @@ calibration_L2P2()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L2P2, file2_L2P2, file3_L2P2, file4_L2P2, file5_L2P2, file6_L2P2, file7_L2P2);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 4);
+    if (!startCalibration(4, slave, file2_L2P2, file3_L2P2, file4_L2P2))
+    {
+        setStatusError( tr("Loop_2_Pipe_2 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_10->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5086,6 +5564,14 @@ calibration_L2P3()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(5))
+    {
+        m_calibration->stop(5);
+        ui->pushButton_11->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_19->text().toInt();
     QString startSalt = ui->comboBox_60->currentText();
@@ -5131,6 +5617,14 @@ calibration_L2P3()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L2P3, file2_L2P3, file3_L2P3, file4_L2P3, file5_L2P3, file6_L2P3, file7_L2P3);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 5);
+    if (!startCalibration(5, slave, file2_L2P3, file3_L2P3, file4_L2P3))
+    {
+        setStatusError( tr("Loop_2_Pipe_3 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_11->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5146,6 +5640,14 @@ calibration_L3P1()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(6))
+    {
+        m_calibration->stop(6);
+        ui->pushButton_12->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_21->text().toInt();
     QString startSalt = ui->comboBox_62->currentText();
@@ -5191,6 +5693,14 @@ calibration_L3P1()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L3P1, file2_L3P1, file3_L3P1, file4_L3P1, file5_L3P1, file6_L3P1, file7_L3P1);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 6);
+    if (!startCalibration(6, slave, file2_L3P1, file3_L3P1, file4_L3P1))
+    {
+        setStatusError( tr("Loop_3_Pipe_1 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_12->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5206,6 +5716,14 @@ calibration_L3P2()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(7))
+    {
+        m_calibration->stop(7);
+        ui->pushButton_13->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_23->text().toInt();
     QString startSalt = ui->comboBox_66->currentText();
@@ -5251,6 +5769,14 @@ calibration_L3P2()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L3P2, file2_L3P2, file3_L3P2, file4_L3P2, file5_L3P2, file6_L3P2, file7_L3P2);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 7);
+    if (!startCalibration(7, slave, file2_L3P2, file3_L3P2, file4_L3P2))
+    {
+        setStatusError( tr("Loop_3_Pipe_2 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_13->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5266,6 +5792,14 @@ calibration_L3P3()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(8))
+    {
+        m_calibration->stop(8);
+        ui->pushButton_14->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_25->text().toInt();
     QString startSalt = ui->comboBox_69->currentText();
@@ -5311,6 +5845,14 @@ calibration_L3P3()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L3P3, file2_L3P3, file3_L3P3, file4_L3P3, file5_L3P3, file6_L3P3, file7_L3P3);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 8);
+    if (!startCalibration(8, slave, file2_L3P3, file3_L3P3, file4_L3P3))
+    {
+        setStatusError( tr("Loop_3_Pipe_3 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_14->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5326,6 +5868,14 @@ calibration_L4P1()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(9))
+    {
+        m_calibration->stop(9);
+        ui->pushButton_15->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_27->text().toInt();
     QString startSalt = ui->comboBox_71->currentText();
@@ -5371,6 +5921,14 @@ calibration_L4P1()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L4P1, file2_L4P1, file3_L4P1, file4_L4P1, file5_L4P1, file6_L4P1, file7_L4P1);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 9);
+    if (!startCalibration(9, slave, file2_L4P1, file3_L4P1, file4_L4P1))
+    {
+        setStatusError( tr("Loop_4_Pipe_1 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_15->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5386,6 +5944,14 @@ calibration_L4P2()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(10))
+    {
+        m_calibration->stop(10);
+        ui->pushButton_16->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_29->text().toInt();
     QString startSalt = ui->comboBox_75->currentText();
@@ -5431,6 +5997,14 @@ calibration_L4P2()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L4P2, file2_L4P2, file3_L4P2, file4_L4P2, file5_L4P2, file6_L4P2, file7_L4P2);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 10);
+    if (!startCalibration(10, slave, file2_L4P2, file3_L4P2, file4_L4P2))
+    {
+        setStatusError( tr("Loop_4_Pipe_2 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_16->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5446,6 +6020,14 @@ calibration_L4P3()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(11))
+    {
+        m_calibration->stop(11);
+        ui->pushButton_17->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_31->text().toInt();
     QString startSalt = ui->comboBox_78->currentText();
@@ -5491,6 +6073,14 @@ calibration_L4P3()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L4P3, file2_L4P3, file3_L4P3, file4_L4P3, file5_L4P3, file6_L4P3, file7_L4P3);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 11);
+    if (!startCalibration(11, slave, file2_L4P3, file3_L4P3, file4_L4P3))
+    {
+        setStatusError( tr("Loop_4_Pipe_3 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_17->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5506,6 +6096,14 @@ calibration_L5P1()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(12))
+    {
+        m_calibration->stop(12);
+        ui->pushButton_18->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_33->text().toInt();
     QString startSalt = ui->comboBox_80->currentText();
@@ -5551,6 +6149,14 @@ calibration_L5P1()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L5P1, file2_L5P1, file3_L5P1, file4_L5P1, file5_L5P1, file6_L5P1, file7_L5P1);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 12);
+    if (!startCalibration(12, slave, file2_L5P1, file3_L5P1, file4_L5P1))
+    {
+        setStatusError( tr("Loop_5_Pipe_1 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_18->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5566,6 +6172,14 @@ calibration_L5P2()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(13))
+    {
+        m_calibration->stop(13);
+        ui->pushButton_19->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_35->text().toInt();
     QString startSalt = ui->comboBox_84->currentText();
@@ -5611,6 +6225,14 @@ calibration_L5P2()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L5P2, file2_L5P2, file3_L5P2, file4_L5P2, file5_L5P2, file6_L5P2, file7_L5P2);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 13);
+    if (!startCalibration(13, slave, file2_L5P2, file3_L5P2, file4_L5P2))
+    {
+        setStatusError( tr("Loop_5_Pipe_2 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_19->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5626,6 +6248,14 @@ calibration_L5P3()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(14))
+    {
+        m_calibration->stop(14);
+        ui->pushButton_20->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_110->text().toInt();
     QString startSalt = ui->comboBox_87->currentText();
@@ -5671,6 +6301,14 @@ calibration_L5P3()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L5P3, file2_L5P3, file3_L5P3, file4_L5P3, file5_L5P3, file6_L5P3, file7_L5P3);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 14);
+    if (!startCalibration(14, slave, file2_L5P3, file3_L5P3, file4_L5P3))
+    {
+        setStatusError( tr("Loop_5_Pipe_3 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_20->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5686,6 +6324,14 @@ calibration_L6P1()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(15))
+    {
+        m_calibration->stop(15);
+        ui->pushButton_21->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_121->text().toInt();
     QString startSalt = ui->comboBox_89->currentText();
@@ -5731,6 +6377,14 @@ calibration_L6P1()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L6P1, file2_L6P1, file3_L6P1, file4_L6P1, file5_L6P1, file6_L6P1, file7_L6P1);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 15);
+    if (!startCalibration(15, slave, file2_L6P1, file3_L6P1, file4_L6P1))
+    {
+        setStatusError( tr("Loop_6_Pipe_1 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_21->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5746,6 +6400,14 @@ calibration_L6P2()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(16))
+    {
+        m_calibration->stop(16);
+        ui->pushButton_22->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_123->text().toInt();
     QString startSalt = ui->comboBox_93->currentText();
@@ -5791,6 +6453,14 @@ calibration_L6P2()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L6P2, file2_L6P2, file3_L6P2, file4_L6P2, file5_L6P2, file6_L6P2, file7_L6P2);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 16);
+    if (!startCalibration(16, slave, file2_L6P2, file3_L6P2, file4_L6P2))
+    {
+        setStatusError( tr("Loop_6_Pipe_2 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_22->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5806,6 +6476,14 @@ calibration_L6P3()
     QString path;
     BOOL isEEA = true;
 
+    /// a second press stops the run
+    if (m_calibration->isRunning(17))
+    {
+        m_calibration->stop(17);
+        ui->pushButton_23->setText(tr("S T A R T"));
+        return;
+    }
+
     /// get user inputs
     int slave = ui->lineEdit_129->text().toInt();
     QString startSalt = ui->comboBox_96->currentText();
@@ -5851,6 +6529,14 @@ calibration_L6P3()
     /// create files
     createLoopFiles(slave, path, isEEA, startSalt, stopSalt, oilTemp, volume, startWaterRun, stopWaterRun, startOilRun, stopOilRun, file1_L6P3, file2_L6P3, file3_L6P3, file4_L6P3, file5_L6P3, file6_L6P3, file7_L6P3);
 
+    /// start sampling
+    updateRegisters(isEEA ? EEA : RAZ, 17);
+    if (!startCalibration(17, slave, file2_L6P3, file3_L6P3, file4_L6P3))
+    {
+        setStatusError( tr("Loop_6_Pipe_3 calibration could not be started!") );
+        return;
+    }
+
     ui->pushButton_23->setText(tr("S T O P"));
 /*    memset( dest, 0, 1024 );
     modbus_set_slave( m_serialModbus, slave );
@@ -5990,222 +6676,16 @@ onWriteButtonPressed(bool enabled)
     onFunctionCodeChanges();
 }
 
-float 
+void
 MainWindow::
-toFloat(QByteArray f)
+updateRegisters(const bool isRazor, const int i)
 {
-    bool ok;
-    int sign = 1;
-
-    f = f.toHex(); // Convert to Hex
-
-    qDebug() << "QByteArrayToFloat: QByteArray hex = " << f;
-
-    f = QByteArray::number(f.toLongLong(&ok, 16), 2);    // Convert hex to binary
-
-    if(f.length() == 32) {
-        if(f.at(0) == '1') sign =-1;     // If bit 0 is 1 number is negative
-        f.remove(0,1);                   // Remove sign bit
-    }
-
-    QByteArray fraction = f.right(23);  // Get the fractional part
-    double mantissa = 0;
-    for(int i = 0; i < fraction.length(); i++){  // Iterate through the array to claculate the fraction as a decimal.
-        if(fraction.at(i) == '1')
-            mantissa += 1.0 / (pow(2, i+1));
-    }
-
-    int exponent = f.left(f.length() - 23).toLongLong(&ok, 2) - 127;     // Calculate the exponent
-
-    qDebug() << "QByteArrayToFloat: float number = "<< QString::number(sign * pow(2, exponent) * (mantissa + 1.0),'f', 5);
-
-    return (sign * pow(2, exponent) * (mantissa + 1.0));
+    m_pipeProduct[i] = isRazor ? RegisterRazor : RegisterEEA;
 }
 
-void
+const REGISTER_DEF *
 MainWindow::
-updateRegisters(const bool isRazor, const int i)
+pipeRegister(const int pipe, const RegisterId id)
 {
-    if (isRazor)
-    {
-        REG_SN_PIPE[i] = 1;
-        REG_WATERCUT[i] = 3;
-        REG_TEMPERATURE[i] = 5;
-        REG_EMULSTION_PHASE[i] = 7;
-        REG_SALINITY[i] = 9;
-        REG_HARDWARE_VERSION[i] = 11;
-        REG_FIRMWARE_VERSION[i] = 13;
-        REG_OIL_ADJUST[i] = 15;
-        REG_WATER_ADJUST[i] = 17;
-        REG_FREQ[i] = 19;
-        REG_FREQ_AVG[i] = 21;
-        REG_WATERCUT_AVG[i] = 23;
-        REG_WATERCUT_RAW[i] = 25;
-        REG_ANALYZER_MODE[i] = 27;
-        REG_TEMP_AVG[i] = 29;
-        REG_TEMP_ADJUST[i] = 31;
-        REG_TEMP_USER[i] = 33;
-        REG_PROC_AVGING[i] = 35;
-        REG_OIL_INDEX[i] = 37;
-        REG_OIL_P0[i] = 39;
-        REG_OIL_P1[i] = 41;
-        REG_OIL_FREQ_LOW[i] = 43 ;
-        REG_OIL_FREQ_HIGH[i] = 45;
-        REG_SAMPLE_PERIOD[i] = 47;
-        REG_AO_LRV[i] = 49;
-        REG_AO_URV[i] = 51;
-        REG_AO_DAMPEN[i] = 53;
-        REG_BAUD_RATE[i] = 55;
-        REG_SLAVE_ADDRESS[i] = 57;
-        REG_STOP_BITS[i] = 59;
-        REG_OIL_RP[i] = 61;
-        REG_WATER_RP[i] = 63;
-        REG_DENSITY_MODE[i] = 65;
-        REG_OIL_CALC_MAX[i] = 67;
-        REG_OIL_PHASE_CUTOFF[i] = 69;
-        REG_TEMP_OIL_NUM_CURVES[i] = 71;
-        REG_STREAM[i] = 73;
-        REG_OIL_RP_AVG[i] = 75;
-        REG_PLACE_HOLDER[i] = 77;
-        REG_OIL_SAMPLE[i] = 79;
-        REG_RTC_SEC[i] = 81;
-        REG_RTC_MIN[i] = 83;
-        REG_RTC_HR[i] = 85;
-        REG_RTC_DAY[i] = 87;
-        REG_RTC_MON[i] = 89;
-        REG_RTC_YR[i] = 91;
-        REG_RTC_SEC_IN[i] = 93;
-        REG_RTC_MIN_IN[i] = 95;
-        REG_RTC_HR_IN[i] = 97;
-        REG_RTC_DAY_IN[i] = 99;
-        REG_RTC_MON_IN[i] = 101;
-        REG_RTC_YR_IN[i] = 103;
-        REG_AO_MANUAL_VAL[i] = 105;
-        REG_AO_TRIMLO[i] = 107;
-        REG_AO_TRIMHI[i] = 109;
-        REG_DENSITY_ADJ[i] = 111;
-        REG_DENSITY_UNIT[i] = 113;
-        REG_WC_ADJ_DENS[i] = 115;
-        REG_DENSITY_D3[i] = 117;
-        REG_DENSITY_D2[i] = 119;
-        REG_DENSITY_D1[i] = 121;
-        REG_DENSITY_D0[i] = 123;
-        REG_DENSITY_CAL_VAL[i] = 125;
-        REG_MODEL_CODE_0[i] = 127;
-        REG_MODEL_CODE_1[i] = 129;
-        REG_MODEL_CODE_2[i] = 131;
-        REG_MODEL_CODE_3[i] = 133;
-        REG_LOGGING_PERIOD[i] = 135;
-        REG_PASSWORD[i] = 137;
-        REG_STATISTICS[i] = 139;
-        REG_ACTIVE_ERROR[i] = 141;
-        REG_AO_ALARM_MODE[i] = 143;
-        REG_AO_OUTPUT[i] = 145;
-        REG_PHASE_HOLD_CYCLES[i] = 147;
-        REG_RELAY_DELAY[i] = 149;
-        REG_RELAY_SETPOINT[i] = 151;
-        REG_AO_MODE[i] = 153;
-        REG_OIL_DENSITY[i] = 155;
-        REG_OIL_DENSITY_MODBUS[i] = 157;
-        REG_OIL_DENSITY_AI[i] = 159;
-        REG_OIL_DENSITY_MANUAL[i] = 161;
-        REG_OIL_DENSITY_AI_LRV[i] = 163;
-        REG_OIL_DENSITY_AI_URV[i] = 165;
-        REG_OIL_DENS_CORR_MODE[i] = 167;
-        REG_AI_TRIMLO[i] = 169;
-        REG_AI_TRIMHI[i] = 171;
-        REG_AI_MEASURE[i] = 173;
-        REG_AI_TRIMMED[i] = 175;
-    }
-    else
-    {
-        REG_SN_PIPE[i] = 1;
-        REG_WATERCUT[i] = 3;
-        REG_TEMPERATURE[i] = 5;
-        REG_EMULSTION_PHASE[i] = 7;
-        REG_SALINITY[i] = 9;
-        REG_HARDWARE_VERSION[i] = 11;
-        REG_FIRMWARE_VERSION[i] = 13;
-        REG_OIL_ADJUST[i] = 15;
-        REG_WATER_ADJUST[i] = 17;
-        REG_FREQ[i] = 19;
-        REG_FREQ_AVG[i] = 21;
-        REG_WATERCUT_AVG[i] = 23;
-        REG_WATERCUT_RAW[i] = 25;
-        REG_ANALYZER_MODE[i] = 27;
-        REG_TEMP_AVG[i] = 29;
-        REG_TEMP_ADJUST[i] = 31;
-        REG_TEMP_USER[i] = 33;
-        REG_PROC_AVGING[i] = 35;
-        REG_OIL_INDEX[i] = 37;
-        REG_OIL_P0[i] = 39;
-        REG_OIL_P1[i] = 41;
-        REG_OIL_FREQ_LOW[i] = 43 ;
-        REG_OIL_FREQ_HIGH[i] = 45;
-        REG_SAMPLE_PERIOD[i] = 47;
-        REG_AO_LRV[i] = 49;
-        REG_AO_URV[i] = 51;
-        REG_AO_DAMPEN[i] = 53;
-        REG_BAUD_RATE[i] = 55;
-        REG_SLAVE_ADDRESS[i] = 57;
-        REG_STOP_BITS[i] = 59;
-        REG_OIL_RP[i] = 61;
-        REG_WATER_RP[i] = 63;
-        REG_DENSITY_MODE[i] = 65;
-        REG_OIL_CALC_MAX[i] = 67;
-        REG_OIL_PHASE_CUTOFF[i] = 69;
-        REG_TEMP_OIL_NUM_CURVES[i] = 71;
-        REG_STREAM[i] = 73;
-        REG_OIL_RP_AVG[i] = 75;
-        REG_PLACE_HOLDER[i] = 77;
-        REG_OIL_SAMPLE[i] = 79;
-        REG_RTC_SEC[i] = 81;
-        REG_RTC_MIN[i] = 83;
-        REG_RTC_HR[i] = 85;
-        REG_RTC_DAY[i] = 87;
-        REG_RTC_MON[i] = 89;
-        REG_RTC_YR[i] = 91;
-        REG_RTC_SEC_IN[i] = 93;
-        REG_RTC_MIN_IN[i] = 95;
-        REG_RTC_HR_IN[i] = 97;
-        REG_RTC_DAY_IN[i] = 99;
-        REG_RTC_MON_IN[i] = 101;
-        REG_RTC_YR_IN[i] = 103;
-        REG_AO_MANUAL_VAL[i] = 105;
-        REG_AO_TRIMLO[i] = 107;
-        REG_AO_TRIMHI[i] = 109;
-        REG_DENSITY_ADJ[i] = 111;
-        REG_DENSITY_UNIT[i] = 113;
-        REG_WC_ADJ_DENS[i] = 115;
-        REG_DENSITY_D3[i] = 117;
-        REG_DENSITY_D2[i] = 119;
-        REG_DENSITY_D1[i] = 121;
-        REG_DENSITY_D0[i] = 123;
-        REG_DENSITY_CAL_VAL[i] = 125;
-        REG_MODEL_CODE_0[i] = 127;
-        REG_MODEL_CODE_1[i] = 129;
-        REG_MODEL_CODE_2[i] = 131;
-        REG_MODEL_CODE_3[i] = 133;
-        REG_LOGGING_PERIOD[i] = 135;
-        REG_PASSWORD[i] = 137;
-        REG_STATISTICS[i] = 139;
-        REG_ACTIVE_ERROR[i] = 141;
-        REG_AO_ALARM_MODE[i] = 143;
-        REG_AO_OUTPUT[i] = 145;
-        REG_PHASE_HOLD_CYCLES[i] = 147;
-        REG_RELAY_DELAY[i] = 149;
-        REG_RELAY_SETPOINT[i] = 151;
-        REG_AO_MODE[i] = 153;
-        REG_OIL_DENSITY[i] = 155;
-        REG_OIL_DENSITY_MODBUS[i] = 157;
-        REG_OIL_DENSITY_AI[i] = 159;
-        REG_OIL_DENSITY_MANUAL[i] = 161;
-        REG_OIL_DENSITY_AI_LRV[i] = 163;
-        REG_OIL_DENSITY_AI_URV[i] = 165;
-        REG_OIL_DENS_CORR_MODE[i] = 167;
-        REG_AI_TRIMLO[i] = 169;
-        REG_AI_TRIMHI[i] = 171;
-        REG_AI_MEASURE[i] = 173;
-        REG_AI_TRIMMED[i] = 175;
-    }
+    return &RegisterMap::def(m_pipeProduct[pipe], id);
 }
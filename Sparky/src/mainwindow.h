@@ -3,22 +3,35 @@
 
 #include <QMainWindow>
 #include <QTimer>
+#include <QThread>
 #include <QtCharts/QChartView>
 #include <QtCharts/QLineSeries>
 #include <QtCharts/QSplineSeries>
 #include <QtCharts/QValueAxis>
 #include <QtCharts/QCategoryAxis>
 #include <QProgressDialog>
+#include <QLineEdit>
+#include <QVector>
 #include "modbus.h"
 #include "ui_about.h"
 #include "modbus-rtu.h"
 #include "modbus.h"
 #include "qcgaugewidget.h"
+#include "LoopWorker.h"
+#include "CalibrationOrchestrator.h"
+#include "TelemetryPoller.h"
+#include "DiscoveryEngine.h"
+#include "PortInventory.h"
+#include "RegisterMap.h"
+#include "BusMonitorModel.h"
+#include "ProfileModel.h"
 
 #define RELEASE_VERSION             "0.0.7"
 #define RAZ_REG_WATERCUT 
 #define RAZ_REG_WATERCUT 
 #define MAX_PIPE 18
+#define MAX_LOOP 6
+#define GAUGE_REFRESH_INTERVAL 50  // ms, the needles move at 20 fps whatever the poll rate
 #define RAZ true
 #define EEA false
 
@@ -86,6 +99,24 @@ typedef struct pipe_object
 
 } PIPE;
 
+typedef struct profile_item
+{
+    int row;                // profile table row
+    int value;              // index of the value in the profile row
+    int addr;               // 1-based modbus address
+    int width;              // registers (or coils) per value
+    bool readable;          // r/w column allows reading back
+
+} PROFILE_ITEM;
+
+typedef struct register_block
+{
+    int addr;               // 1-based address of the first item
+    int count;              // registers (or coils) covered by the block
+    QVector<PROFILE_ITEM> items;
+
+} REGISTER_BLOCK;
+
 namespace Ui
 {
     class MainWindowClass;
@@ -99,7 +130,8 @@ public:
     MainWindow( QWidget * parent = 0 );
     ~MainWindow();
 
-    void delay(int);
+    bool waitForDeviceRestart(LoopWorker *, const QVector<int> &, const int);
+    void setBusy(const bool);
 
 
     modbus_t * m_serialModbus;
@@ -136,11 +168,11 @@ public:
     void releaseSerialModbus_4();
     void releaseSerialModbus_5();
     void releaseSerialModbus_6();
+    void releaseLoop(int);
 
     void busMonitorAddItem( bool isRequest,uint16_t slave,uint8_t func,uint16_t addr,uint16_t nb,uint16_t expectedCRC,uint16_t actualCRC );
     static void stBusMonitorAddItem( modbus_t * modbus,uint8_t isOut, uint16_t slave, uint8_t func, uint16_t addr,uint16_t nb, uint16_t expectedCRC, uint16_t actualCRC );
     static void stBusMonitorRawData( modbus_t * modbus, uint8_t * data,uint8_t dataLen, uint8_t addNewline );
-    void busMonitorRawData( uint8_t * data, uint8_t dataLen, bool addNewline );
     void connectRadioButtons();
     void connectSerialPort();
     void connectActions();
@@ -156,10 +188,21 @@ public:
     void updateTabIcon(int, bool);
     void updateChartTitle();
     void initializeTabIcons();
-    float toFloat(QByteArray arr);
     void initializeModbusMonitor();
     void onFunctionCodeChanges();
-    QString sendCalibrationRequest(int, modbus_t *, int, int, int, int, uint8_t *, uint16_t *, bool, bool, QString);
+    QString sendCalibrationRequest(int, LoopWorker *, int, int, int, int, int, uint8_t *, uint16_t *, bool, bool, QString);
+    LoopWorker * currentLoopWorker();
+    int currentPipe();
+    QLineEdit * pipeSerialNumber(const int);
+    QVector<int> loopSerialNumbers(const int);
+    QVector<REGISTER_BLOCK> planProfileBlocks(const bool, const bool, const int);
+    QString modbusErrorText(const int, const int);
+    QVector<quint16> packRegisterBlock(const REGISTER_BLOCK &);
+    bool writeCoil(LoopWorker *, const int, const int, const bool);
+    bool writeRegisterBlock(LoopWorker *, const int, const REGISTER_BLOCK &, QString &);
+    bool verifyRegisterBlock(LoopWorker *, const int, const REGISTER_BLOCK &, QString &);
+    void showProfile();
+    bool startCalibration(const int, const int, QFile &, QFile &, QFile &);
 
 private slots:
 
@@ -197,6 +240,16 @@ private slots:
     void calibration_L6P1();
     void calibration_L6P2();
     void calibration_L6P3();
+    void onCalibrationFailed(int, int, int);
+    void updateTelemetryTarget();
+    void refreshGauges();
+    void onDiscoverChecked(bool);
+    void onDeviceDiscovered(const DISCOVERY_DEVICE &);
+    void onDiscoveryProgress(int, int);
+    void onDiscoveryFinished(int, int, int);
+    void onPortsChanged();
+    void onPortOpened(int, int, bool, int);
+    void onPortLost(int, void *, int);
 
     void initializeToolbarIcons(void);
     void initializeFrequencyGauge();
@@ -214,7 +267,8 @@ private slots:
     void enableHexView( void );
     void sendModbusRequest( void );
     void onSendButtonPress( void );
-    void pollForDataOnBus( void );
+    void onBusMonitorItem( bool, int, int, int, int, int, int );
+    void onBusMonitorRawData( const QByteArray &, bool );
     void openBatchProcessor();
     void aboutQModBus( void );
     void onCheckBoxChecked(bool);
@@ -231,6 +285,7 @@ private slots:
     void onUploadEquation();
     void onDownloadEquation();
     void updateRegisters(const bool, const int);
+    const REGISTER_DEF * pipeRegister(const int, const RegisterId);
     void onDownloadButtonChecked(bool);
     void saveCsvFile();
     void onEquationTableChecked(bool);
@@ -513,6 +568,17 @@ signals:
 private:
     void keyPressEvent(QKeyEvent* event);
     void keyReleaseEvent(QKeyEvent* event);
+    void closeEvent(QCloseEvent* event);
+
+    /// marks a sequential flow busy however it returns, see setBusy()
+    class BusyGuard
+    {
+    public:
+        BusyGuard(MainWindow * w) : m_w(w) { m_w->setBusy(true); }
+        ~BusyGuard() { m_w->setBusy(false); }
+    private:
+        MainWindow * m_w;
+    };
 
     Ui::MainWindowClass * ui;
 
@@ -673,7 +739,16 @@ private:
     modbus_t * m_modbus_4;
     modbus_t * m_modbus_5;
     modbus_t * m_modbus_6;
-    modbus_t * m_modbus_snipping;
+    LoopWorker * m_loopWorker[MAX_LOOP];
+    QThread * m_loopThread[MAX_LOOP];
+    CalibrationOrchestrator * m_calibration;
+    DiscoveryEngine * m_discovery;
+    int m_discoveredPipes[MAX_LOOP];    // pipe tabs of the loop filled by the scan
+    int m_discoveredDevices;
+    PortInventory * m_portInventory;
+    int m_openId[MAX_LOOP];             // port being opened by the loop thread, 0 when none
+    int m_startupOpenId[MAX_LOOP];      // the ones opened at startup, for the trace
+    int m_startupOpens;
 
     QWidget * m_statusInd;
     QLabel * m_statusText;
@@ -682,6 +757,7 @@ private:
 
     bool m_tcpActive;
     bool m_poll;
+    int m_busy;             // sequential flows waiting on a loop
 
     // 3 axis line graph display
     QChart *chart;
@@ -702,95 +778,14 @@ private:
     QcNeedleItem * m_densityNeedle;
     QcGaugeWidget * m_RPGauge;
     QcNeedleItem * m_RPNeedle;
+    TelemetryPoller * m_telemetry;
+    BusMonitorModel * m_busMonitor;
+    RawDataModel * m_rawMonitor;
+    ProfileModel * m_profile;
+    QTimer * m_gaugeTimer;
+    TELEMETRY_SAMPLE m_gaugeSample;
     
-    int REG_SN_PIPE[MAX_PIPE];
-    int REG_WATERCUT[MAX_PIPE];
-    int REG_TEMPERATURE[MAX_PIPE];
-    int REG_EMULSTION_PHASE[MAX_PIPE];
-    int REG_SALINITY[MAX_PIPE];
-    int REG_HARDWARE_VERSION[MAX_PIPE];
-    int REG_FIRMWARE_VERSION[MAX_PIPE];
-    int REG_OIL_ADJUST[MAX_PIPE];
-    int REG_WATER_ADJUST[MAX_PIPE];
-    int REG_FREQ[MAX_PIPE];
-    int REG_FREQ_AVG[MAX_PIPE];
-    int REG_WATERCUT_AVG[MAX_PIPE];
-    int REG_WATERCUT_RAW[MAX_PIPE];
-    int REG_ANALYZER_MODE[MAX_PIPE];
-    int REG_TEMP_AVG[MAX_PIPE];
-    int REG_TEMP_ADJUST[MAX_PIPE];
-    int REG_TEMP_USER[MAX_PIPE];
-    int REG_PROC_AVGING[MAX_PIPE];
-    int REG_OIL_INDEX[MAX_PIPE];
-    int REG_OIL_P0[MAX_PIPE];
-    int REG_OIL_P1[MAX_PIPE];
-    int REG_OIL_FREQ_LOW[MAX_PIPE];
-    int REG_OIL_FREQ_HIGH[MAX_PIPE];
-    int REG_SAMPLE_PERIOD[MAX_PIPE];
-    int REG_AO_LRV[MAX_PIPE];
-    int REG_AO_URV[MAX_PIPE];
-    int REG_AO_DAMPEN[MAX_PIPE];
-    int REG_BAUD_RATE[MAX_PIPE];
-    int REG_SLAVE_ADDRESS[MAX_PIPE];
-    int REG_STOP_BITS[MAX_PIPE];
-    int REG_OIL_RP[MAX_PIPE];
-    int REG_WATER_RP[MAX_PIPE];
-    int REG_DENSITY_MODE[MAX_PIPE];
-    int REG_OIL_CALC_MAX[MAX_PIPE];
-    int REG_OIL_PHASE_CUTOFF[MAX_PIPE];
-    int REG_TEMP_OIL_NUM_CURVES[MAX_PIPE];
-    int REG_STREAM[MAX_PIPE];
-    int REG_OIL_RP_AVG[MAX_PIPE];
-    int REG_PLACE_HOLDER[MAX_PIPE];
-    int REG_OIL_SAMPLE[MAX_PIPE];
-    int REG_RTC_SEC[MAX_PIPE];
-    int REG_RTC_MIN[MAX_PIPE];
-    int REG_RTC_HR[MAX_PIPE];
-    int REG_RTC_DAY[MAX_PIPE];
-    int REG_RTC_MON[MAX_PIPE];
-    int REG_RTC_YR[MAX_PIPE];
-    int REG_RTC_SEC_IN[MAX_PIPE];
-    int REG_RTC_MIN_IN[MAX_PIPE];
-    int REG_RTC_HR_IN[MAX_PIPE];
-    int REG_RTC_DAY_IN[MAX_PIPE];
-    int REG_RTC_MON_IN[MAX_PIPE];
-    int REG_RTC_YR_IN[MAX_PIPE];
-    int REG_AO_MANUAL_VAL[MAX_PIPE];
-    int REG_AO_TRIMLO[MAX_PIPE];
-    int REG_AO_TRIMHI[MAX_PIPE];
-    int REG_DENSITY_ADJ[MAX_PIPE];
-    int REG_DENSITY_UNIT[MAX_PIPE];
-    int REG_WC_ADJ_DENS[MAX_PIPE];
-    int REG_DENSITY_D3[MAX_PIPE];
-    int REG_DENSITY_D2[MAX_PIPE];
-    int REG_DENSITY_D1[MAX_PIPE];
-    int REG_DENSITY_D0[MAX_PIPE];
-    int REG_DENSITY_CAL_VAL[MAX_PIPE];
-    int REG_MODEL_CODE_0[MAX_PIPE];
-    int REG_MODEL_CODE_1[MAX_PIPE];
-    int REG_MODEL_CODE_2[MAX_PIPE];
-    int REG_MODEL_CODE_3[MAX_PIPE];
-    int REG_LOGGING_PERIOD[MAX_PIPE];
-    int REG_PASSWORD[MAX_PIPE];
-    int REG_STATISTICS[MAX_PIPE];
-    int REG_ACTIVE_ERROR[MAX_PIPE];
-    int REG_AO_ALARM_MODE[MAX_PIPE];
-    int REG_AO_OUTPUT[MAX_PIPE];
-    int REG_PHASE_HOLD_CYCLES[MAX_PIPE];
-    int REG_RELAY_DELAY[MAX_PIPE];
-    int REG_RELAY_SETPOINT[MAX_PIPE];
-    int REG_AO_MODE[MAX_PIPE];
-    int REG_OIL_DENSITY[MAX_PIPE];
-    int REG_OIL_DENSITY_MODBUS[MAX_PIPE];
-    int REG_OIL_DENSITY_AI[MAX_PIPE];
-    int REG_OIL_DENSITY_MANUAL[MAX_PIPE];
-    int REG_OIL_DENSITY_AI_LRV[MAX_PIPE];
-    int REG_OIL_DENSITY_AI_URV[MAX_PIPE];
-    int REG_OIL_DENS_CORR_MODE[MAX_PIPE];
-    int REG_AI_TRIMLO[MAX_PIPE];
-    int REG_AI_TRIMHI[MAX_PIPE];
-    int REG_AI_MEASURE[MAX_PIPE];
-    int REG_AI_TRIMMED[MAX_PIPE];
+    RegisterProduct m_pipeProduct[MAX_PIPE];   // register map of the analyzer on each pipe
 
 	bool isModbusTransmissionFailed;
 };